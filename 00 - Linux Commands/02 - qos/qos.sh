@@ -10,18 +10,25 @@ tc qdisc del dev $IFACE root
 tc qdisc add dev $IFACE root handle 1: htb default 30
 tc class add dev $IFACE parent 1: classid 1:1 htb rate 500Mbit
 
+# u32 matches "ip dscp" against the whole TOS byte, so DSCP values are shifted left by 2
+
 # Add child qdisc for expedited forwarding (DSCP EF) traffic
 tc class add dev $IFACE parent 1:1 classid 1:10 htb rate 128Kbit ceil 128Kbit
 tc qdisc add dev $IFACE parent 1:10 handle 10: sfq
-tc filter add dev $IFACE protocol ip parent 1:0 prio 1 u32 match ip dscp 46 0xfc flowid 1:10
+tc filter add dev $IFACE protocol ip parent 1:0 prio 1 u32 match ip dscp 0xb8 0xfc flowid 1:10
 
-# Add child qdisc for prioritization (DSCP pri 4) traffic
+# Add child qdisc for prioritization (DSCP pri 4) traffic, CS4 and AF41-43 (DSCP 32-39)
 tc class add dev $IFACE parent 1:1 classid 1:20 htb rate 1Mbit ceil 5Mbit
 tc qdisc add dev $IFACE parent 1:20 handle 20: sfq
-tc filter add dev $IFACE protocol ip parent 1:0 prio 2 u32 match ip dscp 32 0xfc flowid 1:20
+tc filter add dev $IFACE protocol ip parent 1:0 prio 2 u32 match ip dscp 0x80 0xe0 flowid 1:20
 
 # Add child qdisc for all other traffic with traffic shaping to 450Mb/s
 tc class add dev $IFACE parent 1:1 classid 1:30 htb rate 450Mbit
 tc qdisc add dev $IFACE parent 1:30 handle 30: sfq
 
 echo "QoS configuration applied successfully!"
+
+# To check the classes under contention, run the generator in "03 - QoS example"
+# towards a host behind $IFACE and watch the per-class drops:
+#   ./qos -c voice -c video -c bulk -d 10 <IP> 9000
+#   tc -s class show dev $IFACE
@@ -69,18 +69,26 @@ private:
     std::unique_ptr<uint8_t[]> buffer; // Buffer to hold the frame data
     size_t length;                     // Actual length of the frame data
 
-    // Method to calculate CRC32 for data validation
+    // Table of the CRC32 remainder for every possible byte value, built once at compile time
+    static constexpr std::array<uint32_t, 256> makeCRC32Table() {
+        std::array<uint32_t, 256> table{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int j = 0; j < 8; ++j) {
+                crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+            }
+            table[i] = crc;
+        }
+        return table;
+    }
+
+    // Method to calculate CRC32 for data validation, one table lookup per byte
+    // instead of eight shift/xor steps. See "02 - Ethernet/crc32.h" for faster engines.
     uint32_t calculateCRC32(const uint8_t* data, size_t len) const {
+        static constexpr std::array<uint32_t, 256> table = makeCRC32Table();
         uint32_t crc = 0xFFFFFFFF;
         for (size_t i = 0; i < len; ++i) {
-            crc ^= data[i];
-            for (int j = 0; j < 8; ++j) {
-                if (crc & 1) {
-                    crc = (crc >> 1) ^ 0xEDB88320;
-                } else {
-                    crc >>= 1;
-                }
-            }
+            crc = (crc >> 8) ^ table[(crc ^ data[i]) & 0xFF];
         }
         return ~crc;
     }
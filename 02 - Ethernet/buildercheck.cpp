@@ -0,0 +1,163 @@
+// buildercheck.cpp
+// Checks that EthernetFrameBuilder keeps the FCS right while a frame is
+// edited. Random sequences of tag pushes and pops, PCP, DEI, VID, MAC and
+// EtherType rewrites and payload changes are applied both to a builder and
+// to a plain byte vector, and now and then the frame is adopted by a new
+// builder at another offset in the buffer, with or without its FCS. After
+// every edit the builder's frame must equal the vector's bytes followed by
+// their CRC32, and EthernetFrameView must accept its FCS.
+//
+// Build: g++ -std=c++20 -O2 -o buildercheck buildercheck.cpp
+#include <iostream>
+#include <random>
+#include <vector>
+#include <memory>
+#include <cstdlib>
+#include <cstring>
+#include "framebuilder.h"
+
+#define SEQUENCES 5000
+#define EDITS 60
+#define MAX_PAYLOAD 300
+
+// Offsets in the frame, which starts at the destination MAC address
+#define TAGS_OFFSET 12
+#define FRAME_HEADROOM (EthernetFrameView::MAX_TAGS * Dot1qTagView::SIZE)
+
+static int failures = 0;
+
+// Compare the builder's frame with the expected bytes followed by their FCS
+static bool matches(EthernetFrameBuilder& builder, const std::vector<uint8_t>& expected, const char* edit) {
+    std::span<const uint8_t> frame = builder.getFrame();
+    uint32_t fcs = CRC32::calculate(expected.data(), expected.size());
+    bool ok = frame.size() == expected.size() + sizeof(fcs) && std::memcmp(frame.data(), expected.data(), expected.size()) == 0 &&
+              std::memcmp(frame.data() + expected.size(), &fcs, sizeof(fcs)) == 0 && EthernetFrameView(frame, true).validateFCS();
+    if (!ok && failures++ == 0) {
+        std::cout << "FAILED  after " << edit << ": frame of " << frame.size() << " bytes, expected " << expected.size() + sizeof(fcs)
+                  << " with FCS " << std::hex << fcs << std::dec << std::endl;
+    }
+    return ok;
+}
+
+int main() {
+    std::mt19937 rng(808);
+    std::vector<uint8_t> buffer(FRAME_HEADROOM + 8 + 64 + MAX_PAYLOAD);
+    size_t edits = 0;
+    size_t adoptions = 0;
+    for (int sequence = 0; sequence < SEQUENCES; ++sequence) {
+        auto builder = std::make_unique<EthernetFrameBuilder>(buffer, FRAME_HEADROOM);
+        std::vector<uint8_t> expected(TAGS_OFFSET + 2, 0);
+        size_t tags = 0;
+
+        for (int step = 0; step < EDITS && failures == 0; ++step) {
+            const char* edit = nullptr;
+            switch (rng() % 9) {
+                case 0:
+                    if (tags < EthernetFrameView::MAX_TAGS) {
+                        uint16_t tpid = (rng() % 2) ? 0x88A8 : 0x8100;
+                        uint16_t tci = static_cast<uint16_t>(rng());
+                        builder->pushTag(tpid, tci);
+                        expected.insert(expected.begin() + TAGS_OFFSET,
+                                        { uint8_t(tpid >> 8), uint8_t(tpid), uint8_t(tci >> 8), uint8_t(tci) });
+                        ++tags;
+                        edit = "pushTag";
+                    }
+                    break;
+                case 1:
+                    if (tags > 0) {
+                        builder->popTag();
+                        expected.erase(expected.begin() + TAGS_OFFSET, expected.begin() + TAGS_OFFSET + Dot1qTagView::SIZE);
+                        --tags;
+                        edit = "popTag";
+                    }
+                    break;
+                case 2:
+                    if (tags > 0) {
+                        size_t index = rng() % tags;
+                        uint8_t pcp = rng() % 8;
+                        builder->setPriorityCodePoint(index, pcp);
+                        uint8_t& byte = expected[TAGS_OFFSET + 2 + index * Dot1qTagView::SIZE];
+                        byte = static_cast<uint8_t>((byte & 0x1F) | (pcp << 5));
+                        edit = "setPriorityCodePoint";
+                    }
+                    break;
+                case 3:
+                    if (tags > 0) {
+                        size_t index = rng() % tags;
+                        bool dei = rng() % 2;
+                        builder->setDropEligibleIndicator(index, dei);
+                        uint8_t& byte = expected[TAGS_OFFSET + 2 + index * Dot1qTagView::SIZE];
+                        byte = static_cast<uint8_t>((byte & 0xEF) | (dei << 4));
+                        edit = "setDropEligibleIndicator";
+                    }
+                    break;
+                case 4:
+                    if (tags > 0) {
+                        size_t index = rng() % tags;
+                        uint16_t vid = rng() % 4096;
+                        builder->setVLANIdentifier(index, vid);
+                        uint8_t* tci = &expected[TAGS_OFFSET + 2 + index * Dot1qTagView::SIZE];
+                        tci[0] = static_cast<uint8_t>((tci[0] & 0xF0) | (vid >> 8));
+                        tci[1] = static_cast<uint8_t>(vid);
+                        edit = "setVLANIdentifier";
+                    }
+                    break;
+                case 5: {
+                    MACAddress mac;
+                    for (auto& byte : mac) {
+                        byte = static_cast<uint8_t>(rng());
+                    }
+                    bool source = rng() % 2;
+                    if (source) {
+                        builder->setSource(mac);
+                    } else {
+                        builder->setDestination(mac);
+                    }
+                    std::memcpy(expected.data() + (source ? 6 : 0), mac.data(), mac.size());
+                    edit = source ? "setSource" : "setDestination";
+                    break;
+                }
+                case 6: {
+                    // Not a TPID, so the view still sees the same tags
+                    uint16_t type = (rng() % 2) ? 0x0800 : 0x86DD;
+                    builder->setEtherType(type);
+                    expected[TAGS_OFFSET + tags * Dot1qTagView::SIZE] = static_cast<uint8_t>(type >> 8);
+                    expected[TAGS_OFFSET + tags * Dot1qTagView::SIZE + 1] = static_cast<uint8_t>(type);
+                    edit = "setEtherType";
+                    break;
+                }
+                case 7: {
+                    std::vector<uint8_t> payload(46 + rng() % (MAX_PAYLOAD - 46));
+                    for (auto& byte : payload) {
+                        byte = static_cast<uint8_t>(rng());
+                    }
+                    builder->setPayload(payload);
+                    expected.resize(TAGS_OFFSET + tags * Dot1qTagView::SIZE + 2);
+                    expected.insert(expected.end(), payload.begin(), payload.end());
+                    edit = "setPayload";
+                    break;
+                }
+                default: {
+                    // Hand the frame to a new builder, as a receive path would, with room for the tags left and a few bytes
+                    std::span<const uint8_t> frame = builder->getFrame();
+                    std::vector<uint8_t> copy(frame.begin(), frame.end());
+                    bool hasFCS = rng() % 4 != 0;
+                    size_t headroom = (EthernetFrameView::MAX_TAGS - tags) * Dot1qTagView::SIZE + rng() % 8;
+                    std::memcpy(buffer.data() + headroom, copy.data(), copy.size());
+                    builder = std::make_unique<EthernetFrameBuilder>(buffer, headroom, copy.size() - (hasFCS ? 0 : sizeof(uint32_t)), hasFCS);
+                    ++adoptions;
+                    edit = hasFCS ? "adopting with FCS" : "adopting without FCS";
+                    break;
+                }
+            }
+            if (edit) {
+                ++edits;
+                matches(*builder, expected, edit);
+            }
+        }
+    }
+
+    std::cout << SEQUENCES << " sequences, " << edits << " edits, " << adoptions << " adoptions: "
+              << (failures ? "FAILED" : "ok") << std::endl;
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
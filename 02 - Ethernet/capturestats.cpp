@@ -0,0 +1,189 @@
+// capturestats.cpp
+// Multi-threaded capture analysis. The capture is split into record-aligned
+// byte ranges, one per worker thread. Each worker parses its range with
+// EthernetFrameView and counts frames and bytes per VLAN, per PCP and per
+// EtherType, plus FCS failures, into its own tables. The tables are merged
+// once all workers finish, so the result does not depend on the thread count.
+//
+// Build: g++ -std=c++20 -O2 -pthread -o capturestats capturestats.cpp
+// Usage: ./capturestats <capture.pcap|capture.pcapng> [threads]
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+#include "pcap.h"
+
+#define UNTAGGED_VLAN 4096 // Index of the untagged row in the VLAN table
+#define THREADS_PER_CPU 16 // Most threads accepted per hardware thread
+
+// Frames and bytes seen for one key
+struct Counter {
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+
+    void add(uint64_t length) {
+        frames += 1;
+        bytes += length;
+    }
+
+    void merge(const Counter& other) {
+        frames += other.frames;
+        bytes += other.bytes;
+    }
+};
+
+// Counters owned by one worker thread; nothing in here is shared while counting
+struct FrameStatistics {
+    std::vector<Counter> vlans = std::vector<Counter>(UNTAGGED_VLAN + 1); // Outer VID, or untagged
+    std::vector<Counter> priorities = std::vector<Counter>(8);            // Outer PCP of tagged frames
+    std::vector<Counter> etherTypes = std::vector<Counter>(65536);        // EtherType after the tags
+    Counter total;                                                        // All frames
+    uint64_t fcsChecked = 0;                                              // Frames that carried an FCS
+    uint64_t fcsFailures = 0;                                             // Frames whose FCS did not match
+    uint64_t skipped = 0;                                                 // Records that were not parseable Ethernet
+    double seconds = 0;                                                   // Time the worker spent in its range
+    std::string error;                                                    // Why the worker stopped early, empty if it did not
+
+    void add(const CaptureRecord& record, const EthernetFrameView& view) {
+        uint64_t length = record.originalLength;
+        total.add(length);
+        if (view.getTagCount()) {
+            Dot1qTagView tag = view.getTag(0);
+            vlans[tag.getVLANIdentifier()].add(length);
+            priorities[tag.getPriorityCodePoint()].add(length);
+        } else {
+            vlans[UNTAGGED_VLAN].add(length);
+        }
+        etherTypes[view.getEtherType()].add(length);
+        if (view.hasFCS()) {
+            ++fcsChecked;
+            fcsFailures += !view.validateFCS();
+        }
+    }
+
+    void merge(const FrameStatistics& other) {
+        for (size_t i = 0; i < vlans.size(); ++i) {
+            vlans[i].merge(other.vlans[i]);
+        }
+        for (size_t i = 0; i < priorities.size(); ++i) {
+            priorities[i].merge(other.priorities[i]);
+        }
+        for (size_t i = 0; i < etherTypes.size(); ++i) {
+            etherTypes[i].merge(other.etherTypes[i]);
+        }
+        total.merge(other.total);
+        fcsChecked += other.fcsChecked;
+        fcsFailures += other.fcsFailures;
+        skipped += other.skipped;
+    }
+};
+
+static void printTable(const char* title, const std::vector<Counter>& table, bool hex, size_t untagged = SIZE_MAX) {
+    std::cout << title << std::endl;
+    for (size_t i = 0; i < table.size(); ++i) {
+        if (table[i].frames == 0) {
+            continue;
+        }
+        std::cout << "  ";
+        if (hex) {
+            std::cout << "0x" << std::hex << std::setw(4) << std::setfill('0') << i << std::dec << std::setfill(' ');
+        } else if (i == untagged) {
+            std::cout << "untagged";
+        } else {
+            std::cout << std::setw(6) << i;
+        }
+        std::cout << ": " << table[i].frames << " frames, " << table[i].bytes << " bytes" << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+    size_t threads = cpus;
+    bool valid = argc == 2 || argc == 3;
+    if (argc == 3) {
+        // strtoul() would wrap a negative count around to a huge one
+        char* end = nullptr;
+        threads = (argv[2][0] >= '0' && argv[2][0] <= '9') ? std::strtoul(argv[2], &end, 10) : 0;
+        valid = end != nullptr && *end == '\0' && threads >= 1 && threads <= cpus * THREADS_PER_CPU;
+    }
+    if (!valid) {
+        std::cerr << "Usage: " << argv[0] << " <capture> [threads, 1 to " << cpus * THREADS_PER_CPU << "]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try {
+        CaptureFile capture(argv[1]);
+        std::vector<CaptureRange> ranges = capture.split(threads);
+
+        // Each worker gets its own heap allocation so counters never share a cache line
+        std::vector<std::unique_ptr<FrameStatistics>> results;
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            results.push_back(std::make_unique<FrameStatistics>());
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            workers.emplace_back([&capture, &ranges, &results, i]() {
+                FrameStatistics& stats = *results[i];
+                auto begin = std::chrono::steady_clock::now();
+                // An exception escaping a thread would terminate the process, so it is kept for main to report
+                try {
+                    CaptureReader reader = capture.reader(ranges[i]);
+                    stats.skipped = reader.forEachFrame([&stats](const CaptureRecord& record, const EthernetFrameView& view) {
+                        stats.add(record, view);
+                    });
+                } catch (const std::exception& e) {
+                    stats.error = e.what();
+                }
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+                stats.seconds = elapsed.count();
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        // Merge in range order; a failed range still contributes the records before the failure
+        FrameStatistics merged;
+        bool failed = false;
+        for (size_t i = 0; i < results.size(); ++i) {
+            const FrameStatistics& stats = *results[i];
+            if (!stats.error.empty()) {
+                std::cerr << "Thread " << i << " stopped at range " << ranges[i].begin << "-" << ranges[i].end
+                          << ": " << stats.error << std::endl;
+                failed = true;
+            }
+            std::cout << "Thread " << std::setw(2) << i << ": " << stats.total.frames << " frames in "
+                      << std::fixed << std::setprecision(3) << stats.seconds << " s, "
+                      << std::setprecision(2) << (stats.seconds > 0 ? stats.total.frames / stats.seconds / 1e6 : 0)
+                      << " Mframes/s" << std::endl;
+            merged.merge(stats);
+        }
+
+        std::cout << "Total: " << merged.total.frames << " frames, " << merged.total.bytes << " bytes, "
+                  << ranges.size() << " threads, " << std::setprecision(2)
+                  << merged.total.frames / elapsed.count() / 1e6 << " Mframes/s" << std::endl;
+        std::cout << "FCS: " << merged.fcsChecked << " checked, " << merged.fcsFailures << " failed" << std::endl;
+        std::cout << "Skipped records: " << merged.skipped << std::endl;
+
+        printTable("Per VLAN:", merged.vlans, false, UNTAGGED_VLAN);
+        printTable("Per PCP:", merged.priorities, false);
+        printTable("Per EtherType:", merged.etherTypes, true);
+        if (failed) {
+            return EXIT_FAILURE;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
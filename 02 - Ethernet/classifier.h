@@ -0,0 +1,281 @@
+#ifndef FRAME_CLASSIFIER_H
+#define FRAME_CLASSIFIER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <vector>
+#include <stdexcept>
+#include "framebatch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CLASSIFIER_HAVE_X86 1
+#endif
+
+/**
+ * @brief One classification rule. A frame matches when every condition that is set holds.
+ *
+ * Example: "VID in {10,20,300} and PCP >= 5" is { {10, 20, 300}, 3, 5, 0 }
+ * and "EtherType == 0x0800" is { {}, 0, 0, 0x0800 }.
+ */
+struct FrameRule {
+    static const size_t MAX_VLANS = 8; // Largest VID set per rule
+
+    std::array<uint16_t, MAX_VLANS> vlans{}; // Accepted outer VIDs
+    size_t vlanCount = 0;                    // Number of entries in vlans, 0 accepts any VLAN or untagged
+    uint8_t minPriority = 0;                 // Lowest accepted outer PCP, 0 accepts any
+    uint16_t etherType = 0;                  // Required EtherType after the tags, 0 accepts any
+};
+
+/**
+ * @brief Evaluates a set of FrameRules over blocks of up to 32 frames at once.
+ *
+ * The VLAN, PCP and EtherType of 32 frames are compared against each rule
+ * with 16-bit and 8-bit vector compares (AVX2, or SSE2 when AVX2 is missing)
+ * and reduced to a 32-bit match mask, bit i set when frame i matches any rule.
+ * Traffic that no rule wants can then be dropped before full parsing. A
+ * scalar implementation is used on other CPUs and is the reference for the
+ * vector ones.
+ */
+class FrameClassifier {
+public:
+    static constexpr size_t BLOCK = 32; // Frames classified per call
+
+    /**
+     * @brief Available classifier implementations.
+     */
+    enum class Engine {
+        Scalar,
+        SSE2,
+        AVX2
+    };
+
+    /**
+     * @brief Constructor selecting the fastest engine the CPU supports.
+     */
+    FrameClassifier() : engine(bestEngine()) {}
+
+    /**
+     * @brief Add a rule. Frames matching any rule are selected.
+     * @param rule Rule to add.
+     * @throws std::out_of_range if the rule lists more than MAX_VLANS VIDs.
+     */
+    void addRule(const FrameRule& rule) {
+        if (rule.vlanCount > FrameRule::MAX_VLANS) {
+            throw std::out_of_range("Too many VLANs in rule");
+        }
+        rules.push_back(rule);
+    }
+
+    /**
+     * @brief Force a specific engine, e.g. to compare against the scalar reference.
+     * @param engine Engine to use. Must be supported by the running CPU.
+     */
+    void setEngine(Engine engine) {
+        this->engine = engine;
+    }
+
+    /**
+     * @brief Classify up to 32 rows of decoded columns.
+     * @param columns Columns produced by FrameBatchDecoder.
+     * @param first First row to classify.
+     * @return Match mask, bit i for row first + i.
+     */
+    uint32_t classify(const FrameColumns& columns, size_t first) const {
+        size_t count = (first < columns.count) ? std::min(BLOCK, columns.count - first) : 0;
+        if (count == BLOCK) {
+            return classifyBlock(columns.outerVLAN.data() + first, columns.priority.data() + first,
+                                 columns.etherType.data() + first, count);
+        }
+        Block block;
+        std::memcpy(block.vlan, columns.outerVLAN.data() + first, count * sizeof(uint16_t));
+        std::memcpy(block.priority, columns.priority.data() + first, count);
+        std::memcpy(block.etherType, columns.etherType.data() + first, count * sizeof(uint16_t));
+        return classifyBlock(block.vlan, block.priority, block.etherType, count);
+    }
+
+    /**
+     * @brief Classify up to 32 raw frames without decoding them first.
+     * @param frames Pointers to the start of each frame.
+     * @param lengths Length of each frame in bytes.
+     * @param count Number of frames, at most 32.
+     * @return Match mask, bit i for frame i.
+     */
+    uint32_t classify(const uint8_t* const* frames, const size_t* lengths, size_t count) const {
+        count = std::min(count, BLOCK);
+        Block block;
+        for (size_t i = 0; i < count; ++i) {
+            loadHeader(frames[i], lengths[i], block, i);
+        }
+        return classifyBlock(block.vlan, block.priority, block.etherType, count);
+    }
+
+    /**
+     * @brief Get the fastest engine supported by this CPU.
+     * @return Engine chosen by the constructor.
+     */
+    static Engine bestEngine() {
+#ifdef CLASSIFIER_HAVE_X86
+        static const Engine best = __builtin_cpu_supports("avx2") ? Engine::AVX2 : Engine::SSE2;
+        return best;
+#else
+        return Engine::Scalar;
+#endif
+    }
+
+private:
+    /**
+     * @brief Local copy of the classified fields, padded to a full block.
+     */
+    struct Block {
+        alignas(32) uint16_t vlan[BLOCK] = {};
+        alignas(32) uint8_t priority[BLOCK] = {};
+        alignas(32) uint16_t etherType[BLOCK] = {};
+    };
+
+    std::vector<FrameRule> rules; // Rules, any of which selects a frame
+    Engine engine;                // Implementation used by classify()
+
+    /**
+     * @brief Pull the outer VID, PCP and EtherType of one frame into a block.
+     */
+    static void loadHeader(const uint8_t* frame, size_t length, Block& block, size_t index) {
+        size_t offset = sizeof(EthernetFrameHeader);
+        block.vlan[index] = FrameColumns::UNTAGGED;
+        block.priority[index] = 0;
+        block.etherType[index] = 0;
+        if (length < offset + sizeof(uint16_t)) {
+            return;
+        }
+        uint16_t type = loadBE16(frame + offset);
+        if (EthernetFrameView::isTagProtocolIdentifier(type)) {
+            if (length < offset + Dot1qTagView::SIZE + sizeof(uint16_t)) {
+                return;
+            }
+            uint16_t tci = loadBE16(frame + offset + 2);
+            block.vlan[index] = tci & 0x0FFF;
+            block.priority[index] = tci >> 13;
+            offset += Dot1qTagView::SIZE;
+            type = loadBE16(frame + offset);
+            while (EthernetFrameView::isTagProtocolIdentifier(type) && length >= offset + Dot1qTagView::SIZE + sizeof(uint16_t)) {
+                offset += Dot1qTagView::SIZE;
+                type = loadBE16(frame + offset);
+            }
+        }
+        block.etherType[index] = type;
+    }
+
+    /**
+     * @brief Evaluate all rules over one block. Every pointer must have 32 readable entries.
+     */
+    uint32_t classifyBlock(const uint16_t* vlan, const uint8_t* priority, const uint16_t* etherType, size_t count) const {
+        uint32_t matches = 0;
+        for (const auto& rule : rules) {
+            switch (engine) {
+#ifdef CLASSIFIER_HAVE_X86
+                case Engine::AVX2:
+                    matches |= matchAVX2(rule, vlan, priority, etherType);
+                    break;
+                case Engine::SSE2:
+                    matches |= matchSSE2(rule, vlan, priority, etherType);
+                    break;
+#endif
+                default:
+                    matches |= matchScalar(rule, vlan, priority, etherType);
+                    break;
+            }
+        }
+        return (count == BLOCK) ? matches : matches & ((uint32_t(1) << count) - 1);
+    }
+
+    static uint32_t matchScalar(const FrameRule& rule, const uint16_t* vlan, const uint8_t* priority, const uint16_t* etherType) {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < BLOCK; ++i) {
+            bool match = priority[i] >= rule.minPriority && (rule.etherType == 0 || etherType[i] == rule.etherType);
+            if (match && rule.vlanCount) {
+                match = false;
+                for (size_t v = 0; v < rule.vlanCount; ++v) {
+                    match |= vlan[i] == rule.vlans[v];
+                }
+            }
+            mask |= uint32_t(match) << i;
+        }
+        return mask;
+    }
+
+#ifdef CLASSIFIER_HAVE_X86
+    /**
+     * @brief Narrow two vectors of 16-bit compare results to one 32-bit mask, preserving order.
+     */
+    __attribute__((target("avx2")))
+    static uint32_t packMaskAVX2(__m256i low, __m256i high) {
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(low, high), 0xD8);
+        return static_cast<uint32_t>(_mm256_movemask_epi8(packed));
+    }
+
+    __attribute__((target("avx2")))
+    static uint32_t matchAVX2(const FrameRule& rule, const uint16_t* vlan, const uint8_t* priority, const uint16_t* etherType) {
+        // PCP >= min is max(pcp, min) == pcp on unsigned bytes
+        __m256i pcp = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(priority));
+        __m256i minimum = _mm256_set1_epi8(static_cast<char>(rule.minPriority));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(pcp, minimum), pcp)));
+
+        if (rule.etherType) {
+            __m256i type = _mm256_set1_epi16(static_cast<short>(rule.etherType));
+            __m256i low = _mm256_cmpeq_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(etherType)), type);
+            __m256i high = _mm256_cmpeq_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(etherType + 16)), type);
+            mask &= packMaskAVX2(low, high);
+        }
+
+        if (rule.vlanCount) {
+            __m256i vlanLow = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(vlan));
+            __m256i vlanHigh = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(vlan + 16));
+            __m256i low = _mm256_setzero_si256();
+            __m256i high = _mm256_setzero_si256();
+            for (size_t v = 0; v < rule.vlanCount; ++v) {
+                __m256i vid = _mm256_set1_epi16(static_cast<short>(rule.vlans[v]));
+                low = _mm256_or_si256(low, _mm256_cmpeq_epi16(vlanLow, vid));
+                high = _mm256_or_si256(high, _mm256_cmpeq_epi16(vlanHigh, vid));
+            }
+            mask &= packMaskAVX2(low, high);
+        }
+        return mask;
+    }
+
+    static uint32_t matchSSE2(const FrameRule& rule, const uint16_t* vlan, const uint8_t* priority, const uint16_t* etherType) {
+        uint32_t mask = 0;
+        for (size_t half = 0; half < BLOCK; half += 16) {
+            __m128i pcp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(priority + half));
+            __m128i minimum = _mm_set1_epi8(static_cast<char>(rule.minPriority));
+            uint32_t part = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(pcp, minimum), pcp)));
+
+            if (rule.etherType) {
+                __m128i type = _mm_set1_epi16(static_cast<short>(rule.etherType));
+                __m128i low = _mm_cmpeq_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(etherType + half)), type);
+                __m128i high = _mm_cmpeq_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(etherType + half + 8)), type);
+                part &= static_cast<uint32_t>(_mm_movemask_epi8(_mm_packs_epi16(low, high)));
+            }
+
+            if (rule.vlanCount) {
+                __m128i vlanLow = _mm_loadu_si128(reinterpret_cast<const __m128i*>(vlan + half));
+                __m128i vlanHigh = _mm_loadu_si128(reinterpret_cast<const __m128i*>(vlan + half + 8));
+                __m128i low = _mm_setzero_si128();
+                __m128i high = _mm_setzero_si128();
+                for (size_t v = 0; v < rule.vlanCount; ++v) {
+                    __m128i vid = _mm_set1_epi16(static_cast<short>(rule.vlans[v]));
+                    low = _mm_or_si128(low, _mm_cmpeq_epi16(vlanLow, vid));
+                    high = _mm_or_si128(high, _mm_cmpeq_epi16(vlanHigh, vid));
+                }
+                part &= static_cast<uint32_t>(_mm_movemask_epi8(_mm_packs_epi16(low, high)));
+            }
+            mask |= part << half;
+        }
+        return mask;
+    }
+#endif
+};
+
+#endif // FRAME_CLASSIFIER_H
@@ -0,0 +1,136 @@
+// classifiercheck.cpp
+// Checks that the vector engines of FrameClassifier agree with the scalar
+// reference. Random rule sets are applied to random batches of untagged,
+// 802.1Q, QinQ and runt frames, drawing VIDs, priorities and EtherTypes from
+// small pools so that rules both hit and miss. Every block is classified
+// with each engine the CPU supports, from raw frames and from the columns
+// FrameBatchDecoder produces, including a partial last block. Each engine's
+// match masks must be identical to the scalar engine's for the same input.
+//
+// Build: g++ -std=c++20 -O2 -o classifiercheck classifiercheck.cpp
+#include <iostream>
+#include <random>
+#include <vector>
+#include <cstdlib>
+#include "classifier.h"
+
+#define ROUNDS 2000
+#define MAX_FRAMES 200 // Frames per batch, so the last block is usually partial
+
+static const uint16_t VIDS[] = { 1, 10, 20, 100, 300, 4094 };
+static const uint16_t ETHER_TYPES[] = { 0x0800, 0x86DD, 0x0806, 0x88CC, 0x8100 };
+static const uint16_t TPIDS[] = { 0x8100, 0x88A8, 0x9100 };
+
+template <typename T, size_t N>
+static T pick(std::mt19937& rng, const T (&values)[N]) {
+    return values[rng() % N];
+}
+
+// A frame of 0 to 5 tags, or a runt cut anywhere in its header
+static std::vector<uint8_t> randomFrame(std::mt19937& rng) {
+    std::vector<uint8_t> frame(12);
+    for (auto& byte : frame) {
+        byte = static_cast<uint8_t>(rng());
+    }
+    size_t tags = rng() % 6;
+    for (size_t t = 0; t < tags; ++t) {
+        uint16_t tpid = pick(rng, TPIDS);
+        uint16_t tci = static_cast<uint16_t>((rng() % 8) << 13 | (rng() % 2) << 12 | pick(rng, VIDS));
+        frame.insert(frame.end(), { uint8_t(tpid >> 8), uint8_t(tpid), uint8_t(tci >> 8), uint8_t(tci) });
+    }
+    uint16_t type = pick(rng, ETHER_TYPES);
+    frame.insert(frame.end(), { uint8_t(type >> 8), uint8_t(type) });
+    frame.resize(rng() % 8 ? frame.size() + 46 : rng() % frame.size(), 0);
+    return frame;
+}
+
+static FrameRule randomRule(std::mt19937& rng) {
+    FrameRule rule;
+    rule.vlanCount = rng() % 3 ? rng() % (FrameRule::MAX_VLANS + 1) : 0;
+    for (size_t v = 0; v < rule.vlanCount; ++v) {
+        rule.vlans[v] = rng() % 8 ? pick(rng, VIDS) : FrameColumns::UNTAGGED;
+    }
+    rule.minPriority = rng() % 2 ? rng() % 8 : 0;
+    rule.etherType = rng() % 2 ? pick(rng, ETHER_TYPES) : 0;
+    return rule;
+}
+
+static const char* name(FrameClassifier::Engine engine) {
+    switch (engine) {
+        case FrameClassifier::Engine::AVX2:
+            return "AVX2";
+        case FrameClassifier::Engine::SSE2:
+            return "SSE2";
+        default:
+            return "scalar";
+    }
+}
+
+int main() {
+    std::vector<FrameClassifier::Engine> engines = { FrameClassifier::Engine::Scalar };
+#ifdef CLASSIFIER_HAVE_X86
+    engines.push_back(FrameClassifier::Engine::SSE2);
+    if (FrameClassifier::bestEngine() == FrameClassifier::Engine::AVX2) {
+        engines.push_back(FrameClassifier::Engine::AVX2);
+    }
+#endif
+
+    std::mt19937 rng(4242);
+    FrameColumns columns;
+    columns.reserve(MAX_FRAMES);
+    std::vector<size_t> mismatches(engines.size());
+    size_t blocks = 0;
+    size_t matched = 0;
+    for (int round = 0; round < ROUNDS; ++round) {
+        std::vector<FrameClassifier> classifiers(engines.size());
+        size_t ruleCount = 1 + rng() % 4;
+        for (size_t r = 0; r < ruleCount; ++r) {
+            FrameRule rule = randomRule(rng);
+            for (auto& classifier : classifiers) {
+                classifier.addRule(rule);
+            }
+        }
+        for (size_t e = 0; e < engines.size(); ++e) {
+            classifiers[e].setEngine(engines[e]);
+        }
+
+        std::vector<std::vector<uint8_t>> frames(1 + rng() % MAX_FRAMES);
+        std::vector<const uint8_t*> pointers;
+        std::vector<size_t> lengths;
+        for (auto& frame : frames) {
+            frame = randomFrame(rng);
+            pointers.push_back(frame.data());
+            lengths.push_back(frame.size());
+        }
+        FrameBatchDecoder::decode(pointers.data(), lengths.data(), frames.size(), columns, false);
+
+        for (size_t first = 0; first < frames.size(); first += FrameClassifier::BLOCK) {
+            size_t count = std::min(FrameClassifier::BLOCK, frames.size() - first);
+            // The two inputs may read a malformed tag stack differently, so each has its own reference
+            uint32_t reference = classifiers[0].classify(pointers.data() + first, lengths.data() + first, count);
+            uint32_t decodedReference = classifiers[0].classify(columns, first);
+            matched += __builtin_popcount(reference);
+            ++blocks;
+            for (size_t e = 0; e < engines.size(); ++e) {
+                uint32_t raw = classifiers[e].classify(pointers.data() + first, lengths.data() + first, count);
+                uint32_t decoded = classifiers[e].classify(columns, first);
+                if (raw != reference || decoded != decodedReference) {
+                    if (mismatches[e]++ == 0) {
+                        std::cout << name(engines[e]) << " differs in round " << round << ", block at " << first << ": raw "
+                                  << std::hex << raw << " (scalar " << reference << "), columns " << decoded << " (scalar " << decodedReference << ")"
+                                  << std::dec << std::endl;
+                    }
+                }
+            }
+        }
+    }
+
+    bool ok = true;
+    for (size_t e = 0; e < engines.size(); ++e) {
+        std::cout << name(engines[e]) << ": " << blocks << " blocks, " << mismatches[e] << " mismatches, "
+                  << (mismatches[e] ? "FAILED" : "ok") << std::endl;
+        ok = ok && mismatches[e] == 0;
+    }
+    std::cout << matched << " of the frames classified matched a rule" << std::endl;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,402 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <span>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CRC32_HAVE_PCLMUL 1
+#endif
+
+#define CRC32_POLYNOMIAL 0xEDB88320 // Reflected IEEE 802.3 polynomial
+
+typedef std::array<std::array<uint32_t, 256>, 16> CRC32SliceTables;
+
+/**
+ * @brief Build the CRC32 slicing tables at compile time.
+ * @return Table 0 is the classic byte table, table k advances a byte k positions further.
+ */
+constexpr CRC32SliceTables makeCRC32SliceTables() {
+    CRC32SliceTables tables{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int j = 0; j < 8; ++j) {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32_POLYNOMIAL : crc >> 1;
+        }
+        tables[0][i] = crc;
+    }
+    for (size_t k = 1; k < tables.size(); ++k) {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t previous = tables[k - 1][i];
+            tables[k][i] = (previous >> 8) ^ tables[0][previous & 0xFF];
+        }
+    }
+    return tables;
+}
+
+inline constexpr CRC32SliceTables crc32SliceTables = makeCRC32SliceTables();
+
+/**
+ * @brief Multiply two polynomials modulo the CRC32 polynomial, in the reflected bit order.
+ * @param a First factor.
+ * @param b Second factor.
+ * @return a * b mod P.
+ */
+constexpr uint32_t multiplyCRC32(uint32_t a, uint32_t b) {
+    uint32_t product = 0;
+    for (uint32_t m = uint32_t(1) << 31; m != 0; m >>= 1) {
+        if (a & m) {
+            product ^= b;
+        }
+        b = (b & 1) ? (b >> 1) ^ CRC32_POLYNOMIAL : b >> 1;
+    }
+    return product;
+}
+
+/**
+ * @brief Build the table of x^(2^k) mod P used to advance a CRC over runs of zero bits.
+ * @return Entry k is x^(2^k) mod P.
+ */
+constexpr std::array<uint32_t, 64> makeCRC32PowerTable() {
+    std::array<uint32_t, 64> powers{};
+    powers[0] = uint32_t(1) << 30; // x^1
+    for (size_t k = 1; k < powers.size(); ++k) {
+        powers[k] = multiplyCRC32(powers[k - 1], powers[k - 1]);
+    }
+    return powers;
+}
+
+inline constexpr std::array<uint32_t, 64> crc32PowerTable = makeCRC32PowerTable();
+
+/**
+ * @brief CRC-32 (IEEE 802.3) engine used to compute the Ethernet Frame Check Sequence.
+ *
+ * All engines are bit-exact with the classic reflected bit-at-a-time algorithm
+ * (polynomial 0xEDB88320, initial value 0xFFFFFFFF, final complement). The
+ * running value passed to and returned from update() is the finished CRC, so a
+ * frame spread over several buffers is computed by chaining update() calls
+ * starting from 0.
+ * @link https://en.wikipedia.org/wiki/Cyclic_redundancy_check
+ */
+class CRC32 {
+public:
+    /**
+     * @brief Available CRC32 implementations.
+     */
+    enum class Engine {
+        Bitwise,   // One shift/xor per bit, the reference implementation
+        SliceBy8,  // Eight 256-entry tables, 8 bytes per iteration
+        SliceBy16, // Sixteen 256-entry tables, 16 bytes per iteration
+        PCLMUL     // Carry-less multiply folding, 64 bytes per iteration
+    };
+
+    /**
+     * @brief Compute the CRC32 of a single buffer.
+     * @param data Pointer to the data.
+     * @param len Length of the data.
+     * @return CRC32 value.
+     */
+    static uint32_t calculate(const uint8_t* data, size_t len) {
+        return update(0, std::span<const uint8_t>(data, len));
+    }
+
+    /**
+     * @brief Continue a CRC32 over another buffer using the fastest supported engine.
+     * @param crc CRC32 of the preceding data, or 0 to start.
+     * @param data Next buffer to include.
+     * @return CRC32 of the preceding data followed by this buffer.
+     */
+    static uint32_t update(uint32_t crc, std::span<const uint8_t> data) {
+        return update(bestEngine(), crc, data);
+    }
+
+    /**
+     * @brief Continue a CRC32 over another buffer using a specific engine.
+     * @param engine Engine to use. Must be supported by the running CPU.
+     * @param crc CRC32 of the preceding data, or 0 to start.
+     * @param data Next buffer to include.
+     * @return CRC32 of the preceding data followed by this buffer.
+     */
+    static uint32_t update(Engine engine, uint32_t crc, std::span<const uint8_t> data) {
+        uint32_t state = ~crc;
+        switch (engine) {
+            case Engine::Bitwise:
+                state = updateBitwise(state, data.data(), data.size());
+                break;
+            case Engine::SliceBy8:
+                state = updateSliceBy8(state, data.data(), data.size());
+                break;
+            case Engine::SliceBy16:
+                state = updateSliceBy16(state, data.data(), data.size());
+                break;
+            case Engine::PCLMUL:
+                state = updatePCLMUL(state, data.data(), data.size());
+                break;
+        }
+        return ~state;
+    }
+
+    /**
+     * @brief Combine the CRC32s of two adjacent buffers without reading either buffer.
+     * @param crcA CRC32 of the first buffer.
+     * @param crcB CRC32 of the second buffer.
+     * @param lengthB Length of the second buffer.
+     * @return CRC32 of the first buffer followed by the second.
+     */
+    static uint32_t combine(uint32_t crcA, uint32_t crcB, size_t lengthB) {
+        return shift(crcA, lengthB) ^ crcB;
+    }
+
+    /**
+     * @brief Update a CRC32 after bytes inside the message were overwritten with the same number of bytes.
+     *
+     * Costs O(changed bytes + log(trailing)) instead of a pass over the whole message,
+     * which makes rewriting a field such as a VLAN tag's PCP cheap.
+     * @param crc CRC32 of the message before the change.
+     * @param before Bytes that were replaced.
+     * @param after Bytes that replaced them, same length as before.
+     * @param trailing Number of message bytes after the changed bytes.
+     * @return CRC32 of the changed message.
+     */
+    static uint32_t replace(uint32_t crc, std::span<const uint8_t> before, std::span<const uint8_t> after, size_t trailing) {
+        // The CRC is affine in the message, so the change is the raw CRC of the xor of the two versions
+        uint32_t delta = update(0xFFFFFFFF, before) ^ update(0xFFFFFFFF, after);
+        return crc ^ shift(delta, trailing);
+    }
+
+    /**
+     * @brief Update a CRC32 after the start of the message was replaced by a prefix of any length.
+     * @param crc CRC32 of the message before the change.
+     * @param before CRC32 of the prefix that was removed.
+     * @param after CRC32 of the prefix that replaced it.
+     * @param suffixLength Number of unchanged bytes after the prefix.
+     * @return CRC32 of the changed message.
+     */
+    static uint32_t replacePrefix(uint32_t crc, uint32_t before, uint32_t after, size_t suffixLength) {
+        return crc ^ shift(before ^ after, suffixLength);
+    }
+
+    /**
+     * @brief Check whether an engine can run on this CPU.
+     * @param engine Engine to check.
+     * @return True if the engine is usable.
+     */
+    static bool isSupported(Engine engine) {
+        if (engine != Engine::PCLMUL) {
+            return true;
+        }
+#ifdef CRC32_HAVE_PCLMUL
+        static const bool supported = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+        return supported;
+#else
+        return false;
+#endif
+    }
+
+    /**
+     * @brief Get the fastest engine supported by this CPU, detected once via CPUID.
+     * @return Engine used by update() when none is specified.
+     */
+    static Engine bestEngine() {
+        static const Engine best = isSupported(Engine::PCLMUL) ? Engine::PCLMUL : Engine::SliceBy16;
+        return best;
+    }
+
+    /**
+     * @brief Get a printable name for an engine.
+     * @param engine Engine to name.
+     * @return Name of the engine.
+     */
+    static const char* engineName(Engine engine) {
+        switch (engine) {
+            case Engine::Bitwise:   return "bitwise";
+            case Engine::SliceBy8:  return "slice-by-8";
+            case Engine::SliceBy16: return "slice-by-16";
+            case Engine::PCLMUL:    return "pclmul";
+        }
+        return "unknown";
+    }
+
+private:
+    static constexpr size_t PCLMUL_MINIMUM_LENGTH = 64; // Below this the tables are faster
+
+    static constexpr const CRC32SliceTables& tables = crc32SliceTables;
+
+    /**
+     * @brief Multiply a CRC by x^(8 * length) mod P, i.e. advance it over length zero bytes without the complements.
+     */
+    static uint32_t shift(uint32_t crc, size_t length) {
+        uint64_t bits = uint64_t(length) * 8;
+        for (size_t k = 0; bits != 0; bits >>= 1, ++k) {
+            if (bits & 1) {
+                crc = multiplyCRC32(crc32PowerTable[k], crc);
+            }
+        }
+        return crc;
+    }
+
+    /**
+     * @brief Read a little-endian 32-bit value without alignment requirements.
+     */
+    static uint32_t loadLE32(const uint8_t* p) {
+        return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+    }
+
+    static uint32_t updateBitwise(uint32_t crc, const uint8_t* data, size_t len) {
+        for (size_t i = 0; i < len; ++i) {
+            crc ^= data[i];
+            for (int j = 0; j < 8; ++j) {
+                if (crc & 1) {
+                    crc = (crc >> 1) ^ CRC32_POLYNOMIAL;
+                } else {
+                    crc >>= 1;
+                }
+            }
+        }
+        return crc;
+    }
+
+    static uint32_t updateBytewise(uint32_t crc, const uint8_t* data, size_t len) {
+        for (size_t i = 0; i < len; ++i) {
+            crc = (crc >> 8) ^ tables[0][(crc ^ data[i]) & 0xFF];
+        }
+        return crc;
+    }
+
+    static uint32_t updateSliceBy8(uint32_t crc, const uint8_t* data, size_t len) {
+        while (len >= 8) {
+            uint32_t one = crc ^ loadLE32(data);
+            uint32_t two = loadLE32(data + 4);
+            crc = tables[7][one & 0xFF] ^ tables[6][(one >> 8) & 0xFF] ^
+                  tables[5][(one >> 16) & 0xFF] ^ tables[4][one >> 24] ^
+                  tables[3][two & 0xFF] ^ tables[2][(two >> 8) & 0xFF] ^
+                  tables[1][(two >> 16) & 0xFF] ^ tables[0][two >> 24];
+            data += 8;
+            len -= 8;
+        }
+        return updateBytewise(crc, data, len);
+    }
+
+    static uint32_t updateSliceBy16(uint32_t crc, const uint8_t* data, size_t len) {
+        while (len >= 16) {
+            uint32_t one = crc ^ loadLE32(data);
+            uint32_t two = loadLE32(data + 4);
+            uint32_t three = loadLE32(data + 8);
+            uint32_t four = loadLE32(data + 12);
+            crc = tables[15][one & 0xFF] ^ tables[14][(one >> 8) & 0xFF] ^
+                  tables[13][(one >> 16) & 0xFF] ^ tables[12][one >> 24] ^
+                  tables[11][two & 0xFF] ^ tables[10][(two >> 8) & 0xFF] ^
+                  tables[9][(two >> 16) & 0xFF] ^ tables[8][two >> 24] ^
+                  tables[7][three & 0xFF] ^ tables[6][(three >> 8) & 0xFF] ^
+                  tables[5][(three >> 16) & 0xFF] ^ tables[4][three >> 24] ^
+                  tables[3][four & 0xFF] ^ tables[2][(four >> 8) & 0xFF] ^
+                  tables[1][(four >> 16) & 0xFF] ^ tables[0][four >> 24];
+            data += 16;
+            len -= 16;
+        }
+        return updateBytewise(crc, data, len);
+    }
+
+    static uint32_t updatePCLMUL(uint32_t crc, const uint8_t* data, size_t len) {
+#ifdef CRC32_HAVE_PCLMUL
+        if (len >= PCLMUL_MINIMUM_LENGTH) {
+            size_t folded = len & ~size_t(15);
+            crc = foldPCLMUL(crc, data, folded);
+            data += folded;
+            len -= folded;
+        }
+#endif
+        return updateSliceBy16(crc, data, len);
+    }
+
+#ifdef CRC32_HAVE_PCLMUL
+    /**
+     * @brief Fold a buffer with carry-less multiplication and Barrett-reduce to 32 bits.
+     * @param crc Running (uncomplemented) CRC state.
+     * @param data Pointer to the data.
+     * @param len Length of the data, at least 64 and a multiple of 16.
+     * @return Updated (uncomplemented) CRC state.
+     * @link https://www.intel.com/content/dam/www/public/us/en/documents/white-papers/fast-crc-computation-generic-polynomials-pclmulqdq-paper.pdf
+     */
+    __attribute__((target("pclmul,sse4.1")))
+    static uint32_t foldPCLMUL(uint32_t crc, const uint8_t* data, size_t len) {
+        // Bit-reflected folding constants x^(4*128+32), x^(4*128-32), x^(128+32),
+        // x^(128-32), x^64 mod P, followed by the Barrett constants for P.
+        alignas(16) static const uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+        alignas(16) static const uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+        alignas(16) static const uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+        alignas(16) static const uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+
+        __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+        x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x00));
+        x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x10));
+        x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x20));
+        x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x30));
+        x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(crc)));
+        x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2));
+        data += 64;
+        len -= 64;
+
+        // Fold four 128-bit lanes in parallel, 64 bytes per iteration
+        while (len >= 64) {
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+            x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+            x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+            x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+            x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+            x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+            x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x00)));
+            x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x10)));
+            x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x20)));
+            x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x30)));
+            data += 64;
+            len -= 64;
+        }
+
+        // Fold the four lanes into one
+        x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4));
+        for (__m128i next : { x2, x3, x4 }) {
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, next), x5);
+        }
+
+        // Fold any remaining 16-byte blocks
+        while (len >= 16) {
+            x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+            data += 16;
+            len -= 16;
+        }
+
+        // Reduce 128 bits to 64 bits
+        x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+        x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+        x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+        x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0));
+        x2 = _mm_srli_si128(x1, 4);
+        x1 = _mm_and_si128(x1, x3);
+        x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, x0, 0x00), x2);
+
+        // Barrett reduction to 32 bits
+        x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(poly));
+        x2 = _mm_and_si128(x1, x3);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+        x2 = _mm_and_si128(x2, x3);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+    }
+#endif
+};
+
+#endif // CRC32_H
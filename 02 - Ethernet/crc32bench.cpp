@@ -0,0 +1,68 @@
+// crc32bench.cpp
+// Measures the throughput of each CRC32 engine against the bitwise reference
+// and checks that every engine produces the same result, both for whole
+// buffers and when the buffer is fed in scattered pieces.
+//
+// Build: g++ -std=c++20 -O2 -o crc32bench crc32bench.cpp
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cstdlib>
+#include "crc32.h"
+
+#define DEFAULT_SIZE_MB 64
+
+int main(int argc, char* argv[]) {
+    size_t sizeMB = (argc > 1) ? std::atoi(argv[1]) : DEFAULT_SIZE_MB;
+    std::vector<uint8_t> data(sizeMB * 1024 * 1024);
+
+    std::mt19937 rng(12345);
+    for (auto& byte : data) {
+        byte = static_cast<uint8_t>(rng());
+    }
+
+    const CRC32::Engine engines[] = {
+        CRC32::Engine::Bitwise, CRC32::Engine::SliceBy8, CRC32::Engine::SliceBy16, CRC32::Engine::PCLMUL
+    };
+
+    uint32_t reference = CRC32::update(CRC32::Engine::Bitwise, 0, data);
+    double baseline = 0;
+
+    std::cout << "Buffer: " << sizeMB << " MB, best engine: " << CRC32::engineName(CRC32::bestEngine()) << std::endl;
+
+    for (auto engine : engines) {
+        if (!CRC32::isSupported(engine)) {
+            std::cout << std::setw(12) << CRC32::engineName(engine) << ": not supported on this CPU" << std::endl;
+            continue;
+        }
+
+        // Whole buffer throughput
+        auto start = std::chrono::steady_clock::now();
+        uint32_t crc = CRC32::update(engine, 0, data);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        double mbps = sizeMB / elapsed.count();
+        if (engine == CRC32::Engine::Bitwise) {
+            baseline = mbps;
+        }
+
+        // Frame sized, odd length pieces exercise the incremental path and the tails
+        uint32_t scattered = 0;
+        for (size_t offset = 0, piece = 1; offset < data.size(); offset += piece, piece = piece % 1517 + 1) {
+            size_t len = std::min(piece, data.size() - offset);
+            scattered = CRC32::update(engine, scattered, std::span<const uint8_t>(data.data() + offset, len));
+        }
+
+        bool exact = (crc == reference) && (scattered == reference);
+        std::cout << std::setw(12) << CRC32::engineName(engine) << ": "
+                  << std::fixed << std::setprecision(1) << std::setw(9) << mbps << " MB/s, "
+                  << std::setprecision(1) << std::setw(6) << mbps / baseline << "x, "
+                  << (exact ? "bit-exact" : "MISMATCH") << std::endl;
+        if (!exact) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
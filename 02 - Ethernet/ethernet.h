@@ -7,6 +7,7 @@
 #include <array>
 #include <vector>
 #include <memory>
+#include "crc32.h"
 
 /**
  * @brief Define a MAC address as an array of 6 bytes.
@@ -281,21 +282,10 @@ private:
      * @brief Calculate CRC32 for data validation.
      * @param data Pointer to the data.
      * @param len Length of the data.
-     * @return CRC32 value.
+     * @return CRC32 value, computed with the fastest engine the CPU supports.
      */
     uint32_t calculateCRC32(const uint8_t* data, size_t len) const {
-        uint32_t crc = 0xFFFFFFFF;
-        for (size_t i = 0; i < len; ++i) {
-            crc ^= data[i];
-            for (int j = 0; j < 8; ++j) {
-                if (crc & 1) {
-                    crc = (crc >> 1) ^ 0xEDB88320;
-                } else {
-                    crc >>= 1;
-                }
-            }
-        }
-        return ~crc;
+        return CRC32::calculate(data, len);
     }
 };
 
@@ -0,0 +1,283 @@
+#ifndef ETHERNET_FRAME_VIEW_H
+#define ETHERNET_FRAME_VIEW_H
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <span>
+#include "ethernet.h"
+#include "crc32.h"
+
+/**
+ * @brief Read a big-endian (network order) 16-bit value without alignment requirements.
+ * @param p Pointer to the first byte.
+ * @return Value in host order.
+ */
+inline uint16_t loadBE16(const uint8_t* p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+/**
+ * @brief Read a big-endian (network order) 32-bit value without alignment requirements.
+ * @param p Pointer to the first byte.
+ * @return Value in host order.
+ */
+inline uint32_t loadBE32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+/**
+ * @brief Non-owning view of an 802.1Q/802.1ad tag (TPID followed by TCI) inside a frame.
+ * @link https://en.wikipedia.org/wiki/IEEE_802.1Q
+ */
+class Dot1qTagView {
+public:
+    static const size_t SIZE = 4; // TPID + TCI
+
+    /**
+     * @brief Constructor to wrap the 4 bytes of a tag.
+     * @param data Span covering the tag, starting at the TPID.
+     */
+    explicit Dot1qTagView(std::span<const uint8_t, SIZE> data) : data(data) {}
+
+    /**
+     * @brief Get the Tag Protocol Identifier (TPID).
+     * @return TPID value, e.g. 0x8100 or 0x88A8.
+     */
+    uint16_t getTagProtocolIdentifier() const {
+        return loadBE16(data.data());
+    }
+
+    /**
+     * @brief Get the Tag Control Information (TCI).
+     * @return TCI value.
+     */
+    uint16_t getTagControlInformation() const {
+        return loadBE16(data.data() + 2);
+    }
+
+    /**
+     * @brief Get the Priority Code Point (PCP).
+     * @return PCP value.
+     */
+    uint8_t getPriorityCodePoint() const {
+        return (getTagControlInformation() >> 13) & 0x07;
+    }
+
+    /**
+     * @brief Get the Drop Eligible Indicator (DEI).
+     * @return DEI value.
+     */
+    bool getDropEligibleIndicator() const {
+        return (getTagControlInformation() >> 12) & 0x01;
+    }
+
+    /**
+     * @brief Get the VLAN Identifier (VID).
+     * @return VID value.
+     */
+    uint16_t getVLANIdentifier() const {
+        return getTagControlInformation() & 0x0FFF;
+    }
+
+    /**
+     * @brief Get the raw bytes of the tag.
+     * @return Span covering the tag.
+     */
+    std::span<const uint8_t, SIZE> getData() const {
+        return data;
+    }
+
+private:
+    std::span<const uint8_t, SIZE> data; // TPID and TCI in wire format
+};
+
+/**
+ * @brief Non-owning, allocation-free view of an Ethernet frame.
+ *
+ * Unlike EthernetFrame, the view never copies the frame: it parses in place
+ * over a caller-owned buffer (for example a slot in a receive ring) and hands
+ * out spans into that buffer. The buffer must outlive the view. Parsing does
+ * not touch the heap; only the error path allocates, for the exception.
+ * @link https://en.wikipedia.org/wiki/Ethernet_frame
+ */
+class EthernetFrameView {
+public:
+    static const size_t MAX_TAGS = 4;       // Deepest tag stack accepted (QinQ and beyond)
+    static const size_t FCS_SIZE = sizeof(uint32_t);
+
+    /**
+     * @brief Constructor for an empty view.
+     */
+    EthernetFrameView() = default;
+
+    /**
+     * @brief Constructor to parse a frame in place.
+     * @param frame Frame bytes, starting at the destination MAC address.
+     * @param hasFCS True if the last 4 bytes are the Frame Check Sequence.
+     * @throws std::out_of_range if the frame is truncated.
+     */
+    explicit EthernetFrameView(std::span<const uint8_t> frame, bool hasFCS = true) {
+        setFrame(frame, hasFCS);
+    }
+
+    /**
+     * @brief Point the view at a new frame and parse its header and tags.
+     * @param frame Frame bytes, starting at the destination MAC address.
+     * @param hasFCS True if the last 4 bytes are the Frame Check Sequence.
+     * @throws std::out_of_range if the frame is truncated.
+     */
+    void setFrame(std::span<const uint8_t> frame, bool hasFCS = true) {
+        size_t end = frame.size();
+        if (hasFCS) {
+            if (end < FCS_SIZE) {
+                throw std::out_of_range("Frame too short for FCS");
+            }
+            end -= FCS_SIZE;
+        }
+
+        size_t offset = sizeof(EthernetFrameHeader);
+        size_t tags = 0;
+        uint16_t type;
+        while (true) {
+            if (offset + sizeof(uint16_t) > end) {
+                throw std::out_of_range("Frame truncated in header");
+            }
+            type = loadBE16(frame.data() + offset);
+            if (!isTagProtocolIdentifier(type)) {
+                break;
+            }
+            if (tags == MAX_TAGS) {
+                throw std::out_of_range("Too many VLAN tags");
+            }
+            if (offset + Dot1qTagView::SIZE > end) {
+                throw std::out_of_range("Frame truncated in VLAN tag");
+            }
+            offset += Dot1qTagView::SIZE;
+            ++tags;
+        }
+
+        this->frame = frame;
+        this->fcs = hasFCS;
+        this->tagCount = tags;
+        this->etherType = type;
+        this->payloadOffset = offset + sizeof(uint16_t);
+        this->payloadLength = end - payloadOffset;
+    }
+
+    /**
+     * @brief Get the Ethernet frame header.
+     * @return Reference to the header inside the caller's buffer.
+     */
+    const EthernetFrameHeader& getHeader() const {
+        return *reinterpret_cast<const EthernetFrameHeader*>(frame.data());
+    }
+
+    /**
+     * @brief Get the number of 802.1Q/802.1ad tags in the frame.
+     * @return Tag count, outermost first.
+     */
+    size_t getTagCount() const {
+        return tagCount;
+    }
+
+    /**
+     * @brief Get a tag by position.
+     * @param index Tag index, 0 being the outermost tag.
+     * @return View of the tag.
+     * @throws std::out_of_range if index is not less than getTagCount().
+     */
+    Dot1qTagView getTag(size_t index) const {
+        if (index >= tagCount) {
+            throw std::out_of_range("Tag index out of range");
+        }
+        return Dot1qTagView(frame.subspan(sizeof(EthernetFrameHeader) + index * Dot1qTagView::SIZE).first<Dot1qTagView::SIZE>());
+    }
+
+    /**
+     * @brief Get all tags as one contiguous span.
+     * @return Span of getTagCount() * 4 bytes.
+     */
+    std::span<const uint8_t> getTags() const {
+        return frame.subspan(sizeof(EthernetFrameHeader), tagCount * Dot1qTagView::SIZE);
+    }
+
+    /**
+     * @brief Get the EtherType following the tags.
+     * @return EtherType in host order.
+     */
+    uint16_t getEtherType() const {
+        return etherType;
+    }
+
+    /**
+     * @brief Get the payload following the EtherType, excluding the FCS.
+     * @return Span into the caller's buffer.
+     */
+    std::span<const uint8_t> getPayload() const {
+        return frame.subspan(payloadOffset, payloadLength);
+    }
+
+    /**
+     * @brief Get the offset of the payload from the start of the frame.
+     * @return Offset in bytes.
+     */
+    size_t getPayloadOffset() const {
+        return payloadOffset;
+    }
+
+    /**
+     * @brief Get the whole frame the view was parsed from.
+     * @return Span into the caller's buffer.
+     */
+    std::span<const uint8_t> getFrame() const {
+        return frame;
+    }
+
+    /**
+     * @brief Check whether the frame carries a Frame Check Sequence.
+     * @return True if the last 4 bytes are the FCS.
+     */
+    bool hasFCS() const {
+        return fcs;
+    }
+
+    /**
+     * @brief Get the Frame Check Sequence (FCS) value.
+     * @return FCS value, or 0 if the frame has none.
+     */
+    uint32_t getFCS() const {
+        uint32_t value = 0;
+        if (fcs) {
+            std::memcpy(&value, frame.data() + frame.size() - FCS_SIZE, sizeof(value));
+        }
+        return value;
+    }
+
+    /**
+     * @brief Validate the Frame Check Sequence (FCS) using CRC32.
+     * @return True if the FCS is valid, false if it is wrong or absent.
+     */
+    bool validateFCS() const {
+        return fcs && CRC32::calculate(frame.data(), frame.size() - FCS_SIZE) == getFCS();
+    }
+
+    /**
+     * @brief Check whether an EtherType introduces a VLAN tag.
+     * @param type EtherType in host order.
+     * @return True for 802.1Q (0x8100), 802.1ad (0x88A8) and legacy QinQ (0x9100).
+     */
+    static bool isTagProtocolIdentifier(uint16_t type) {
+        return type == 0x8100 || type == 0x88A8 || type == 0x9100;
+    }
+
+private:
+    std::span<const uint8_t> frame; // Caller-owned frame bytes
+    bool fcs = false;               // True if the frame ends with an FCS
+    size_t tagCount = 0;            // Number of VLAN tags after the MAC addresses
+    uint16_t etherType = 0;         // EtherType of the payload, host order
+    size_t payloadOffset = 0;       // Offset of the payload from the start of the frame
+    size_t payloadLength = 0;       // Length of the payload, excluding the FCS
+};
+
+#endif // ETHERNET_FRAME_VIEW_H
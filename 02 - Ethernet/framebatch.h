@@ -0,0 +1,183 @@
+#ifndef FRAME_BATCH_H
+#define FRAME_BATCH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "ethernetview.h"
+#include "crc32.h"
+
+/**
+ * @brief Structure-of-arrays result of decoding a batch of frames.
+ *
+ * Each field is one contiguous column indexed by frame number, so filters can
+ * scan a single attribute across the batch with vector instructions instead
+ * of striding over per-frame objects. Columns are sized by reserve() and
+ * reused between batches; decoding into reserved columns does not allocate.
+ */
+struct FrameColumns {
+    static const uint16_t UNTAGGED = 0xFFFF; // outerVLAN value for frames without a VLAN tag
+
+    size_t count = 0;                    // Number of frames in the batch
+    std::vector<uint64_t> destination;   // Destination MAC as a 48-bit big-endian number
+    std::vector<uint64_t> source;        // Source MAC as a 48-bit big-endian number
+    std::vector<uint16_t> outerVLAN;     // VID of the outermost tag, or UNTAGGED
+    std::vector<uint8_t> priority;       // PCP of the outermost tag, 0 if untagged
+    std::vector<uint16_t> etherType;     // EtherType after all tags, 0 if malformed
+    std::vector<uint16_t> l3Offset;      // Offset of the layer 3 header, 0 if malformed
+    std::vector<uint64_t> fcsValid;      // Bitmap, bit i set if frame i has a valid FCS
+
+    /**
+     * @brief Size every column for up to capacity frames.
+     * @param capacity Largest batch that will be decoded.
+     */
+    void reserve(size_t capacity) {
+        destination.resize(capacity);
+        source.resize(capacity);
+        outerVLAN.resize(capacity);
+        priority.resize(capacity);
+        etherType.resize(capacity);
+        l3Offset.resize(capacity);
+        fcsValid.resize((capacity + 63) / 64);
+    }
+
+    /**
+     * @brief Get the number of frames the columns can hold.
+     * @return Capacity in frames.
+     */
+    size_t capacity() const {
+        return destination.size();
+    }
+
+    /**
+     * @brief Check the FCS bit of a frame.
+     * @param index Frame index within the batch.
+     * @return True if the frame's FCS was valid.
+     */
+    bool isFCSValid(size_t index) const {
+        return (fcsValid[index / 64] >> (index % 64)) & 1;
+    }
+
+    /**
+     * @brief Convert a MAC address to the numeric form used by the MAC columns.
+     * @param mac MAC address.
+     * @return 48-bit big-endian value.
+     */
+    static uint64_t toColumn(const MACAddress& mac) {
+        uint64_t value = 0;
+        for (uint8_t byte : mac) {
+            value = (value << 8) | byte;
+        }
+        return value;
+    }
+};
+
+/**
+ * @brief Decodes many frames per call into FrameColumns.
+ *
+ * The batch loop prefetches the headers of frames a few positions ahead, so
+ * the cache misses on a ring of receive buffers overlap with decoding the
+ * current frame. Malformed frames do not throw; they are recorded with an
+ * EtherType and layer 3 offset of 0 and a clear FCS bit.
+ */
+class FrameBatchDecoder {
+public:
+    static const size_t PREFETCH_DISTANCE = 8; // Frames ahead of the current one to prefetch
+
+    /**
+     * @brief Decode a batch of frames.
+     * @param frames Pointers to the start of each frame.
+     * @param lengths Length of each frame in bytes.
+     * @param count Number of frames.
+     * @param columns Output columns, reserved for at least count frames.
+     * @param hasFCS True if each frame ends with a Frame Check Sequence.
+     * @throws std::out_of_range if the columns are too small for the batch.
+     */
+    static void decode(const uint8_t* const* frames, const size_t* lengths, size_t count,
+                       FrameColumns& columns, bool hasFCS = true) {
+        if (columns.capacity() < count) {
+            throw std::out_of_range("FrameColumns capacity smaller than batch");
+        }
+        columns.count = count;
+
+        for (size_t i = 0; i < count; ++i) {
+            if (i + PREFETCH_DISTANCE < count) {
+                __builtin_prefetch(frames[i + PREFETCH_DISTANCE]);
+            }
+            decodeOne(frames[i], lengths[i], i, columns, hasFCS);
+        }
+
+        // Clear bits past the end of the batch so whole-word scans of the bitmap stay exact
+        if (count % 64) {
+            columns.fcsValid[count / 64] &= (uint64_t(1) << (count % 64)) - 1;
+        }
+    }
+
+    /**
+     * @brief Decode a single frame into one row of the columns.
+     * @param frame Pointer to the start of the frame.
+     * @param length Length of the frame in bytes.
+     * @param index Row to write.
+     * @param columns Output columns.
+     * @param hasFCS True if the frame ends with a Frame Check Sequence.
+     */
+    static void decodeOne(const uint8_t* frame, size_t length, size_t index,
+                          FrameColumns& columns, bool hasFCS = true) {
+        size_t end = length;
+        if (hasFCS) {
+            end = (length >= EthernetFrameView::FCS_SIZE) ? length - EthernetFrameView::FCS_SIZE : 0;
+        }
+
+        uint16_t vlan = FrameColumns::UNTAGGED;
+        uint8_t pcp = 0;
+        uint16_t type = 0;
+        size_t offset = sizeof(EthernetFrameHeader);
+
+        if (end >= offset + sizeof(uint16_t)) {
+            columns.destination[index] = loadMAC(frame);
+            columns.source[index] = loadMAC(frame + 6);
+            type = loadBE16(frame + offset);
+            for (size_t tags = 0; EthernetFrameView::isTagProtocolIdentifier(type); ++tags) {
+                if (tags == EthernetFrameView::MAX_TAGS || offset + Dot1qTagView::SIZE + sizeof(uint16_t) > end) {
+                    type = 0;
+                    break;
+                }
+                if (tags == 0) {
+                    uint16_t tci = loadBE16(frame + offset + 2);
+                    vlan = tci & 0x0FFF;
+                    pcp = tci >> 13;
+                }
+                offset += Dot1qTagView::SIZE;
+                type = loadBE16(frame + offset);
+            }
+        } else {
+            columns.destination[index] = 0;
+            columns.source[index] = 0;
+        }
+
+        columns.outerVLAN[index] = vlan;
+        columns.priority[index] = pcp;
+        columns.etherType[index] = type;
+        columns.l3Offset[index] = (type != 0) ? static_cast<uint16_t>(offset + sizeof(uint16_t)) : 0;
+
+        // Only a frame whose header and tags parsed gets its FCS checked; runts and malformed frames keep a clear bit
+        bool valid = false;
+        if (hasFCS && type != 0) {
+            uint32_t fcs;
+            std::memcpy(&fcs, frame + end, sizeof(fcs));
+            valid = CRC32::calculate(frame, end) == fcs;
+        }
+        uint64_t bit = uint64_t(1) << (index % 64);
+        columns.fcsValid[index / 64] = valid ? (columns.fcsValid[index / 64] | bit) : (columns.fcsValid[index / 64] & ~bit);
+    }
+
+private:
+    /**
+     * @brief Read a MAC address as a 48-bit big-endian number.
+     */
+    static uint64_t loadMAC(const uint8_t* p) {
+        return (uint64_t(loadBE16(p)) << 32) | loadBE32(p + 2);
+    }
+};
+
+#endif // FRAME_BATCH_H
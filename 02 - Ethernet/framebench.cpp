@@ -0,0 +1,116 @@
+// framebench.cpp
+// Compares decoding a synthetic capture one frame at a time against the
+// batched structure-of-arrays decoder in framebatch.h.
+//
+// Build: g++ -std=c++20 -O2 -o framebench framebench.cpp
+// Usage: ./framebench [frames] [batch size]
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cstdlib>
+#include "ethernet.h"
+#include "framebatch.h"
+
+#define DEFAULT_FRAMES 10000000
+#define DEFAULT_BATCH 256
+#define MIN_FRAME 64
+#define MAX_FRAME 128
+
+// Build a frame with 0, 1 or 2 VLAN tags, random addresses and a valid FCS
+static size_t buildFrame(uint8_t* frame, size_t length, std::mt19937& rng) {
+    for (size_t i = 0; i < 12; ++i) {
+        frame[i] = static_cast<uint8_t>(rng());
+    }
+    size_t offset = 12;
+    int tags = rng() % 3;
+    for (int t = 0; t < tags; ++t) {
+        uint16_t tpid = (t == 0 && tags == 2) ? 0x88A8 : 0x8100;
+        uint16_t tci = static_cast<uint16_t>(((rng() % 8) << 13) | (rng() % 4095 + 1));
+        frame[offset++] = tpid >> 8;
+        frame[offset++] = tpid & 0xFF;
+        frame[offset++] = tci >> 8;
+        frame[offset++] = tci & 0xFF;
+    }
+    frame[offset++] = 0x08;
+    frame[offset++] = 0x00;
+    for (; offset < length - 4; ++offset) {
+        frame[offset] = static_cast<uint8_t>(rng());
+    }
+    uint32_t fcs = CRC32::calculate(frame, length - 4);
+    std::memcpy(frame + length - 4, &fcs, sizeof(fcs));
+    return length;
+}
+
+static double report(const char* name, std::chrono::steady_clock::time_point start, size_t frames, double baseline) {
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    double mfps = frames / elapsed.count() / 1e6;
+    std::cout << std::setw(24) << name << ": " << std::fixed << std::setprecision(2) << std::setw(8) << mfps << " Mframes/s";
+    if (baseline > 0) {
+        std::cout << ", " << std::setprecision(2) << mfps / baseline << "x";
+    }
+    std::cout << std::endl;
+    return mfps;
+}
+
+int main(int argc, char* argv[]) {
+    size_t frameCount = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : DEFAULT_FRAMES;
+    size_t batchSize = (argc > 2) ? std::strtoull(argv[2], nullptr, 10) : DEFAULT_BATCH;
+
+    // Frames are laid out back to back like a capture file or receive ring
+    std::mt19937 rng(2024);
+    std::vector<uint8_t> storage(frameCount * MAX_FRAME);
+    std::vector<const uint8_t*> frames(frameCount);
+    std::vector<size_t> lengths(frameCount);
+    size_t offset = 0;
+    for (size_t i = 0; i < frameCount; ++i) {
+        size_t length = MIN_FRAME + rng() % (MAX_FRAME - MIN_FRAME + 1);
+        frames[i] = storage.data() + offset;
+        lengths[i] = buildFrame(storage.data() + offset, length, rng);
+        offset += length;
+    }
+    std::cout << "Frames: " << frameCount << ", batch size: " << batchSize << std::endl;
+
+    uint64_t checksum = 0;
+
+    // Legacy copying parser, one frame per call
+    auto start = std::chrono::steady_clock::now();
+    EthernetFrame legacy;
+    for (size_t i = 0; i < frameCount; ++i) {
+        legacy.setFrame(frames[i], lengths[i]);
+        checksum += legacy.validateFCS() + legacy.getPayloads().size();
+    }
+    double baseline = report("EthernetFrame", start, frameCount, 0);
+
+    // Zero-copy view, one frame per call, writing the same columns as the batch
+    FrameColumns columns;
+    columns.reserve(batchSize);
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < frameCount; ++i) {
+        EthernetFrameView view(std::span<const uint8_t>(frames[i], lengths[i]));
+        size_t row = i % batchSize;
+        columns.destination[row] = FrameColumns::toColumn(view.getHeader().destination);
+        columns.source[row] = FrameColumns::toColumn(view.getHeader().source);
+        columns.outerVLAN[row] = view.getTagCount() ? view.getTag(0).getVLANIdentifier() : FrameColumns::UNTAGGED;
+        columns.priority[row] = view.getTagCount() ? view.getTag(0).getPriorityCodePoint() : 0;
+        columns.etherType[row] = view.getEtherType();
+        columns.l3Offset[row] = static_cast<uint16_t>(view.getPayloadOffset());
+        checksum += view.validateFCS() + columns.etherType[row];
+    }
+    report("EthernetFrameView", start, frameCount, baseline);
+
+    // Batched decode into columns
+    start = std::chrono::steady_clock::now();
+    for (size_t first = 0; first < frameCount; first += batchSize) {
+        size_t count = std::min(batchSize, frameCount - first);
+        FrameBatchDecoder::decode(frames.data() + first, lengths.data() + first, count, columns);
+        for (size_t w = 0; w < (count + 63) / 64; ++w) {
+            checksum += __builtin_popcountll(columns.fcsValid[w]);
+        }
+    }
+    report("FrameBatchDecoder", start, frameCount, baseline);
+
+    std::cout << "Checksum: " << checksum << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,276 @@
+#ifndef ETHERNET_FRAME_BUILDER_H
+#define ETHERNET_FRAME_BUILDER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <span>
+#include "ethernetview.h"
+#include "crc32.h"
+
+/**
+ * @brief Writes a wire-format Ethernet frame directly into a caller-owned buffer.
+ *
+ * The frame is placed after some headroom at the start of the buffer. Pushing
+ * a VLAN tag moves only the 12 bytes of MAC addresses down into the headroom,
+ * and popping one moves them back up, so the payload is never moved. The FCS
+ * is kept up to date as the frame is edited: tag pushes, pops and header
+ * rewrites adjust it in O(log frame length) with CRC32::replace and
+ * CRC32::replacePrefix instead of recomputing it over the whole frame. Only
+ * writing the payload requires a full pass, done lazily by getFrame().
+ *
+ * Buffer layout:
+ *   [headroom][destination][source][tags...][EtherType][payload][FCS]
+ *
+ * Callers are responsible for padding the payload to the 60 byte minimum
+ * frame size when the frame is destined for the wire.
+ */
+class EthernetFrameBuilder {
+public:
+    static const size_t DEFAULT_HEADROOM = 2 * Dot1qTagView::SIZE; // Room to push two tags
+    static const size_t FCS_SIZE = sizeof(uint32_t);
+
+    /**
+     * @brief Constructor for an empty, untagged frame with no payload.
+     * @param buffer Caller-owned buffer the frame is built in.
+     * @param headroom Bytes reserved in front of the frame for tag pushes.
+     * @throws std::out_of_range if the buffer cannot hold the headroom and an empty frame.
+     */
+    explicit EthernetFrameBuilder(std::span<uint8_t> buffer, size_t headroom = DEFAULT_HEADROOM)
+        : buffer(buffer), start(headroom), tags(0), end(headroom + HEADER_SIZE) {
+        if (end + FCS_SIZE > buffer.size()) {
+            throw std::out_of_range("Buffer too small for an Ethernet frame");
+        }
+        std::memset(buffer.data() + start, 0, HEADER_SIZE);
+        fcs = CRC32::calculate(buffer.data() + start, HEADER_SIZE);
+        fcsValid = true;
+    }
+
+    /**
+     * @brief Constructor to adopt a frame already written at buffer[headroom], e.g. by a receive call.
+     * @param buffer Caller-owned buffer holding the frame.
+     * @param headroom Offset of the frame in the buffer; the bytes before it are free for tag pushes.
+     * @param length Length of the frame, including the FCS if hasFCS is true.
+     * @param hasFCS True if the frame ends with an FCS. It is trusted and maintained
+     *               incrementally, so a corrupt frame stays corrupt after rewriting.
+     * @throws std::out_of_range if the frame is truncated or leaves no room for the FCS.
+     */
+    EthernetFrameBuilder(std::span<uint8_t> buffer, size_t headroom, size_t length, bool hasFCS)
+        : buffer(buffer), start(headroom) {
+        if (start + length > buffer.size()) {
+            throw std::out_of_range("Frame does not fit the buffer");
+        }
+        EthernetFrameView view(std::span<const uint8_t>(buffer.data() + start, length), hasFCS);
+        tags = view.getTagCount();
+        end = start + length - (hasFCS ? FCS_SIZE : 0);
+        if (end + FCS_SIZE > buffer.size()) {
+            throw std::out_of_range("No room for the FCS");
+        }
+        fcs = view.getFCS();
+        fcsValid = hasFCS;
+    }
+
+    /**
+     * @brief Set the destination MAC address.
+     * @param mac Destination MAC address.
+     */
+    void setDestination(const MACAddress& mac) {
+        write(0, mac.data(), mac.size());
+    }
+
+    /**
+     * @brief Set the source MAC address.
+     * @param mac Source MAC address.
+     */
+    void setSource(const MACAddress& mac) {
+        write(6, mac.data(), mac.size());
+    }
+
+    /**
+     * @brief Set the EtherType that follows the tags.
+     * @param type EtherType in host order.
+     */
+    void setEtherType(uint16_t type) {
+        uint8_t bytes[2] = { static_cast<uint8_t>(type >> 8), static_cast<uint8_t>(type) };
+        write(12 + tags * Dot1qTagView::SIZE, bytes, sizeof(bytes));
+    }
+
+    /**
+     * @brief Get the number of VLAN tags in the frame.
+     * @return Tag count.
+     */
+    size_t getTagCount() const {
+        return tags;
+    }
+
+    /**
+     * @brief Insert a new outermost tag by moving the MAC addresses into the headroom.
+     * @param tpid Tag Protocol Identifier, 0x8100 for 802.1Q or 0x88A8 for 802.1ad.
+     * @param tci Tag Control Information.
+     * @throws std::out_of_range if the headroom is exhausted.
+     */
+    void pushTag(uint16_t tpid, uint16_t tci) {
+        if (start < Dot1qTagView::SIZE) {
+            throw std::out_of_range("No headroom left for another tag");
+        }
+        uint8_t* frame = buffer.data() + start;
+        size_t suffix = end - start - 12;
+        uint32_t before = fcsValid ? CRC32::calculate(frame, 12) : 0;
+
+        std::memmove(frame - Dot1qTagView::SIZE, frame, 12);
+        start -= Dot1qTagView::SIZE;
+        frame = buffer.data() + start;
+        frame[12] = static_cast<uint8_t>(tpid >> 8);
+        frame[13] = static_cast<uint8_t>(tpid);
+        frame[14] = static_cast<uint8_t>(tci >> 8);
+        frame[15] = static_cast<uint8_t>(tci);
+        ++tags;
+
+        if (fcsValid) {
+            fcs = CRC32::replacePrefix(fcs, before, CRC32::calculate(frame, 12 + Dot1qTagView::SIZE), suffix);
+        }
+    }
+
+    /**
+     * @brief Remove the outermost tag by moving the MAC addresses up over it.
+     * @throws std::out_of_range if the frame has no tags.
+     */
+    void popTag() {
+        if (tags == 0) {
+            throw std::out_of_range("Frame has no tag to pop");
+        }
+        uint8_t* frame = buffer.data() + start;
+        size_t suffix = end - start - 12 - Dot1qTagView::SIZE;
+        uint32_t before = fcsValid ? CRC32::calculate(frame, 12 + Dot1qTagView::SIZE) : 0;
+
+        std::memmove(frame + Dot1qTagView::SIZE, frame, 12);
+        start += Dot1qTagView::SIZE;
+        frame = buffer.data() + start;
+        --tags;
+
+        if (fcsValid) {
+            fcs = CRC32::replacePrefix(fcs, before, CRC32::calculate(frame, 12), suffix);
+        }
+    }
+
+    /**
+     * @brief Rewrite the Tag Control Information of a tag in place.
+     * @param index Tag index, 0 being the outermost.
+     * @param tci New TCI value.
+     * @throws std::out_of_range if index is not less than getTagCount().
+     */
+    void setTagControlInformation(size_t index, uint16_t tci) {
+        if (index >= tags) {
+            throw std::out_of_range("Tag index out of range");
+        }
+        uint8_t bytes[2] = { static_cast<uint8_t>(tci >> 8), static_cast<uint8_t>(tci) };
+        write(14 + index * Dot1qTagView::SIZE, bytes, sizeof(bytes));
+    }
+
+    /**
+     * @brief Get the Tag Control Information of a tag.
+     * @param index Tag index, 0 being the outermost.
+     * @return TCI value.
+     * @throws std::out_of_range if index is not less than getTagCount().
+     */
+    uint16_t getTagControlInformation(size_t index) const {
+        if (index >= tags) {
+            throw std::out_of_range("Tag index out of range");
+        }
+        return loadBE16(buffer.data() + start + 14 + index * Dot1qTagView::SIZE);
+    }
+
+    /**
+     * @brief Rewrite the Priority Code Point (PCP) of a tag in place.
+     * @param index Tag index, 0 being the outermost.
+     * @param pcp PCP value.
+     */
+    void setPriorityCodePoint(size_t index, uint8_t pcp) {
+        setTagControlInformation(index, (getTagControlInformation(index) & 0x1FFF) | ((pcp & 0x07) << 13));
+    }
+
+    /**
+     * @brief Rewrite the Drop Eligible Indicator (DEI) of a tag in place.
+     * @param index Tag index, 0 being the outermost.
+     * @param dei DEI value.
+     */
+    void setDropEligibleIndicator(size_t index, bool dei) {
+        setTagControlInformation(index, (getTagControlInformation(index) & 0xEFFF) | (dei << 12));
+    }
+
+    /**
+     * @brief Rewrite the VLAN Identifier (VID) of a tag in place.
+     * @param index Tag index, 0 being the outermost.
+     * @param vid VID value.
+     */
+    void setVLANIdentifier(size_t index, uint16_t vid) {
+        setTagControlInformation(index, (getTagControlInformation(index) & 0xF000) | (vid & 0x0FFF));
+    }
+
+    /**
+     * @brief Resize the payload and get it for writing. The FCS is recomputed by getFrame().
+     * @param length Payload length in bytes.
+     * @return Writable span over the payload.
+     * @throws std::out_of_range if the buffer is too small.
+     */
+    std::span<uint8_t> resizePayload(size_t length) {
+        size_t payload = start + HEADER_SIZE + tags * Dot1qTagView::SIZE;
+        if (payload + length + FCS_SIZE > buffer.size()) {
+            throw std::out_of_range("Payload does not fit the buffer");
+        }
+        end = payload + length;
+        fcsValid = false;
+        return buffer.subspan(payload, length);
+    }
+
+    /**
+     * @brief Copy a payload into the frame.
+     * @param data Payload bytes.
+     * @throws std::out_of_range if the buffer is too small.
+     */
+    void setPayload(std::span<const uint8_t> data) {
+        std::span<uint8_t> payload = resizePayload(data.size());
+        std::memcpy(payload.data(), data.data(), data.size());
+    }
+
+    /**
+     * @brief Finish the frame by writing the FCS after the payload.
+     * @return Span over the complete wire-format frame, FCS included.
+     */
+    std::span<const uint8_t> getFrame() {
+        if (!fcsValid) {
+            fcs = CRC32::calculate(buffer.data() + start, end - start);
+            fcsValid = true;
+        }
+        std::memcpy(buffer.data() + end, &fcs, FCS_SIZE);
+        return std::span<const uint8_t>(buffer.data() + start, end - start + FCS_SIZE);
+    }
+
+private:
+    static const size_t HEADER_SIZE = sizeof(EthernetFrameHeader) + sizeof(uint16_t); // MACs and EtherType
+
+    std::span<uint8_t> buffer; // Caller-owned buffer
+    size_t start;              // Offset of the destination MAC address
+    size_t tags;               // Number of VLAN tags
+    size_t end;                // Offset just past the payload, where the FCS goes
+    uint32_t fcs = 0;          // CRC32 of [start, end) when fcsValid
+    bool fcsValid = false;     // False after the payload was handed out for writing
+
+    /**
+     * @brief Overwrite bytes of the frame, adjusting the FCS for just those bytes.
+     * @param offset Offset from the destination MAC address.
+     * @param data New bytes.
+     * @param length Number of bytes.
+     */
+    void write(size_t offset, const uint8_t* data, size_t length) {
+        uint8_t* target = buffer.data() + start + offset;
+        if (fcsValid) {
+            fcs = CRC32::replace(fcs, std::span<const uint8_t>(target, length), std::span<const uint8_t>(data, length),
+                                 end - start - offset - length);
+        }
+        std::memcpy(target, data, length);
+    }
+};
+
+#endif // ETHERNET_FRAME_BUILDER_H
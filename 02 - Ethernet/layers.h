@@ -0,0 +1,476 @@
+#ifndef ETHERNET_LAYERS_H
+#define ETHERNET_LAYERS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <array>
+#include <span>
+#include <variant>
+#include "ethernetview.h"
+
+/**
+ * @brief Namespace of the protocol number a layer announces for the layer after it.
+ */
+enum class LayerDomain : uint8_t {
+    None,       // Nothing follows, or it cannot be decoded (e.g. a non-first fragment)
+    Link,       // Start of a frame
+    EtherType,  // Value is an EtherType
+    IPProtocol  // Value is an IP protocol / IPv6 next header number
+};
+
+/**
+ * @brief Outcome of decoding one layer.
+ */
+enum class DecodeResult : uint8_t {
+    Decoded,     // The header was parsed
+    Truncated,   // The data ends inside the header
+    Malformed,   // The header is complete but its fields are invalid, e.g. a wrong version or a length too small
+    Unsupported  // A valid variant of the protocol this decoder does not handle
+};
+
+/**
+ * @brief Identifies which layer comes next, as announced by the current layer.
+ */
+struct NextLayer {
+    LayerDomain domain; // How to interpret value
+    uint16_t value;     // EtherType or IP protocol number
+};
+
+/*
+ * Every layer type below follows the same static interface so LayerStack can
+ * dispatch on it at compile time, without virtual calls or allocation:
+ *
+ *   static bool accepts(NextLayer next);
+ *       True if this layer decodes the protocol announced by the previous layer.
+ *   DecodeResult decode(std::span<const uint8_t>& data, NextLayer& next);
+ *       Parse the header at the start of data. On success data is advanced past
+ *       the header (and trimmed to the layer's own length field, which drops
+ *       Ethernet padding) and next names the following protocol. Otherwise
+ *       says whether the data ran out or the header itself is wrong.
+ *
+ * Layers keep a pointer to their header inside the caller's buffer, so the
+ * buffer must outlive the decoded stack.
+ */
+
+/**
+ * @brief Ethernet II MAC header, without the EtherType (owned by the next layer lookup).
+ * @link https://en.wikipedia.org/wiki/Ethernet_frame
+ */
+struct EthernetLayer {
+    const EthernetFrameHeader* header = nullptr; // Destination and source MAC addresses
+
+    static bool accepts(NextLayer next) {
+        return next.domain == LayerDomain::Link;
+    }
+
+    DecodeResult decode(std::span<const uint8_t>& data, NextLayer& next) {
+        if (data.size() < sizeof(EthernetFrameHeader) + sizeof(uint16_t)) {
+            return DecodeResult::Truncated;
+        }
+        header = reinterpret_cast<const EthernetFrameHeader*>(data.data());
+        next = { LayerDomain::EtherType, loadBE16(data.data() + sizeof(EthernetFrameHeader)) };
+        data = data.subspan(sizeof(EthernetFrameHeader) + sizeof(uint16_t));
+        return DecodeResult::Decoded;
+    }
+};
+
+/**
+ * @brief 802.1Q VLAN tag or 802.1ad service tag. Stacked tags decode as consecutive layers.
+ * @link https://en.wikipedia.org/wiki/IEEE_802.1ad
+ */
+struct VLANLayer {
+    uint16_t tagProtocolIdentifier = 0; // TPID that introduced this tag
+    uint16_t tagControlInformation = 0; // PCP, DEI and VID
+
+    uint8_t getPriorityCodePoint() const {
+        return (tagControlInformation >> 13) & 0x07;
+    }
+
+    bool getDropEligibleIndicator() const {
+        return (tagControlInformation >> 12) & 0x01;
+    }
+
+    uint16_t getVLANIdentifier() const {
+        return tagControlInformation & 0x0FFF;
+    }
+
+    static bool accepts(NextLayer next) {
+        return next.domain == LayerDomain::EtherType && EthernetFrameView::isTagProtocolIdentifier(next.value);
+    }
+
+    DecodeResult decode(std::span<const uint8_t>& data, NextLayer& next) {
+        // The TPID was consumed as the previous layer's EtherType, so TCI and the inner EtherType remain
+        if (data.size() < 4) {
+            return DecodeResult::Truncated;
+        }
+        tagProtocolIdentifier = next.value;
+        tagControlInformation = loadBE16(data.data());
+        next = { LayerDomain::EtherType, loadBE16(data.data() + 2) };
+        data = data.subspan(4);
+        return DecodeResult::Decoded;
+    }
+};
+
+/**
+ * @brief IPv4 header.
+ * @link https://en.wikipedia.org/wiki/Internet_Protocol_version_4
+ */
+struct IPv4Layer {
+    const uint8_t* header = nullptr; // Start of the IPv4 header
+    uint8_t headerLength = 0;        // Header length in bytes, including options
+    uint8_t protocol = 0;            // IP protocol number of the payload
+    uint16_t totalLength = 0;        // Header plus payload length in bytes
+    uint32_t source = 0;             // Source address, host order
+    uint32_t destination = 0;        // Destination address, host order
+
+    uint8_t getDSCP() const {
+        return header[1] >> 2;
+    }
+
+    uint8_t getTimeToLive() const {
+        return header[8];
+    }
+
+    bool isFragment() const {
+        return (loadBE16(header + 6) & 0x3FFF) != 0; // More fragments flag or a non-zero offset
+    }
+
+    static bool accepts(NextLayer next) {
+        return next.domain == LayerDomain::EtherType && next.value == 0x0800;
+    }
+
+    DecodeResult decode(std::span<const uint8_t>& data, NextLayer& next) {
+        if (data.size() < 20) {
+            return DecodeResult::Truncated;
+        }
+        header = data.data();
+        headerLength = (header[0] & 0x0F) * 4;
+        totalLength = loadBE16(header + 2);
+        if ((header[0] >> 4) != 4 || headerLength < 20 || totalLength < headerLength) {
+            return DecodeResult::Malformed;
+        }
+        if (data.size() < headerLength) {
+            return DecodeResult::Truncated;
+        }
+        protocol = header[9];
+        source = loadBE32(header + 12);
+        destination = loadBE32(header + 16);
+
+        // Only the first fragment carries the transport header
+        bool laterFragment = (loadBE16(header + 6) & 0x1FFF) != 0;
+        next = laterFragment ? NextLayer{ LayerDomain::None, 0 } : NextLayer{ LayerDomain::IPProtocol, protocol };
+        data = data.first(std::min<size_t>(data.size(), totalLength)).subspan(headerLength);
+        return DecodeResult::Decoded;
+    }
+};
+
+/**
+ * @brief IPv6 header, including any hop-by-hop, routing, fragment and destination option headers.
+ * @link https://en.wikipedia.org/wiki/IPv6_packet
+ */
+struct IPv6Layer {
+    const uint8_t* header = nullptr; // Start of the fixed IPv6 header
+    uint16_t payloadLength = 0;      // Payload length in bytes, including extension headers
+    uint8_t nextHeader = 0;          // Protocol after the extension headers
+    uint8_t hopLimit = 0;            // Hop limit
+
+    std::span<const uint8_t, 16> getSource() const {
+        return std::span<const uint8_t, 16>(header + 8, 16);
+    }
+
+    std::span<const uint8_t, 16> getDestination() const {
+        return std::span<const uint8_t, 16>(header + 24, 16);
+    }
+
+    uint8_t getTrafficClass() const {
+        return static_cast<uint8_t>(loadBE16(header) >> 4);
+    }
+
+    static bool accepts(NextLayer next) {
+        return next.domain == LayerDomain::EtherType && next.value == 0x86DD;
+    }
+
+    DecodeResult decode(std::span<const uint8_t>& data, NextLayer& next) {
+        if (data.size() < 40) {
+            return DecodeResult::Truncated;
+        }
+        if ((data[0] >> 4) != 6) {
+            return DecodeResult::Malformed;
+        }
+        header = data.data();
+        payloadLength = loadBE16(header + 4);
+        hopLimit = header[7];
+        std::span<const uint8_t> rest = data.subspan(40);
+        rest = rest.first(std::min<size_t>(rest.size(), payloadLength));
+
+        nextHeader = header[6];
+        bool laterFragment = false;
+        while (nextHeader == 0 || nextHeader == 43 || nextHeader == 44 || nextHeader == 60) {
+            if (rest.size() < 8) {
+                return DecodeResult::Truncated;
+            }
+            size_t length = (nextHeader == 44) ? 8 : (rest[1] + 1) * 8;
+            if (rest.size() < length) {
+                return DecodeResult::Truncated;
+            }
+            if (nextHeader == 44) {
+                laterFragment = (loadBE16(rest.data() + 2) & 0xFFF8) != 0;
+            }
+            nextHeader = rest[0];
+            rest = rest.subspan(length);
+        }
+
+        next = laterFragment ? NextLayer{ LayerDomain::None, 0 } : NextLayer{ LayerDomain::IPProtocol, nextHeader };
+        data = rest;
+        return DecodeResult::Decoded;
+    }
+};
+
+/**
+ * @brief ARP packet for Ethernet/IPv4.
+ * @link https://en.wikipedia.org/wiki/Address_Resolution_Protocol
+ */
+struct ARPLayer {
+    const uint8_t* header = nullptr; // Start of the ARP packet
+    uint16_t operation = 0;          // 1 = request, 2 = reply
+    uint32_t senderAddress = 0;      // Sender protocol address, host order
+    uint32_t targetAddress = 0;      // Target protocol address, host order
+
+    const MACAddress& getSenderHardwareAddress() const {
+        return *reinterpret_cast<const MACAddress*>(header + 8);
+    }
+
+    const MACAddress& getTargetHardwareAddress() const {
+        return *reinterpret_cast<const MACAddress*>(header + 18);
+    }
+
+    static bool accepts(NextLayer next) {
+        return next.domain == LayerDomain::EtherType && next.value == 0x0806;
+    }
+
+    DecodeResult decode(std::span<const uint8_t>& data, NextLayer& next) {
+        // Only the Ethernet (1) / IPv4 (0x0800) form with 6 and 4 byte addresses is decoded
+        if (data.size() < 8) {
+            return DecodeResult::Truncated;
+        }
+        if (loadBE16(data.data()) != 1 || loadBE16(data.data() + 2) != 0x0800 || data[4] != 6 || data[5] != 4) {
+            return DecodeResult::Unsupported;
+        }
+        if (data.size() < 28) {
+            return DecodeResult::Truncated;
+        }
+        header = data.data();
+        operation = loadBE16(header + 6);
+        senderAddress = loadBE32(header + 14);
+        targetAddress = loadBE32(header + 24);
+        next = { LayerDomain::None, 0 };
+        data = data.subspan(28);
+        return DecodeResult::Decoded;
+    }
+};
+
+/**
+ * @brief UDP header.
+ * @link https://en.wikipedia.org/wiki/User_Datagram_Protocol
+ */
+struct UDPLayer {
+    uint16_t sourcePort = 0;      // Source port
+    uint16_t destinationPort = 0; // Destination port
+    uint16_t length = 0;          // Header plus payload length in bytes
+
+    static bool accepts(NextLayer next) {
+        return next.domain == LayerDomain::IPProtocol && next.value == 17;
+    }
+
+    DecodeResult decode(std::span<const uint8_t>& data, NextLayer& next) {
+        if (data.size() < 8) {
+            return DecodeResult::Truncated;
+        }
+        sourcePort = loadBE16(data.data());
+        destinationPort = loadBE16(data.data() + 2);
+        length = loadBE16(data.data() + 4);
+        next = { LayerDomain::None, 0 };
+        data = data.first(std::max<size_t>(8, std::min<size_t>(data.size(), length))).subspan(8);
+        return DecodeResult::Decoded;
+    }
+};
+
+/**
+ * @brief TCP header.
+ * @link https://en.wikipedia.org/wiki/Transmission_Control_Protocol
+ */
+struct TCPLayer {
+    uint16_t sourcePort = 0;      // Source port
+    uint16_t destinationPort = 0; // Destination port
+    uint32_t sequenceNumber = 0;  // Sequence number
+    uint32_t acknowledgment = 0;  // Acknowledgment number
+    uint8_t headerLength = 0;     // Header length in bytes, including options
+    uint8_t flags = 0;            // CWR, ECE, URG, ACK, PSH, RST, SYN, FIN
+
+    static bool accepts(NextLayer next) {
+        return next.domain == LayerDomain::IPProtocol && next.value == 6;
+    }
+
+    DecodeResult decode(std::span<const uint8_t>& data, NextLayer& next) {
+        if (data.size() < 20) {
+            return DecodeResult::Truncated;
+        }
+        headerLength = (data[12] >> 4) * 4;
+        if (headerLength < 20) {
+            return DecodeResult::Malformed;
+        }
+        if (data.size() < headerLength) {
+            return DecodeResult::Truncated;
+        }
+        sourcePort = loadBE16(data.data());
+        destinationPort = loadBE16(data.data() + 2);
+        sequenceNumber = loadBE32(data.data() + 4);
+        acknowledgment = loadBE32(data.data() + 8);
+        flags = data[13];
+        next = { LayerDomain::None, 0 };
+        data = data.subspan(headerLength);
+        return DecodeResult::Decoded;
+    }
+};
+
+/**
+ * @brief Decodes a frame into a fixed-capacity, inline stack of protocol layers.
+ *
+ * The supported protocols are the compile-time list Layers. Choosing the
+ * decoder for the next layer is an unrolled chain of accepts() checks, and
+ * the results are stored in an inline array of std::variant, so decoding
+ * involves no virtual calls and no heap allocation. Decoding stops at the
+ * first protocol not in the list, at a header that is cut short, malformed
+ * or of an unsupported variant, or when the stack is full, leaving the rest
+ * of the frame as the payload.
+ * @tparam Capacity Maximum number of layers decoded per frame.
+ * @tparam Layers Layer types, see the interface described above.
+ */
+template <size_t Capacity, typename... Layers>
+class LayerStack {
+public:
+    typedef std::variant<Layers...> Layer;
+
+    /**
+     * @brief Decode a frame.
+     * @param frame Frame bytes, starting at the destination MAC address.
+     * @param hasFCS True if the last 4 bytes are the Frame Check Sequence.
+     * @return Number of layers decoded.
+     */
+    size_t decode(std::span<const uint8_t> frame, bool hasFCS = true) {
+        if (hasFCS) {
+            frame = frame.first(frame.size() >= sizeof(uint32_t) ? frame.size() - sizeof(uint32_t) : 0);
+        }
+        count = 0;
+        truncated = false;
+        malformed = false;
+        NextLayer next{ LayerDomain::Link, 0 };
+        while (count < Capacity && next.domain != LayerDomain::None) {
+            if (!decodeLayer<Layers...>(next, frame)) {
+                break;
+            }
+        }
+        payload = frame;
+        return count;
+    }
+
+    /**
+     * @brief Get the number of decoded layers.
+     * @return Layer count.
+     */
+    size_t size() const {
+        return count;
+    }
+
+    /**
+     * @brief Get a decoded layer by position.
+     * @param index Layer index, 0 being the Ethernet header.
+     * @return Reference to the layer.
+     */
+    const Layer& operator[](size_t index) const {
+        return layers[index];
+    }
+
+    /**
+     * @brief Find a decoded layer by type.
+     * @tparam L Layer type to look for.
+     * @param occurrence Which match to return, 0 being the outermost.
+     * @return Pointer to the layer, or nullptr if there is no such layer.
+     */
+    template <typename L>
+    const L* find(size_t occurrence = 0) const {
+        for (size_t i = 0; i < count; ++i) {
+            if (const L* layer = std::get_if<L>(&layers[i])) {
+                if (occurrence-- == 0) {
+                    return layer;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Get the bytes after the last decoded layer, e.g. the UDP or TCP payload.
+     * @return Span into the caller's buffer.
+     */
+    std::span<const uint8_t> getPayload() const {
+        return payload;
+    }
+
+    /**
+     * @brief Check whether decoding stopped because the frame ended inside a header.
+     * @return True if a supported protocol's header was cut short.
+     */
+    bool isTruncated() const {
+        return truncated;
+    }
+
+    /**
+     * @brief Check whether decoding stopped at a header with invalid fields.
+     * @return True if a supported protocol's header was complete but malformed.
+     */
+    bool isMalformed() const {
+        return malformed;
+    }
+
+private:
+    std::array<Layer, Capacity> layers; // Decoded layers, outermost first
+    size_t count = 0;                   // Number of valid entries in layers
+    bool truncated = false;             // True if decoding hit a truncated header
+    bool malformed = false;             // True if decoding hit a malformed header
+    std::span<const uint8_t> payload;   // Undecoded remainder of the frame
+
+    /**
+     * @brief Decode the next layer with the first type in the list that accepts it.
+     * @return True if a layer was decoded, false if none accepts it or its header could not be decoded.
+     */
+    template <typename First, typename... Rest>
+    bool decodeLayer(NextLayer& next, std::span<const uint8_t>& data) {
+        if (First::accepts(next)) {
+            std::span<const uint8_t> rest = data;
+            First& layer = layers[count].template emplace<First>();
+            DecodeResult result = layer.decode(rest, next);
+            if (result != DecodeResult::Decoded) {
+                truncated = result == DecodeResult::Truncated;
+                malformed = result == DecodeResult::Malformed;
+                return false;
+            }
+            data = rest;
+            ++count;
+            return true;
+        }
+        if constexpr (sizeof...(Rest) > 0) {
+            return decodeLayer<Rest...>(next, data);
+        } else {
+            return false;
+        }
+    }
+};
+
+/**
+ * @brief Decoder for Ethernet, stacked VLAN tags, IPv4/IPv6/ARP and UDP/TCP.
+ */
+typedef LayerStack<8, EthernetLayer, VLANLayer, IPv4Layer, IPv6Layer, ARPLayer, UDPLayer, TCPLayer> FrameLayers;
+
+#endif // ETHERNET_LAYERS_H
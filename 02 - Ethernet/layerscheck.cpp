@@ -0,0 +1,257 @@
+// layerscheck.cpp
+// Checks FrameLayers from layers.h on hand-built frames: IPv4 with options
+// under a VLAN tag, TCP with options, IPv6 through hop-by-hop, routing and
+// fragment headers, later fragments, ARP, Ethernet padding and an FCS, and
+// frames cut short or with invalid headers. For each frame the decoded layer
+// sequence, the fields of each layer and the offset and length of what is
+// left as payload must match what the frame was built with. Then all of them
+// are decoded in a loop to show the decoding rate.
+//
+// Build: g++ -std=c++20 -O2 -o layerscheck layerscheck.cpp
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include "layers.h"
+
+#define ROUNDS 1000000
+
+// Frame bytes appended field by field in network byte order
+class Frame {
+public:
+    Frame& bytes(std::initializer_list<uint8_t> values) {
+        data.insert(data.end(), values);
+        return *this;
+    }
+
+    Frame& be16(uint16_t value) {
+        return bytes({ uint8_t(value >> 8), uint8_t(value) });
+    }
+
+    Frame& be32(uint32_t value) {
+        return be16(value >> 16).be16(value & 0xFFFF);
+    }
+
+    Frame& fill(size_t count, uint8_t value) {
+        data.insert(data.end(), count, value);
+        return *this;
+    }
+
+    // Destination and source MAC addresses, then the EtherType
+    Frame& ethernet(uint16_t etherType) {
+        return fill(6, 0x02).fill(6, 0x04).be16(etherType);
+    }
+
+    // An 802.1Q or 802.1ad tag: TCI, then the EtherType after it
+    Frame& tag(uint16_t tci, uint16_t etherType) {
+        return be16(tci).be16(etherType);
+    }
+
+    // An IPv4 header of words * 4 bytes, options filled with NOPs
+    Frame& ipv4(uint8_t words, uint16_t totalLength, uint8_t protocol, uint16_t fragment = 0) {
+        bytes({ uint8_t(0x40 | words), 0xB8 }).be16(totalLength).be16(0x1234).be16(fragment);
+        bytes({ 64, protocol }).be16(0).be32(0xC0000201).be32(0xC6336402);
+        return fill((words - 5) * 4, 0x01);
+    }
+
+    Frame& ipv6(uint16_t payloadLength, uint8_t nextHeader) {
+        be32(0x6B800000).be16(payloadLength).bytes({ nextHeader, 32 });
+        bytes({ 0x20, 0x01, 0x0D, 0xB8 }).fill(11, 0).bytes({ 1 });
+        return bytes({ 0x20, 0x01, 0x0D, 0xB8 }).fill(11, 0).bytes({ 2 });
+    }
+
+    // A hop-by-hop, routing or destination options header of (extra + 1) * 8 bytes
+    Frame& extension(uint8_t nextHeader, uint8_t extra) {
+        return bytes({ nextHeader, extra }).fill(6 + extra * 8, 0);
+    }
+
+    Frame& fragment(uint8_t nextHeader, uint16_t offset, bool more) {
+        return bytes({ nextHeader, 0 }).be16(uint16_t(offset << 3) | more).be32(0xCAFE);
+    }
+
+    Frame& udp(uint16_t source, uint16_t destination, uint16_t length) {
+        return be16(source).be16(destination).be16(length).be16(0);
+    }
+
+    // A TCP header of words * 4 bytes with the ACK and PSH flags
+    Frame& tcp(uint16_t source, uint16_t destination, uint8_t words) {
+        be16(source).be16(destination).be32(1000).be32(2000);
+        bytes({ uint8_t(words << 4), 0x18 }).be16(65535).be32(0);
+        return fill((words - 5) * 4, 0x01);
+    }
+
+    Frame& arp(uint16_t operation, uint32_t sender, uint32_t target) {
+        be16(1).be16(0x0800).bytes({ 6, 4 }).be16(operation);
+        fill(6, 0x04).be32(sender).fill(6, 0).be32(target);
+        return *this;
+    }
+
+    std::vector<uint8_t> data;
+};
+
+// What decoding one frame must give
+struct Case {
+    std::string name;
+    std::vector<uint8_t> frame;
+    bool hasFCS;
+    std::string layers;      // Decoded layer types, one letter each: E, V, 4, 6, A, U, T
+    size_t payloadOffset;    // Where the undecoded rest starts in the frame
+    size_t payloadLength;
+    bool truncated = false;
+    bool malformed = false;
+};
+
+static int failures = 0;
+
+static void expect(const std::string& name, const std::string& what, uint64_t got, uint64_t expected) {
+    if (got != expected) {
+        std::cout << "FAILED  " << name << ": " << what << " is " << got << ", expected " << expected << std::endl;
+        ++failures;
+    }
+}
+
+static std::string describe(const FrameLayers& layers) {
+    static const char letters[] = "EV46AUT";
+    std::string result;
+    for (size_t i = 0; i < layers.size(); ++i) {
+        result += letters[layers[i].index()];
+    }
+    return result;
+}
+
+// Decode one case and compare the layer sequence, the payload and the flags
+static void check(const Case& test) {
+    FrameLayers layers;
+    layers.decode(test.frame, test.hasFCS);
+    std::string got = describe(layers);
+    bool ok = got == test.layers;
+    if (!ok) {
+        std::cout << "FAILED  " << test.name << ": layers " << got << ", expected " << test.layers << std::endl;
+        ++failures;
+    }
+    int before = failures;
+    expect(test.name, "payload offset", layers.getPayload().data() - test.frame.data(), test.payloadOffset);
+    expect(test.name, "payload length", layers.getPayload().size(), test.payloadLength);
+    expect(test.name, "truncated", layers.isTruncated(), test.truncated);
+    expect(test.name, "malformed", layers.isMalformed(), test.malformed);
+    if (ok && failures == before) {
+        std::cout << "ok      " << test.name << ": " << got << ", payload at " << test.payloadOffset << std::endl;
+    }
+}
+
+int main() {
+    std::vector<Case> cases;
+
+    // IPv4 with two option words under a VLAN tag, UDP with 18 bytes of data, padded to 60 bytes, FCS
+    Frame udp4;
+    udp4.ethernet(0x8100).tag(0x6064, 0x0800).ipv4(7, 28 + 26, 17).udp(5000, 53, 26).fill(18, 0xAA).fill(2, 0).be32(0);
+    cases.push_back({ "IPv4 options, UDP, VLAN, padding", udp4.data, true, "EV4U", 18 + 28 + 8, 18 });
+
+    // IPv4 and TCP with 12 bytes of options, 100 bytes of data, no FCS
+    Frame tcp4;
+    tcp4.ethernet(0x0800).ipv4(5, 20 + 32 + 100, 6).tcp(443, 51000, 8).fill(100, 0xBB);
+    cases.push_back({ "IPv4, TCP options", tcp4.data, false, "E4T", 14 + 20 + 32, 100 });
+
+    // IPv6 through hop-by-hop (8), routing (24) and a first fragment (8) to TCP with 40 bytes of data
+    Frame tcp6;
+    tcp6.ethernet(0x86DD).ipv6(8 + 24 + 8 + 20 + 40, 0).extension(43, 0).extension(44, 2).fragment(6, 0, true);
+    tcp6.tcp(80, 40000, 5).fill(40, 0xCC);
+    cases.push_back({ "IPv6 extension headers, TCP", tcp6.data, false, "E6T", 14 + 40 + 40 + 20, 40 });
+
+    // IPv6 destination options then UDP, under QinQ
+    Frame udp6;
+    udp6.ethernet(0x88A8).tag(0x0064, 0x8100).tag(0x00C8, 0x86DD).ipv6(16 + 8 + 10, 60).extension(17, 1);
+    udp6.udp(123, 123, 18).fill(10, 0xDD);
+    cases.push_back({ "IPv6 destination options, UDP, QinQ", udp6.data, false, "EVV6U", 22 + 40 + 16 + 8, 10 });
+
+    // A later IPv6 fragment: the transport header is in the first one
+    Frame later6;
+    later6.ethernet(0x86DD).ipv6(8 + 64, 44).fragment(17, 181, false).fill(64, 0xEE);
+    cases.push_back({ "IPv6 later fragment", later6.data, false, "E6", 14 + 40 + 8, 64 });
+
+    // A later IPv4 fragment
+    Frame later4;
+    later4.ethernet(0x0800).ipv4(5, 20 + 48, 17, 185).fill(48, 0xEE);
+    cases.push_back({ "IPv4 later fragment", later4.data, false, "E4", 14 + 20, 48 });
+
+    // ARP request, padded to 60 bytes, FCS
+    Frame arp;
+    arp.ethernet(0x0806).arp(1, 0xC0000201, 0xC0000202).fill(18, 0).be32(0);
+    cases.push_back({ "ARP request, padding", arp.data, true, "EA", 14 + 28, 18 });
+
+    // Cut short inside the TCP header
+    Frame cut = tcp4;
+    cut.data.resize(14 + 20 + 10);
+    cases.push_back({ "TCP truncated", cut.data, false, "E4", 14 + 20, 10, true, false });
+
+    // IPv6 cut inside the routing header
+    Frame cut6 = tcp6;
+    cut6.data.resize(14 + 40 + 8 + 12);
+    cases.push_back({ "IPv6 extension truncated", cut6.data, false, "E", 14, 40 + 8 + 12, true, false });
+
+    // IHL of 4 words is shorter than the fixed header
+    Frame badIHL = tcp4;
+    badIHL.data[14] = 0x44;
+    cases.push_back({ "IPv4 bad IHL", badIHL.data, false, "E", 14, badIHL.data.size() - 14, false, true });
+
+    // ARP for a hardware type other than Ethernet stops decoding without a flag
+    Frame otherARP = arp;
+    otherARP.data[15] = 6;
+    cases.push_back({ "ARP non-Ethernet", otherARP.data, true, "E", 14, otherARP.data.size() - 14 - 4 });
+
+    for (const Case& test : cases) {
+        check(test);
+    }
+
+    // The field values of a few layers, not just where they end
+    FrameLayers layers;
+    layers.decode(udp4.data, true);
+    const VLANLayer* vlan = layers.find<VLANLayer>();
+    const IPv4Layer* ipv4 = layers.find<IPv4Layer>();
+    const UDPLayer* udp = layers.find<UDPLayer>();
+    if (vlan && ipv4 && udp) {
+        expect("VLAN fields", "VID", vlan->getVLANIdentifier(), 100);
+        expect("VLAN fields", "PCP", vlan->getPriorityCodePoint(), 3);
+        expect("IPv4 fields", "header length", ipv4->headerLength, 28);
+        expect("IPv4 fields", "DSCP", ipv4->getDSCP(), 46);
+        expect("IPv4 fields", "source", ipv4->source, 0xC0000201);
+        expect("UDP fields", "ports", udp->sourcePort << 16 | udp->destinationPort, 5000 << 16 | 53);
+    }
+    layers.decode(tcp6.data, false);
+    const IPv6Layer* ipv6 = layers.find<IPv6Layer>();
+    const TCPLayer* tcp = layers.find<TCPLayer>();
+    if (ipv6 && tcp) {
+        expect("IPv6 fields", "next header", ipv6->nextHeader, 6);
+        expect("IPv6 fields", "traffic class", ipv6->getTrafficClass(), 0xB8);
+        expect("IPv6 fields", "destination", ipv6->getDestination()[15], 2);
+        expect("TCP fields", "ports", tcp->sourcePort << 16 | tcp->destinationPort, 80 << 16 | 40000);
+        expect("TCP fields", "flags", tcp->flags, 0x18);
+    }
+    layers.decode(arp.data, true);
+    if (const ARPLayer* request = layers.find<ARPLayer>()) {
+        expect("ARP fields", "operation", request->operation, 1);
+        expect("ARP fields", "target", request->targetAddress, 0xC0000202);
+        expect("ARP fields", "sender MAC", request->getSenderHardwareAddress()[5], 0x04);
+    }
+
+    // Decoding rate over all the cases
+    uint64_t decoded = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; ++round) {
+        for (const Case& test : cases) {
+            decoded += layers.decode(test.frame, test.hasFCS);
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << std::fixed << std::setprecision(1) << ROUNDS * cases.size() / seconds / 1e6 << " Mframes/s decoded, "
+              << (double)decoded / (ROUNDS * cases.size()) << " layers per frame" << std::endl;
+
+    if (failures) {
+        std::cout << failures << " checks failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "All checks passed" << std::endl;
+    return EXIT_SUCCESS;
+}
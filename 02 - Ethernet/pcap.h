@@ -0,0 +1,533 @@
+#ifndef PCAP_READER_H
+#define PCAP_READER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <span>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ethernetview.h"
+
+/**
+ * @brief Read a 16-bit capture field in the file's byte order.
+ * @param p Pointer to the field.
+ * @param swapped True if the file's byte order differs from the host's.
+ * @return Value in host order.
+ */
+inline uint16_t captureRead16(const uint8_t* p, bool swapped) {
+    uint16_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return swapped ? __builtin_bswap16(value) : value;
+}
+
+/**
+ * @brief Read a 32-bit capture field in the file's byte order.
+ * @param p Pointer to the field.
+ * @param swapped True if the file's byte order differs from the host's.
+ * @return Value in host order.
+ */
+inline uint32_t captureRead32(const uint8_t* p, bool swapped) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return swapped ? __builtin_bswap32(value) : value;
+}
+
+/**
+ * @brief One captured packet, pointing into the memory-mapped capture file.
+ */
+struct CaptureRecord {
+    std::span<const uint8_t> data;  // Captured bytes, possibly fewer than originalLength
+    uint32_t originalLength = 0;    // Length of the packet on the wire
+    uint64_t timestamp = 0;         // Nanoseconds since the Unix epoch
+    uint32_t interface = 0;         // pcapng interface index, always 0 for pcap
+    uint16_t linkType = 0;          // LINKTYPE_* of the interface, 1 for Ethernet
+    bool hasFCS = false;            // True if data ends with an Ethernet FCS
+};
+
+/**
+ * @brief A contiguous byte range of a capture file that starts on a record boundary.
+ */
+struct CaptureRange {
+    size_t begin; // Offset of the first record in the range
+    size_t end;   // Records starting before this offset belong to the range
+};
+
+/**
+ * @brief Link type and timestamp resolution of a pcapng interface (or the single pcap one).
+ */
+struct CaptureInterface {
+    uint16_t linkType = 1;       // LINKTYPE_* value
+    bool hasFCS = false;         // True if frames include a 4-byte FCS
+    bool decimal = true;         // True if resolution is a power of 10, false for a power of 2
+    uint8_t resolution = 6;      // Exponent of the timestamp unit, 6 = microseconds
+};
+
+/**
+ * @brief Iterates over the records of a capture without copying them.
+ *
+ * Readers are cheap to create: several can walk different ranges of the same
+ * CaptureFile concurrently, one per thread. A reader holds no buffers; each
+ * record's data is a span into the file mapping.
+ */
+class CaptureReader {
+public:
+    /**
+     * @brief Constructor for a reader over part of a mapped capture.
+     * @param file Whole mapped file.
+     * @param range Range of records to read.
+     * @param pcapng True for pcapng, false for classic pcap.
+     * @param swapped True if the file's byte order differs from the host's.
+     * @param interfaces Interfaces known at the start of the range.
+     */
+    CaptureReader(std::span<const uint8_t> file, CaptureRange range, bool pcapng, bool swapped,
+                  const std::vector<CaptureInterface>& interfaces)
+        : file(file), offset(range.begin), end(range.end), pcapng(pcapng), swapped(swapped), interfaces(interfaces) {}
+
+    /**
+     * @brief Advance to the next packet record.
+     * @param record Filled with the next packet.
+     * @return False at the end of the range.
+     * @throws std::runtime_error if a record runs past the end of the file.
+     */
+    bool next(CaptureRecord& record) {
+        return pcapng ? nextPcapng(record) : nextPcap(record);
+    }
+
+    /**
+     * @brief Call a function for every Ethernet frame in the range.
+     * @param callback Called as callback(const CaptureRecord&, const EthernetFrameView&).
+     * @return Number of records skipped because they are not Ethernet or are too short to parse.
+     */
+    template <typename Callback>
+    size_t forEachFrame(Callback&& callback) {
+        CaptureRecord record;
+        EthernetFrameView view;
+        size_t skipped = 0;
+        while (next(record)) {
+            if (record.linkType != 1) {
+                ++skipped;
+                continue;
+            }
+            try {
+                view.setFrame(record.data, record.hasFCS && record.data.size() == record.originalLength);
+            } catch (const std::out_of_range&) {
+                ++skipped;
+                continue;
+            }
+            callback(record, view);
+        }
+        return skipped;
+    }
+
+    /**
+     * @brief Get the offset of the next record to be read.
+     * @return Byte offset into the file.
+     */
+    size_t getOffset() const {
+        return offset;
+    }
+
+private:
+    std::span<const uint8_t> file;              // Whole mapped file
+    size_t offset;                              // Next record or block to read
+    size_t end;                                 // Stop before records starting here
+    bool pcapng;                                // File format
+    bool swapped;                               // File byte order differs from host
+    std::vector<CaptureInterface> interfaces;   // Interfaces seen so far (pcapng)
+
+    uint32_t read32(size_t at) const {
+        return captureRead32(file.data() + at, swapped);
+    }
+
+    void require(size_t at, size_t length) const {
+        if (at > file.size() || length > file.size() - at) {
+            throw std::runtime_error("Capture record runs past end of file");
+        }
+    }
+
+    bool nextPcap(CaptureRecord& record) {
+        if (offset >= end || offset + 16 > file.size()) {
+            return false;
+        }
+        uint32_t seconds = read32(offset);
+        uint32_t fraction = read32(offset + 4);
+        uint32_t captured = read32(offset + 8);
+        require(offset + 16, captured);
+
+        const CaptureInterface& interface = interfaces[0];
+        record.data = file.subspan(offset + 16, captured);
+        record.originalLength = read32(offset + 12);
+        record.timestamp = uint64_t(seconds) * 1000000000 + (interface.resolution == 9 ? fraction : uint64_t(fraction) * 1000);
+        record.interface = 0;
+        record.linkType = interface.linkType;
+        record.hasFCS = interface.hasFCS;
+        offset += 16 + captured;
+        return true;
+    }
+
+    bool nextPcapng(CaptureRecord& record) {
+        while (offset < end && offset + 12 <= file.size()) {
+            uint32_t type = read32(offset);
+            if (type == 0x0A0D0D0A) {
+                // A new section may change byte order and starts a new interface list
+                uint32_t magic;
+                std::memcpy(&magic, file.data() + offset + 8, sizeof(magic));
+                swapped = (magic == 0x4D3C2B1A);
+                interfaces.clear();
+            }
+            uint32_t length = read32(offset + 4);
+            if (length < 12 || (length & 3) != 0) {
+                throw std::runtime_error("Invalid pcapng block length");
+            }
+            require(offset, length);
+            size_t block = offset;
+            offset += length;
+
+            if (type == 1) {
+                interfaces.push_back(parseInterface(file, block, length, swapped));
+            } else if (type == 6 && length >= 32) {
+                // Enhanced Packet Block
+                uint32_t id = read32(block + 8);
+                uint32_t captured = read32(block + 20);
+                if (id >= interfaces.size() || captured > length - 32) {
+                    throw std::runtime_error("Invalid pcapng enhanced packet block");
+                }
+                uint64_t ticks = (uint64_t(read32(block + 12)) << 32) | read32(block + 16);
+                fillRecord(record, interfaces[id], id, file.subspan(block + 28, captured), read32(block + 24), ticks);
+                return true;
+            } else if (type == 3 && length >= 16 && !interfaces.empty()) {
+                // Simple Packet Block, always interface 0 and without a timestamp
+                uint32_t original = read32(block + 8);
+                size_t captured = std::min<size_t>(original, length - 16);
+                fillRecord(record, interfaces[0], 0, file.subspan(block + 12, captured), original, 0);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void fillRecord(CaptureRecord& record, const CaptureInterface& interface, uint32_t id,
+                           std::span<const uint8_t> data, uint32_t original, uint64_t ticks) {
+        record.data = data;
+        record.originalLength = original;
+        record.interface = id;
+        record.linkType = interface.linkType;
+        record.hasFCS = interface.hasFCS;
+        if (interface.decimal) {
+            if (interface.resolution <= 9) {
+                uint64_t scale = 1;
+                for (int i = interface.resolution; i < 9; ++i) {
+                    scale *= 10;
+                }
+                record.timestamp = ticks * scale;
+            } else {
+                uint64_t scale = 1;
+                for (int i = 9; i < interface.resolution; ++i) {
+                    scale *= 10;
+                }
+                record.timestamp = ticks / scale;
+            }
+        } else {
+            record.timestamp = static_cast<uint64_t>((static_cast<unsigned __int128>(ticks) * 1000000000) >> interface.resolution);
+        }
+    }
+
+public:
+    /**
+     * @brief Parse a pcapng Interface Description Block.
+     * @param file Whole mapped file.
+     * @param block Offset of the block.
+     * @param length Total length of the block.
+     * @param swapped True if the section's byte order differs from the host's.
+     * @return Interface description.
+     */
+    static CaptureInterface parseInterface(std::span<const uint8_t> file, size_t block, uint32_t length, bool swapped) {
+        CaptureInterface interface;
+        interface.linkType = captureRead16(file.data() + block + 8, swapped);
+
+        // Options: if_tsresol (9) and if_fcslen (13)
+        size_t option = block + 16;
+        size_t limit = block + length - 4;
+        while (option + 4 <= limit) {
+            uint16_t code = captureRead16(file.data() + option, swapped);
+            uint16_t size = captureRead16(file.data() + option + 2, swapped);
+            if (code == 0 || option + 4 + size > limit) {
+                break;
+            }
+            if (code == 9 && size >= 1) {
+                uint8_t value = file[option + 4];
+                interface.decimal = !(value & 0x80);
+                interface.resolution = value & 0x7F;
+            } else if (code == 13 && size >= 1) {
+                interface.hasFCS = file[option + 4] == 4;
+            }
+            option += 4 + ((size + 3) & ~3u);
+        }
+        return interface;
+    }
+};
+
+/**
+ * @brief A pcap or pcapng capture file mapped read-only into memory.
+ *
+ * The file is mmap'd with MADV_SEQUENTIAL so the kernel reads ahead
+ * aggressively and drops pages behind the readers, which keeps memory use
+ * bounded by the page cache regardless of file size.
+ * @link https://www.ietf.org/archive/id/draft-ietf-opsawg-pcap-04.html
+ * @link https://www.ietf.org/archive/id/draft-ietf-opsawg-pcapng-01.html
+ */
+class CaptureFile {
+public:
+    /**
+     * @brief Constructor to map and identify a capture file.
+     * @param path Path to a pcap or pcapng file.
+     * @throws std::runtime_error if the file cannot be mapped or is not a capture.
+     */
+    explicit CaptureFile(const char* path) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error(std::string("Could not open capture: ") + path);
+        }
+        struct stat st;
+        if (fstat(fd, &st) < 0 || st.st_size < 24) {
+            close(fd);
+            throw std::runtime_error(std::string("Capture too short: ") + path);
+        }
+        size = static_cast<size_t>(st.st_size);
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            throw std::runtime_error(std::string("Could not map capture: ") + path);
+        }
+        data = static_cast<const uint8_t*>(mapping);
+        madvise(mapping, size, MADV_SEQUENTIAL);
+
+        try {
+            identify();
+        } catch (...) {
+            munmap(mapping, size);
+            throw;
+        }
+    }
+
+    ~CaptureFile() {
+        munmap(const_cast<uint8_t*>(data), size);
+    }
+
+    CaptureFile(const CaptureFile&) = delete;
+    CaptureFile& operator=(const CaptureFile&) = delete;
+
+    /**
+     * @brief Check the file format.
+     * @return True for pcapng, false for classic pcap.
+     */
+    bool isPcapng() const {
+        return pcapng;
+    }
+
+    /**
+     * @brief Get the mapped contents of the file.
+     * @return Span over the whole file.
+     */
+    std::span<const uint8_t> getData() const {
+        return std::span<const uint8_t>(data, size);
+    }
+
+    /**
+     * @brief Get a reader over all records.
+     * @return Reader starting at the first record.
+     */
+    CaptureReader reader() const {
+        return reader({ first, size });
+    }
+
+    /**
+     * @brief Get a reader over a range returned by split().
+     * @param range Range of records to read.
+     * @return Reader starting at range.begin.
+     */
+    CaptureReader reader(CaptureRange range) const {
+        return CaptureReader(getData(), range, pcapng, swapped, interfaces);
+    }
+
+    /**
+     * @brief Split the file into roughly equal ranges that start on record boundaries.
+     *
+     * Boundaries are found by resynchronising from each cut point. A pcap cut
+     * is accepted once several consecutive plausible record headers, with
+     * timestamps in order, chain together; a pcapng cut once consecutive
+     * blocks have matching leading and trailing lengths. Either way the chain
+     * must then go on to land exactly on the next boundary already accepted,
+     * or the end of the file, so cuts are resolved from the last back. Only
+     * record headers are read, but every header after the first cut is. A
+     * cut whose chain runs into a damaged record is dropped, leaving the
+     * damage to the reader of the range before it.
+     * Interfaces must be described before the first packet, as every writer does.
+     * @param parts Number of ranges wanted.
+     * @return Between 1 and parts non-empty ranges covering every record once.
+     */
+    std::vector<CaptureRange> split(size_t parts) const {
+        std::vector<size_t> boundaries;
+        size_t known = size;
+        size_t scanned = size; // Candidates from here on already failed to chain to known
+        for (size_t i = parts > 0 ? parts - 1 : 0; i >= 1; --i) {
+            size_t cut = std::max(first + 1, first + (size - first) / parts * i);
+            if (cut >= known) {
+                continue;
+            }
+            size_t boundary = findBoundary(cut, std::min(scanned, known), known);
+            scanned = cut;
+            if (boundary < known) {
+                boundaries.push_back(boundary);
+                known = boundary;
+            }
+        }
+        std::vector<CaptureRange> ranges;
+        size_t begin = first;
+        for (auto it = boundaries.rbegin(); it != boundaries.rend(); ++it) {
+            ranges.push_back({ begin, *it });
+            begin = *it;
+        }
+        ranges.push_back({ begin, size });
+        return ranges;
+    }
+
+private:
+    static constexpr int RESYNC_CHAIN = 8;          // Consecutive valid records, timestamps in order, needed before a known boundary
+    static constexpr uint32_t MAX_PACKET = 262144;  // Largest original length believed, unless the snapshot length is larger
+
+    const uint8_t* data = nullptr;             // Start of the mapping
+    size_t size = 0;                           // Length of the mapping
+    size_t first = 0;                          // Offset of the first record or block after the file header
+    bool pcapng = false;                       // File format
+    bool swapped = false;                      // File byte order differs from host
+    uint32_t snapLength = 0;                   // pcap snapshot length
+    std::vector<CaptureInterface> interfaces;  // Interfaces described at the start of the file
+
+    uint32_t read32(size_t at) const {
+        return captureRead32(data + at, swapped);
+    }
+
+    void identify() {
+        uint32_t magic;
+        std::memcpy(&magic, data, sizeof(magic));
+        if (magic == 0xA1B2C3D4 || magic == 0xA1B23C4D || magic == 0xD4C3B2A1 || magic == 0x4D3CB2A1) {
+            swapped = (magic == 0xD4C3B2A1 || magic == 0x4D3CB2A1);
+            uint32_t network = read32(20);
+            CaptureInterface interface;
+            interface.linkType = network & 0xFFFF;
+            interface.hasFCS = (network & 0x10000000) && ((network >> 29) == 2); // FCS length in 16-bit words
+            interface.resolution = (magic == 0xA1B23C4D || magic == 0x4D3CB2A1) ? 9 : 6;
+            interfaces.push_back(interface);
+            snapLength = read32(16);
+            first = 24;
+        } else if (magic == 0x0A0D0D0A) {
+            uint32_t order;
+            std::memcpy(&order, data + 8, sizeof(order));
+            if (order != 0x1A2B3C4D && order != 0x4D3C2B1A) {
+                throw std::runtime_error("Invalid pcapng byte-order magic");
+            }
+            pcapng = true;
+            swapped = (order == 0x4D3C2B1A);
+            first = 0;
+
+            // Collect the interfaces described before the first packet so ranges can be read independently
+            for (size_t offset = 0; offset + 12 <= size;) {
+                uint32_t type = read32(offset);
+                uint32_t length = read32(offset + 4);
+                if (length < 12 || offset + length > size || type == 6 || type == 3) {
+                    break;
+                }
+                if (type == 1) {
+                    interfaces.push_back(CaptureReader::parseInterface(getData(), offset, length, swapped));
+                }
+                offset += length;
+            }
+        } else {
+            throw std::runtime_error("Not a pcap or pcapng file");
+        }
+    }
+
+    bool plausiblePcapRecord(size_t at) const {
+        uint32_t fraction = read32(at + 4);
+        uint32_t captured = read32(at + 8);
+        uint32_t original = read32(at + 12);
+        uint32_t limit = interfaces[0].resolution == 9 ? 1000000000 : 1000000;
+        return captured <= std::max<uint32_t>(snapLength, 65535) && original >= captured &&
+               original <= std::max<uint32_t>(snapLength, MAX_PACKET) && fraction < limit;
+    }
+
+    // A block running past the end of the file can only be checked by its length
+    bool plausiblePcapngBlock(size_t at) const {
+        uint32_t length = read32(at + 4);
+        return length >= 12 && (length & 3) == 0 && (at + length > size || read32(at + length - 4) == length);
+    }
+
+    /**
+     * @brief Find the first record boundary at or after an offset whose records chain to a known boundary.
+     * @param from Offset to start looking at.
+     * @param to Offset to stop looking at, at most known.
+     * @param known A record boundary, or size.
+     * @return Offset of the boundary, or size if there is none.
+     */
+    size_t findBoundary(size_t from, size_t to, size_t known) const {
+        size_t step = pcapng ? 4 : 1;
+        size_t header = pcapng ? 12 : 16;
+        if (pcapng) {
+            from = (from + 3) & ~size_t(3);
+        }
+        for (size_t candidate = from; candidate < to && candidate + header <= size; candidate += step) {
+            size_t at = candidate;
+            int chained = 0;
+            uint64_t last = 0; // Timestamp of the previous pcap record in the chain, seconds and fraction
+            for (;;) {
+                // Records ending exactly on the known boundary, or at end of file, are the proof
+                if (at == known) {
+                    if (chained >= RESYNC_CHAIN || known == size) {
+                        return candidate;
+                    }
+                    break;
+                }
+                uint32_t length = 0;
+                bool valid = at < known && at + header <= size;
+                if (valid && pcapng) {
+                    length = read32(at + 4);
+                    valid = plausiblePcapngBlock(at);
+                } else if (valid) {
+                    // A chain off by a few bytes reads lengths as timestamps, which then run backwards
+                    length = 16 + read32(at + 8);
+                    uint64_t timestamp = (uint64_t(read32(at)) << 32) | read32(at + 4);
+                    valid = plausiblePcapRecord(at) && (chained >= RESYNC_CHAIN || timestamp >= last);
+                    last = timestamp;
+                }
+                if (valid && at + length > size) {
+                    // A capture cut short by its writer ends in a truncated record, which the readers report
+                    if (known == size && chained >= RESYNC_CHAIN) {
+                        return candidate;
+                    }
+                    valid = false;
+                }
+                if (!valid) {
+                    // A long chain that breaks is almost always the real one running into damage that
+                    // every later candidate would run into too, so the cut is given up
+                    if (chained >= RESYNC_CHAIN) {
+                        return size;
+                    }
+                    break;
+                }
+                at += length;
+                ++chained;
+            }
+        }
+        return size;
+    }
+};
+
+#endif // PCAP_READER_H
@@ -0,0 +1,117 @@
+// splitcheck.cpp
+// Checks that CaptureFile::split() cuts a capture only on record boundaries:
+// for several numbers of ranges, every range must start on a record and
+// hold exactly the records, and bytes, that a single read of the whole file
+// finds between its start and end. Without a file argument a synthetic pcap
+// is written first, with frames whose leading bytes make a chain of record
+// headers misaligned by a few bytes look valid.
+//
+// Build: g++ -std=c++20 -O2 -o splitcheck splitcheck.cpp
+// Usage: ./splitcheck [capture file]
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include "pcap.h"
+
+#define DEFAULT_RECORDS 200000
+#define SYNTHETIC_PATH "/tmp/splitcheck.pcap"
+
+// Write a microsecond pcap of Ethernet frames one microsecond apart, captured whole
+static void writeCapture(const char* path, size_t records) {
+    std::ofstream out(path, std::ios::binary);
+    const uint32_t header[] = { 0xA1B2C3D4, 0x00040002, 0, 0, 65535, 1 };
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+    std::mt19937 rng(12345);
+    std::vector<uint8_t> frame(1514);
+    uint64_t micros = 1700000000ull * 1000000;
+    for (size_t i = 0; i < records; ++i) {
+        uint32_t length = 60 + rng() % (frame.size() - 60 + 1);
+        for (auto& byte : frame) {
+            byte = static_cast<uint8_t>(rng());
+        }
+        // Broadcast, or a unicast address whose first bytes read as a small length
+        if (rng() % 2) {
+            std::memset(frame.data(), 0xFF, 6);
+        } else {
+            frame[0] = static_cast<uint8_t>(rng());
+            frame[1] = static_cast<uint8_t>(rng() % 8);
+            frame[2] = 0;
+            frame[3] = 0;
+        }
+        micros += 1;
+        const uint32_t record[] = { uint32_t(micros / 1000000), uint32_t(micros % 1000000), length, length };
+        out.write(reinterpret_cast<const char*>(record), sizeof(record));
+        out.write(reinterpret_cast<const char*>(frame.data()), length);
+    }
+    if (!out) {
+        throw std::runtime_error(std::string("Could not write ") + path);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const char* path = (argc > 1) ? argv[1] : SYNTHETIC_PATH;
+    try {
+        if (argc <= 1) {
+            writeCapture(path, DEFAULT_RECORDS);
+        }
+        CaptureFile capture(path);
+
+        // Offset and length of every record, from one read of the whole file
+        std::vector<size_t> offsets;
+        std::vector<size_t> lengths;
+        CaptureReader whole = capture.reader();
+        CaptureRecord record;
+        for (size_t offset = whole.getOffset(); whole.next(record); offset = whole.getOffset()) {
+            offsets.push_back(offset);
+            lengths.push_back(record.data.size());
+        }
+        std::cout << "Capture: " << path << ", " << offsets.size() << " records" << std::endl;
+
+        bool ok = true;
+        for (size_t parts : { 1, 2, 3, 5, 7, 16, 64, 1000, 4999 }) {
+            std::vector<CaptureRange> ranges = capture.split(parts);
+            size_t failed = 0;
+            for (const CaptureRange& range : ranges) {
+                auto first = std::lower_bound(offsets.begin(), offsets.end(), range.begin);
+                auto last = std::lower_bound(offsets.begin(), offsets.end(), range.end);
+                size_t expectedRecords = last - first;
+                size_t expectedBytes = 0;
+                for (auto it = first; it != last; ++it) {
+                    expectedBytes += lengths[it - offsets.begin()];
+                }
+                size_t records = 0;
+                size_t bytes = 0;
+                try {
+                    CaptureReader reader = capture.reader(range);
+                    while (reader.next(record)) {
+                        ++records;
+                        bytes += record.data.size();
+                    }
+                } catch (const std::runtime_error&) {
+                    records = SIZE_MAX;
+                }
+                bool aligned = first != offsets.end() && *first == range.begin;
+                if (!aligned || records != expectedRecords || bytes != expectedBytes) {
+                    std::cout << "  range " << range.begin << "-" << range.end << (aligned ? "" : " does not start on a record")
+                              << ": " << records << " records, " << bytes << " bytes; expected "
+                              << expectedRecords << " records, " << expectedBytes << " bytes" << std::endl;
+                    ++failed;
+                }
+            }
+            std::cout << std::setw(3) << parts << " parts: " << std::setw(3) << ranges.size() << " ranges, "
+                      << (failed ? "MISMATCH" : "ok") << std::endl;
+            ok = ok && failed == 0;
+        }
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
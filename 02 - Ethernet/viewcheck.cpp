@@ -0,0 +1,139 @@
+// viewcheck.cpp
+// Checks that parsing frames with EthernetFrameView never touches the heap.
+// Global operator new is replaced by one that counts its calls; untagged,
+// 802.1Q, QinQ and four-tag frames, with and without an FCS, are then parsed
+// and every accessor is called, and the count must not move. A truncated
+// frame is parsed last to show the counter does see the allocation of the
+// exception thrown on the error path.
+//
+// Build: g++ -std=c++20 -O2 -o viewcheck viewcheck.cpp
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <new>
+#include <cstdlib>
+#include <cstring>
+#include "ethernetview.h"
+
+#define ROUNDS 100000
+
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+    ++allocations;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    ++allocations;
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept {
+    return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    std::free(p);
+}
+
+// Build a 128-byte IPv4 frame with the given number of tags and a valid FCS
+static std::vector<uint8_t> buildFrame(size_t tags) {
+    std::vector<uint8_t> frame(128);
+    for (size_t i = 0; i < 12; ++i) {
+        frame[i] = static_cast<uint8_t>(0x10 + i);
+    }
+    size_t offset = 12;
+    for (size_t t = 0; t < tags; ++t) {
+        uint16_t tpid = (t + 1 < tags) ? 0x88A8 : 0x8100;
+        uint16_t tci = static_cast<uint16_t>((t << 13) | (100 + t));
+        frame[offset++] = tpid >> 8;
+        frame[offset++] = tpid & 0xFF;
+        frame[offset++] = tci >> 8;
+        frame[offset++] = tci & 0xFF;
+    }
+    frame[offset++] = 0x08;
+    frame[offset++] = 0x00;
+    for (; offset < frame.size() - 4; ++offset) {
+        frame[offset] = static_cast<uint8_t>(offset);
+    }
+    uint32_t fcs = CRC32::calculate(frame.data(), frame.size() - 4);
+    std::memcpy(frame.data() + frame.size() - 4, &fcs, sizeof(fcs));
+    return frame;
+}
+
+// Parse a frame and read everything the view offers; returns a digest so nothing is optimised away
+static uint64_t parse(EthernetFrameView& view, const std::vector<uint8_t>& frame, bool hasFCS) {
+    view.setFrame(frame, hasFCS);
+    uint64_t digest = view.getEtherType() + view.getPayload().size() + view.getPayloadOffset() + view.getTags().size();
+    digest += view.getHeader().destination[0] + view.getFrame().size();
+    for (size_t i = 0; i < view.getTagCount(); ++i) {
+        Dot1qTagView tag = view.getTag(i);
+        digest += tag.getVLANIdentifier() + tag.getPriorityCodePoint() + tag.getDropEligibleIndicator() + tag.getTagProtocolIdentifier();
+    }
+    digest += view.hasFCS() ? view.validateFCS() + view.getFCS() : 0;
+    return digest;
+}
+
+int main() {
+    std::vector<std::vector<uint8_t>> frames;
+    for (size_t tags : { 0, 1, 2, 4 }) {
+        frames.push_back(buildFrame(tags));
+    }
+
+    // The first pass may set up CRC32 tables; only steady-state parsing has to be free of allocations
+    EthernetFrameView view;
+    uint64_t digest = 0;
+    for (const auto& frame : frames) {
+        digest += parse(view, frame, true);
+    }
+
+    bool ok = true;
+    for (bool hasFCS : { false, true }) {
+        for (size_t i = 0; i < frames.size(); ++i) {
+            size_t before = allocations;
+            for (int round = 0; round < ROUNDS; ++round) {
+                digest += parse(view, frames[i], hasFCS);
+            }
+            size_t counted = allocations - before;
+            bool passed = counted == 0 && view.getTagCount() == (i == 3 ? 4 : i) && (!hasFCS || view.validateFCS());
+            std::cout << std::setw(2) << view.getTagCount() << " tags, " << (hasFCS ? "FCS,   " : "no FCS,") << " "
+                      << ROUNDS << " parses: " << std::setw(3) << counted << " allocations, " << (passed ? "ok" : "FAILED") << std::endl;
+            ok = ok && passed;
+        }
+    }
+
+    size_t before = allocations;
+    try {
+        std::vector<uint8_t> truncated(frames[2].begin(), frames[2].begin() + 16);
+        view.setFrame(truncated, false);
+        ok = false;
+    } catch (const std::out_of_range&) {
+    }
+    // The truncated copy and the exception both allocate
+    bool counting = allocations - before >= 2;
+    std::cout << "Truncated frame: " << allocations - before << " allocations, " << (counting ? "counter works" : "COUNTER BROKEN") << std::endl;
+    ok = ok && counting;
+
+    std::cout << "Digest: " << digest << std::endl;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
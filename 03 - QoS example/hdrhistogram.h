@@ -0,0 +1,194 @@
+#ifndef HDRHISTOGRAM_H
+#define HDRHISTOGRAM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+/**
+ * @brief High dynamic range histogram of non-negative integer values, laid
+ * out like HdrHistogram: fixed memory and O(1) recording, with every value
+ * kept to a chosen number of significant decimal digits across the whole
+ * range.
+ *
+ * Values are grouped in buckets, each covering twice the range of the one
+ * before with the same number of sub-buckets, so the absolute resolution
+ * shrinks as values grow but the relative error stays below 10^-digits.
+ * Values above the highest trackable one are recorded as that value.
+ */
+class HdrHistogram {
+public:
+    /**
+     * @brief Constructor.
+     * @param lowest Smallest value told apart from 0, at least 1; e.g. 1000 for microseconds recorded in ns.
+     * @param highest Largest value tracked, at least 2 * lowest.
+     * @param digits Significant decimal digits kept, 1 to 5.
+     */
+    HdrHistogram(uint64_t lowest, uint64_t highest, int digits) : highest(highest) {
+        unitMagnitude = 63 - __builtin_clzll(lowest);
+        uint64_t largestSingleUnit = 2 * (uint64_t)std::pow(10, digits);
+        subBucketCountMagnitude = (int)std::ceil(std::log2((double)largestSingleUnit));
+        subBucketHalfCountMagnitude = subBucketCountMagnitude - 1;
+        subBucketCount = 1u << subBucketCountMagnitude;
+        subBucketHalfCount = subBucketCount / 2;
+        subBucketMask = (uint64_t)(subBucketCount - 1) << unitMagnitude;
+
+        int buckets = 1;
+        uint64_t smallestUntrackable = (uint64_t)subBucketCount << unitMagnitude;
+        while (smallestUntrackable <= highest) {
+            if (smallestUntrackable > UINT64_MAX / 2) {
+                buckets++;
+                break;
+            }
+            smallestUntrackable <<= 1;
+            buckets++;
+        }
+        counts.resize((size_t)(buckets + 1) * subBucketHalfCount);
+    }
+
+    /**
+     * @brief Record a value.
+     * @param value Value, capped at the highest trackable one.
+     * @param count Number of times it occurred.
+     */
+    void record(uint64_t value, uint64_t count = 1) {
+        value = std::min(value, highest);
+        counts[indexOf(value)] += count;
+        total += count;
+        sum += (double)value * count;
+        if (total == count || value < minimum) {
+            minimum = value;
+        }
+        maximum = std::max(maximum, value);
+    }
+
+    /**
+     * @brief Add every value recorded in another histogram with the same layout.
+     * @param other Histogram built with the same constructor arguments.
+     */
+    void add(const HdrHistogram& other) {
+        if (other.total == 0) {
+            return;
+        }
+        for (size_t i = 0; i < counts.size(); i++) {
+            counts[i] += other.counts[i];
+        }
+        minimum = total == 0 ? other.minimum : std::min(minimum, other.minimum);
+        maximum = std::max(maximum, other.maximum);
+        total += other.total;
+        sum += other.sum;
+    }
+
+    /**
+     * @brief Forget all recorded values.
+     */
+    void reset() {
+        std::fill(counts.begin(), counts.end(), 0);
+        total = 0;
+        sum = 0;
+        minimum = 0;
+        maximum = 0;
+    }
+
+    /**
+     * @brief Get the value at a percentile.
+     * @param percentile 0 to 100.
+     * @return Largest value equivalent to the one that percentile of the recorded values are at or below; 0 if empty.
+     */
+    uint64_t valueAtPercentile(double percentile) const {
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t wanted = std::max<uint64_t>(1, (uint64_t)std::ceil(std::min(percentile, 100.0) / 100 * total));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); i++) {
+            seen += counts[i];
+            if (seen >= wanted) {
+                return std::min(highestEquivalent(valueAt(i)), maximum);
+            }
+        }
+        return maximum;
+    }
+
+    /**
+     * @brief Get the number of recorded values.
+     * @return Count.
+     */
+    uint64_t getCount() const {
+        return total;
+    }
+
+    /**
+     * @brief Get the smallest recorded value, exactly.
+     * @return Minimum, 0 if empty.
+     */
+    uint64_t getMin() const {
+        return minimum;
+    }
+
+    /**
+     * @brief Get the largest recorded value, exactly.
+     * @return Maximum, 0 if empty.
+     */
+    uint64_t getMax() const {
+        return maximum;
+    }
+
+    /**
+     * @brief Get the mean of the recorded values.
+     * @return Mean, 0 if empty.
+     */
+    double getMean() const {
+        return total == 0 ? 0 : sum / total;
+    }
+
+private:
+    uint64_t highest;
+    int unitMagnitude;
+    int subBucketCountMagnitude;
+    int subBucketHalfCountMagnitude;
+    uint32_t subBucketCount;
+    uint32_t subBucketHalfCount;
+    uint64_t subBucketMask;
+    std::vector<uint64_t> counts;
+    uint64_t total = 0;
+    double sum = 0;
+    uint64_t minimum = 0;
+    uint64_t maximum = 0;
+
+    int bucketIndex(uint64_t value) const {
+        int pow2ceiling = 64 - __builtin_clzll(value | subBucketMask);
+        return pow2ceiling - unitMagnitude - (subBucketHalfCountMagnitude + 1);
+    }
+
+    size_t indexOf(uint64_t value) const {
+        int bucket = bucketIndex(value);
+        int64_t subBucket = (int64_t)(value >> (bucket + unitMagnitude));
+        // The first bucket also uses its lower half, which lies below the start of the second
+        return (size_t)(((int64_t)(bucket + 1) << subBucketHalfCountMagnitude) + (subBucket - subBucketHalfCount));
+    }
+
+    // Lowest value that lands in counts[index]
+    uint64_t valueAt(size_t index) const {
+        int bucket = (int)(index >> subBucketHalfCountMagnitude) - 1;
+        uint32_t subBucket = (uint32_t)(index & (subBucketHalfCount - 1)) + subBucketHalfCount;
+        if (bucket < 0) {
+            subBucket -= subBucketHalfCount;
+            bucket = 0;
+        }
+        return (uint64_t)subBucket << (bucket + unitMagnitude);
+    }
+
+    uint64_t highestEquivalent(uint64_t value) const {
+        int bucket = bucketIndex(value);
+        uint32_t subBucket = (uint32_t)(value >> (bucket + unitMagnitude));
+        int magnitude = subBucket >= subBucketCount ? bucket + 1 : bucket;
+        uint64_t range = 1ull << (unitMagnitude + magnitude);
+        uint64_t lowest = (uint64_t)subBucket << (bucket + unitMagnitude);
+        return lowest + range - 1;
+    }
+};
+
+#endif // HDRHISTOGRAM_H
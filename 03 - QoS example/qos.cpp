@@ -1,67 +1,633 @@
 // What I asked Copilot
 
-// write a c++ program which creates a new IPv4 UDP socket 
-// and sets options to enable expedited forwarding tagging on 
-// the IPv4 level and COS 5 on layer-2. It should send some 
+// write a c++ program which creates a new IPv4 UDP socket
+// and sets options to enable expedited forwarding tagging on
+// the IPv4 level and COS 5 on layer-2. It should send some
 // packets to 192.168.1.1 port 9000
 
+// Since grown into a traffic generator for load-testing QoS policies. Packets
+// are built in batches, each starting with a QosHeader (see qos.h), and a
+// whole batch goes to the kernel in one sendmmsg() call. Where the kernel
+// supports UDP GSO (UDP_SEGMENT, Linux 4.18), each message of the batch
+// carries up to 64 packets back to back and is cut into datagrams below the
+// socket layer, so one call sends thousands of packets.
+//
+// With a rate, packets are sent as they fall due: each batch holds the
+// packets whose time has come, up to the batch capacity, and the sender
+// sleeps until the next one is due.
+//
+// With -c, several traffic classes run at once instead, each on its own
+// socket with its own DSCP and SO_PRIORITY, to check that the qdiscs set up
+// by "00 - Linux Commands/02 - qos/qos.sh" prioritize under contention. A
+// paced class has a token bucket filling at its rate; every time the bucket
+// holds a burst of tokens, the burst is sent back to back. One thread serves
+// all classes: it sleeps until shortly before the next burst is due and
+// busy-polls the clock for the rest, so bursts leave within microseconds of
+// their time. With -T the bursts are instead handed to the kernel ahead of
+// time with an SO_TXTIME departure time, for the fq or etf qdisc to release.
+// Unpaced classes soak up the time in between and are skipped when a burst
+// is due soon. A report of the rate each class achieved is printed every
+// second and at the end. qosrecv.cpp measures what arrives: latency, jitter
+// and loss per DSCP.
+//
+// Build: g++ -std=c++20 -O2 -o qos qos.cpp
+// Usage: ./qos [-s size] [-r packets/s] [-n count] [-b messages] [-G] [IP] [Port]
+//        ./qos -c class [-c class ...] [-d seconds] [-T] [-G] [IP] [Port]
+// where a class is voice, video, bulk or name:dscp:packets/s[:size[:burst]].
+
 #include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
 #include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <ctime>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
+#include <linux/net_tstamp.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include "qos.h"
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
 
 #define DEST_IP "192.168.1.1"
 #define DEST_PORT 9000
 #define PACKET_SIZE 1024
+#define DEFAULT_COUNT 10
+#define DEFAULT_BATCH 32        // Messages per sendmmsg()
+#define MAX_BATCH 1024          // UIO_MAXIOV, the most messages one sendmmsg() takes
+#define MAX_GSO_SEGMENTS 64     // UDP_MAX_SEGMENTS before Linux 6.9
+#define MAX_UDP_PAYLOAD 65507   // 65535 minus the IPv4 and UDP headers
+#define EF_DSCP 0x2E            // DSCP value for Expedited Forwarding (EF) PHB
+#define DEFAULT_DURATION 10     // Seconds the traffic classes run
+#define SPIN_NS 200000          // Busy-poll the last part of a wait, sleep through the rest
+#define BULK_GUARD_NS 100000    // No unpaced send when a burst is due sooner than this, or twice what one takes
+#define CATCH_UP_NS 1000000     // A paced class that fell behind may make up this much of its schedule
+#define TXTIME_LEAD_NS 2000000  // With SO_TXTIME, bursts are handed to the kernel this long before they are due
+
+// One traffic class of the multi-class mode, sent on its own marked socket
+struct TrafficClass {
+    std::string name;
+    int dscp = 0;
+    double rate = 0;            // Packets per second, 0 to use whatever capacity the paced classes leave
+    unsigned burst = 1;         // Packets sent back to back each time the bucket holds that many tokens
+    size_t size = PACKET_SIZE;
+
+    int sockfd = -1;
+    double tokens = 0;          // Token bucket, in packets
+    double depth = 0;           // Most tokens the bucket holds: two bursts and CATCH_UP_NS worth
+    uint64_t refilled = 0;      // CLOCK_MONOTONIC when tokens were last added
+    uint64_t sequence = 0;      // Next sequence number; dropped packets use one too, so receivers see the loss
+    uint64_t sent = 0;          // Packets the kernel accepted
+    uint64_t dropped = 0;       // Paced packets refused for lack of buffer space
+    uint64_t refused = 0;       // Sends that reported an unreachable port instead, then retried
+    uint64_t reported = 0;      // sent at the last per-second report
+    uint64_t bursts = 0;
+    uint64_t lateSum = 0;       // Busy-poll: how long after their due time bursts were sent, in ns
+    uint64_t lateMax = 0;
+};
+
+// Command line options
+struct GeneratorOptions {
+    const char *ip = DEST_IP;
+    int port = DEST_PORT;
+    size_t size = PACKET_SIZE;  // UDP payload bytes per packet
+    double rate = 0;            // Packets per second, 0 for as fast as possible
+    uint64_t count = DEFAULT_COUNT; // Packets to send, 0 for no limit
+    unsigned batch = DEFAULT_BATCH;
+    bool gso = true;            // Use UDP_SEGMENT if the kernel has it
+    std::vector<TrafficClass> classes; // Multi-class mode if not empty
+    int duration = DEFAULT_DURATION;   // Multi-class mode: seconds to run
+    bool txtime = false;        // Multi-class mode: pace with SO_TXTIME instead of busy-polling
+};
+
+// Parse a preset name or name:dscp:packets/s[:size[:burst]]
+bool parseClass(const std::string &spec, TrafficClass &traffic) {
+    if (spec == "voice") {
+        // G.711 with 20 ms packetization
+        traffic = TrafficClass{.name = "voice", .dscp = EF_DSCP, .rate = 50, .burst = 1, .size = 200};
+        return true;
+    }
+    if (spec == "video") {
+        // 30 frames per second, each frame a burst of 40 packets
+        traffic = TrafficClass{.name = "video", .dscp = 34, .rate = 1200, .burst = 40, .size = 1200};
+        return true;
+    }
+    if (spec == "bulk") {
+        traffic = TrafficClass{.name = "bulk", .dscp = 0, .rate = 0, .burst = 1, .size = 1400};
+        return true;
+    }
 
-int main() {
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (true) {
+        size_t colon = spec.find(':', start);
+        fields.push_back(spec.substr(start, colon - start));
+        if (colon == std::string::npos) {
+            break;
+        }
+        start = colon + 1;
+    }
+    if (fields.size() < 3 || fields.size() > 5 || fields[0].empty()) {
+        return false;
+    }
+    traffic.name = fields[0];
+    traffic.dscp = std::atoi(fields[1].c_str());
+    traffic.rate = std::atof(fields[2].c_str());
+    if (fields.size() > 3) {
+        traffic.size = std::strtoull(fields[3].c_str(), nullptr, 10);
+    }
+    if (fields.size() > 4) {
+        traffic.burst = std::atoi(fields[4].c_str());
+    }
+    return traffic.dscp >= 0 && traffic.dscp < 64 && traffic.rate >= 0 && traffic.burst > 0 && traffic.burst <= MAX_BATCH &&
+           traffic.size >= sizeof(QosHeader) && traffic.size <= MAX_UDP_PAYLOAD;
+}
+
+bool parseOptions(int argc, char *argv[], GeneratorOptions &options) {
+    int opt;
+    while ((opt = getopt(argc, argv, "s:r:n:b:Gc:d:T")) != -1) {
+        switch (opt) {
+            case 's':
+                options.size = std::strtoull(optarg, nullptr, 10);
+                break;
+            case 'r':
+                options.rate = std::atof(optarg);
+                break;
+            case 'n':
+                options.count = std::strtoull(optarg, nullptr, 10);
+                break;
+            case 'b':
+                options.batch = std::atoi(optarg);
+                break;
+            case 'G':
+                options.gso = false;
+                break;
+            case 'c':
+                options.classes.emplace_back();
+                if (!parseClass(optarg, options.classes.back())) {
+                    return false;
+                }
+                break;
+            case 'd':
+                options.duration = std::atoi(optarg);
+                break;
+            case 'T':
+                options.txtime = true;
+                break;
+            default:
+                return false;
+        }
+    }
+    if (optind < argc) {
+        options.ip = argv[optind++];
+    }
+    if (optind < argc) {
+        options.port = std::atoi(argv[optind++]);
+    }
+    return optind == argc && options.size >= sizeof(QosHeader) && options.size <= MAX_UDP_PAYLOAD &&
+           options.rate >= 0 && options.batch > 0 && options.batch <= MAX_BATCH && options.duration > 0;
+}
+
+uint64_t nowNs(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Create a marked socket, connected so the route is looked up once instead of per packet.
+// Returns -1 after printing the reason on failure.
+int openSocket(const GeneratorOptions &options, int dscp) {
     int sockfd;
     struct sockaddr_in dest_addr;
-    char buffer[PACKET_SIZE];
 
     // Create a socket
-    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockfd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
     if (sockfd < 0) {
         perror("socket");
-        return 1;
+        return -1;
     }
 
-    // Set expedited forwarding (DSCP) on IPv4 level
-    int dscp = 0x2E; // DSCP value for Expedited Forwarding (EF) PHB
-    if (setsockopt(sockfd, IPPROTO_IP, IP_TOS, &dscp, sizeof(dscp)) < 0) {
+    // Set the DSCP on IPv4 level, expedited forwarding unless a traffic class says otherwise
+    int tos = dscp << 2; // DSCP is the upper six bits of the TOS byte
+    if (setsockopt(sockfd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) < 0) {
         perror("setsockopt IP_TOS");
         close(sockfd);
-        return 1;
+        return -1;
     }
 
-    // Set CoS 5 (VLAN Priority) on layer-2
-    int cos = 5 << 5; // CoS value (shifted to correct position for Priority Code Point)
+    // Set the CoS (VLAN Priority) on layer-2 to the DSCP class selector, 5 for EF.
+    // Priorities above 6 would need CAP_NET_ADMIN.
+    int cos = std::min(dscp >> 3, 6); // Packet priority, mapped to the Priority Code Point by the VLAN egress map
     if (setsockopt(sockfd, SOL_SOCKET, SO_PRIORITY, &cos, sizeof(cos)) < 0) {
         perror("setsockopt SO_PRIORITY");
         close(sockfd);
-        return 1;
+        return -1;
     }
 
     // Initialize destination address
     memset(&dest_addr, 0, sizeof(dest_addr));
     dest_addr.sin_family = AF_INET;
-    dest_addr.sin_port = htons(DEST_PORT);
-    inet_pton(AF_INET, DEST_IP, &dest_addr.sin_addr);
-
-    // Send some packets
-    for (int i = 0; i < 10; ++i) {
-        snprintf(buffer, PACKET_SIZE, "Packet number %d", i);
-        if (sendto(sockfd, buffer, strlen(buffer), 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) < 0) {
-            perror("sendto");
+    dest_addr.sin_port = htons(options.port);
+    if (inet_pton(AF_INET, options.ip, &dest_addr.sin_addr) <= 0) {
+        std::cerr << "Invalid address: " << options.ip << std::endl;
+        close(sockfd);
+        return -1;
+    }
+    if (connect(sockfd, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) < 0) {
+        perror("connect");
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+// Number of packets each message carries: as many as GSO allows, or 1 without it
+unsigned enableGso(int sockfd, size_t size, bool gso) {
+    unsigned segments = std::min<size_t>(MAX_GSO_SEGMENTS, MAX_UDP_PAYLOAD / size);
+    if (!gso || segments < 2) {
+        return 1;
+    }
+    int segment = size;
+    if (setsockopt(sockfd, SOL_UDP, UDP_SEGMENT, &segment, sizeof(segment)) < 0) {
+        perror("setsockopt UDP_SEGMENT, sending without GSO");
+        return 1;
+    }
+    return segments;
+}
+
+void disableGso(int sockfd) {
+    int size = 0;
+    setsockopt(sockfd, SOL_UDP, UDP_SEGMENT, &size, sizeof(size));
+}
+
+// Packets on their way to one socket: contiguous in buffer, split into messages of up to
+// segments packets each, every message optionally carrying an SCM_TXTIME departure time
+class Batch {
+public:
+    Batch(size_t size, unsigned segments, unsigned messages)
+        : size(size), segments(segments), buffer((size_t)messages * segments * size),
+          headers(messages), iovecs(messages), controls(messages * CMSG_SPACE(sizeof(uint64_t))) {}
+
+    // Stamp packets sequence onwards of flow and lay them out in messages. txtime is the
+    // CLOCK_MONOTONIC departure time in ns, or 0 to send at once. Returns the message count.
+    unsigned prepare(uint32_t flow, uint64_t sequence, uint64_t packets, uint64_t txtime) {
+        // Shared by every batch, so all flows of this process carry the same run
+        static const uint64_t run = nowNs(CLOCK_REALTIME);
+        uint64_t sentNs = nowNs(CLOCK_REALTIME);
+        for (uint64_t i = 0; i < packets; i++) {
+            QosHeader header = swapHeader({QOS_MAGIC, flow, run, sequence + i, sentNs});
+            memcpy(buffer.data() + i * size, &header, sizeof(header));
+        }
+        this->packets = packets;
+        this->txtime = txtime;
+        return layout();
+    }
+
+    struct mmsghdr *messages() {
+        return headers.data();
+    }
+
+    // Packets in the first done messages, after sendmmsg() returned done
+    uint64_t packetsIn(int done) const {
+        uint64_t packets = 0;
+        for (int m = 0; m < done; m++) {
+            packets += iovecs[m].iov_len / size;
+        }
+        return packets;
+    }
+
+    unsigned getSegments() const {
+        return segments;
+    }
+
+    // Change the packets per message, keeping the capacity in packets, and lay the prepared
+    // packets out again. Returns their new message count.
+    unsigned setSegments(unsigned segments) {
+        this->segments = segments;
+        size_t messages = buffer.size() / (size * segments);
+        headers.resize(messages);
+        iovecs.resize(messages);
+        controls.resize(messages * CMSG_SPACE(sizeof(uint64_t)));
+        return layout();
+    }
+
+private:
+    size_t size;
+    unsigned segments;
+    std::vector<uint8_t> buffer;
+    std::vector<struct mmsghdr> headers;
+    std::vector<struct iovec> iovecs;
+    std::vector<uint8_t> controls; // One SCM_TXTIME control message per message
+    uint64_t packets = 0;          // Stamped by the last prepare()
+    uint64_t txtime = 0;           // Departure time they were prepared with
+
+    // Split the prepared packets into messages of up to segments packets; returns the message count
+    unsigned layout() {
+        unsigned count = (packets + segments - 1) / segments;
+        for (unsigned m = 0; m < count; m++) {
+            uint64_t first = (uint64_t)m * segments;
+            iovecs[m].iov_base = buffer.data() + first * size;
+            iovecs[m].iov_len = std::min<uint64_t>(segments, packets - first) * size;
+            struct msghdr &msg = headers[m].msg_hdr;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iovecs[m];
+            msg.msg_iovlen = 1;
+            if (txtime != 0) {
+                msg.msg_control = controls.data() + m * CMSG_SPACE(sizeof(uint64_t));
+                msg.msg_controllen = CMSG_SPACE(sizeof(uint64_t));
+                struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+                cmsg->cmsg_level = SOL_SOCKET;
+                cmsg->cmsg_type = SCM_TXTIME;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+                memcpy(CMSG_DATA(cmsg), &txtime, sizeof(txtime));
+            }
+        }
+        return count;
+    }
+};
+
+// Single-class mode: EF packets as fast as allowed, or at the given rate, until count are sent
+int runGenerator(const GeneratorOptions &options) {
+    int sockfd = openSocket(options, EF_DSCP);
+    if (sockfd < 0) {
+        return 1;
+    }
+    unsigned segments = enableGso(sockfd, options.size, options.gso);
+    Batch batch(options.size, segments, options.batch);
+
+    uint64_t sent = 0;
+    uint64_t syscalls = 0;
+    uint64_t blocked = 0;   // Sends refused for lack of buffer space, then retried
+    uint64_t refused = 0;   // Sends that reported an unreachable port instead, then retried
+    uint64_t start = nowNs(CLOCK_MONOTONIC);
+    while (options.count == 0 || sent < options.count) {
+        uint64_t packets = (uint64_t)options.batch * batch.getSegments();
+        if (options.count > 0) {
+            packets = std::min(packets, options.count - sent);
+        }
+        if (options.rate > 0) {
+            uint64_t due = (uint64_t)((nowNs(CLOCK_MONOTONIC) - start) * options.rate / 1e9) + 1;
+            if (due <= sent) {
+                // Sleep until the next packet is due
+                uint64_t wake = start + (uint64_t)(sent * 1e9 / options.rate);
+                struct timespec ts = {(time_t)(wake / 1000000000), (long)(wake % 1000000000)};
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+                continue;
+            }
+            packets = std::min(packets, due - sent);
+        }
+
+        unsigned count = batch.prepare(0, sent, packets, 0);
+        int done = sendmmsg(sockfd, batch.messages(), count, 0);
+        ++syscalls;
+        if (done < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == ENOBUFS || errno == EAGAIN) {
+                ++blocked;
+                continue;
+            }
+            // An ICMP port unreachable for an earlier packet, e.g. while the receiver starts
+            if (errno == ECONNREFUSED) {
+                ++refused;
+                continue;
+            }
+            // The route's device or a tunnel on the path cannot take GSO packets
+            if (batch.getSegments() > 1 && (errno == EIO || errno == EINVAL)) {
+                std::cerr << "GSO send failed (" << strerror(errno) << "), sending without GSO" << std::endl;
+                disableGso(sockfd);
+                batch.setSegments(1);
+                continue;
+            }
+            perror("sendmmsg");
             close(sockfd);
             return 1;
         }
-        std::cout << "Sent packet " << i << std::endl;
+        // A partial batch leaves the rest of the packets to be rebuilt with the next call
+        sent += batch.packetsIn(done);
     }
+    double seconds = (nowNs(CLOCK_MONOTONIC) - start) / 1e9;
 
     // Close the socket
     close(sockfd);
+
+    if (seconds <= 0) {
+        seconds = 1e-9;
+    }
+    segments = batch.getSegments();
+    std::cout << "Sent " << sent << " packets of " << options.size << " bytes to " << options.ip << ":" << options.port
+              << " in " << std::fixed << std::setprecision(3) << seconds << " s, "
+              << std::setprecision(0) << sent / seconds << " packets/s, "
+              << std::setprecision(2) << sent * options.size * 8 / seconds / 1e9 << " Gbit/s" << std::endl
+              << syscalls << " sendmmsg calls, " << (segments > 1 ? "GSO with " + std::to_string(segments) + " packets per message" : "no GSO")
+              << ", " << blocked << " retried for lack of buffer space, " << refused << " after port unreachable" << std::endl;
     return 0;
 }
+
+// Send a prepared batch of a class without blocking. A call that only reports an ICMP port
+// unreachable for an earlier packet sent nothing, so it is retried like in single-class mode,
+// and so is a GSO send the path cannot take, without GSO from then on. Returns the messages sent, 0 if the socket has no room for any, or -1 on any other error.
+int sendPrepared(TrafficClass &traffic, Batch &batch, unsigned count) {
+    while (true) {
+        int done = sendmmsg(traffic.sockfd, batch.messages(), count, MSG_DONTWAIT);
+        if (done >= 0) {
+            return done;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == ECONNREFUSED) {
+            ++traffic.refused;
+            continue;
+        }
+        if (batch.getSegments() > 1 && (errno == EIO || errno == EINVAL)) {
+            std::cerr << traffic.name << ": GSO send failed (" << strerror(errno) << "), sending without GSO" << std::endl;
+            disableGso(traffic.sockfd);
+            count = batch.setSegments(1);
+            continue;
+        }
+        return errno == EAGAIN || errno == ENOBUFS ? 0 : -1;
+    }
+}
+
+// Send one burst of a paced class, due at the given CLOCK_MONOTONIC time. A burst the
+// socket has no room for is dropped rather than delaying the other classes.
+// Returns false, with errno set, if sending failed for any other reason.
+bool sendBurst(TrafficClass &traffic, Batch &batch, uint32_t flow, uint64_t due, uint64_t now, bool txtime) {
+    unsigned count = batch.prepare(flow, traffic.sequence, traffic.burst, txtime ? std::max(due, now) : 0);
+    int done = sendPrepared(traffic, batch, count);
+    if (done < 0) {
+        return false;
+    }
+    uint64_t sent = batch.packetsIn(done);
+    traffic.sent += sent;
+    traffic.dropped += traffic.burst - sent;
+    traffic.sequence += traffic.burst;
+    traffic.tokens -= traffic.burst;
+    ++traffic.bursts;
+    if (!txtime && now > due) {
+        traffic.lateSum += now - due;
+        traffic.lateMax = std::max(traffic.lateMax, now - due);
+    }
+    return true;
+}
+
+void reportClasses(const std::vector<TrafficClass> &classes, double seconds, bool final) {
+    for (const TrafficClass &traffic : classes) {
+        uint64_t packets = final ? traffic.sent : traffic.sent - traffic.reported;
+        double achieved = packets / seconds;
+        std::cout << std::left << std::setw(8) << traffic.name << std::right << " dscp " << std::setw(2) << traffic.dscp
+                  << std::fixed << std::setprecision(0) << ": " << std::setw(9) << achieved << " packets/s";
+        if (traffic.rate > 0) {
+            std::cout << " of " << traffic.rate;
+        } else {
+            std::cout << " unpaced";
+        }
+        std::cout << ", " << std::setprecision(3) << achieved * traffic.size * 8 / 1e6 << " Mbit/s";
+        if (final) {
+            std::cout << ", " << traffic.sent << " sent, " << traffic.dropped << " dropped";
+            if (traffic.refused > 0) {
+                std::cout << ", " << traffic.refused << " retried after port unreachable";
+            }
+            if (traffic.bursts > 0 && traffic.lateSum > 0) {
+                std::cout << ", late by " << std::setprecision(1) << traffic.lateSum / 1e3 / traffic.bursts << " us on average, "
+                          << traffic.lateMax / 1e3 << " us at most";
+            }
+        }
+        std::cout << std::endl;
+    }
+}
+
+// Multi-class mode: pace every class from one thread until the duration is over
+int runClasses(GeneratorOptions &options) {
+    std::vector<TrafficClass> &classes = options.classes;
+    std::vector<Batch> batches;
+    for (TrafficClass &traffic : classes) {
+        if ((traffic.sockfd = openSocket(options, traffic.dscp)) < 0) {
+            return 1;
+        }
+        unsigned segments = enableGso(traffic.sockfd, traffic.size, options.gso);
+        // An unpaced class sends one message per turn, a paced one a whole burst
+        unsigned messages = traffic.rate > 0 ? (traffic.burst + segments - 1) / segments : 1;
+        batches.emplace_back(traffic.size, segments, messages);
+        if (traffic.rate == 0) {
+            traffic.burst = segments;
+        }
+        if (options.txtime && traffic.rate > 0) {
+            struct sock_txtime config = {CLOCK_MONOTONIC, 0};
+            if (setsockopt(traffic.sockfd, SOL_SOCKET, SO_TXTIME, &config, sizeof(config)) < 0) {
+                perror("setsockopt SO_TXTIME");
+                return 1;
+            }
+        }
+    }
+
+    uint64_t start = nowNs(CLOCK_MONOTONIC);
+    uint64_t end = start + (uint64_t)options.duration * 1000000000;
+    uint64_t nextReport = start + 1000000000;
+    uint64_t lead = options.txtime ? TXTIME_LEAD_NS : 0;
+    for (TrafficClass &traffic : classes) {
+        traffic.refilled = start;
+        traffic.tokens = traffic.burst; // The first burst leaves at once
+        traffic.depth = 2 * traffic.burst + traffic.rate * CATCH_UP_NS / 1e9;
+    }
+
+    uint64_t unpacedCost = 0;   // Moving average of how long one round of unpaced sends takes, in ns
+    uint64_t now;
+    while ((now = nowNs(CLOCK_MONOTONIC)) < end) {
+        // Send every burst that is due, and find when the next one will be
+        uint64_t wake = end;
+        for (size_t i = 0; i < classes.size(); i++) {
+            TrafficClass &traffic = classes[i];
+            if (traffic.rate == 0) {
+                continue;
+            }
+            traffic.tokens = std::min(traffic.depth, traffic.tokens + (now - traffic.refilled) * traffic.rate / 1e9);
+            traffic.refilled = now;
+            while (true) {
+                // When the bucket holds a whole burst; a bucket fuller than that has been due for a while
+                int64_t wait = (traffic.burst - traffic.tokens) * 1e9 / traffic.rate;
+                uint64_t due = now + wait;
+                if (due > now + lead) {
+                    wake = std::min(wake, due - lead);
+                    break;
+                }
+                if (!sendBurst(traffic, batches[i], i, due, now, options.txtime)) {
+                    perror("sendmmsg");
+                    return 1;
+                }
+            }
+        }
+
+        if (now >= nextReport) {
+            std::cout << "After " << (nextReport - start) / 1000000000 << " s:" << std::endl;
+            reportClasses(classes, 1.0, false);
+            for (TrafficClass &traffic : classes) {
+                traffic.reported = traffic.sent;
+            }
+            nextReport += 1000000000;
+        }
+
+        // Fill the gap until the next burst with unpaced traffic, or wait for it
+        bool unpaced = false;
+        if (wake > now + std::max<uint64_t>(BULK_GUARD_NS, 2 * unpacedCost)) {
+            for (size_t i = 0; i < classes.size(); i++) {
+                TrafficClass &traffic = classes[i];
+                if (traffic.rate > 0) {
+                    continue;
+                }
+                unpaced = true;
+                unsigned count = batches[i].prepare(i, traffic.sequence, traffic.burst, 0);
+                int done = sendPrepared(traffic, batches[i], count);
+                if (done < 0) {
+                    perror("sendmmsg");
+                    return 1;
+                }
+                if (done > 0) {
+                    uint64_t sent = batches[i].packetsIn(done);
+                    traffic.sent += sent;
+                    traffic.sequence += sent;
+                }
+            }
+            if (unpaced) {
+                uint64_t cost = nowNs(CLOCK_MONOTONIC) - now;
+                unpacedCost = (unpacedCost * 7 + cost) / 8;
+            }
+        } else {
+            // Decay while skipped, so one slow round cannot keep the unpaced classes out for good
+            unpacedCost -= unpacedCost / 8;
+        }
+        if (!unpaced && wake > now + SPIN_NS) {
+            uint64_t until = std::min(wake, nextReport) - SPIN_NS;
+            struct timespec ts = {(time_t)(until / 1000000000), (long)(until % 1000000000)};
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+        }
+    }
+
+    std::cout << "Total over " << options.duration << " s to " << options.ip << ":" << options.port
+              << (options.txtime ? ", paced with SO_TXTIME" : ", paced by busy-polling") << ":" << std::endl;
+    reportClasses(classes, options.duration, true);
+    for (TrafficClass &traffic : classes) {
+        close(traffic.sockfd);
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    GeneratorOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0] << " [-s size] [-r packets/s] [-n count, 0 for no limit] [-b messages] [-G (no GSO)] [IP] [Port]" << std::endl
+                  << "       " << argv[0] << " -c class [-c class ...] [-d seconds] [-T (SO_TXTIME)] [-G] [IP] [Port]" << std::endl
+                  << "A class is voice, video, bulk or name:dscp:packets/s[:size[:burst]], 0 packets/s for unpaced" << std::endl;
+        return 1;
+    }
+    return options.classes.empty() ? runGenerator(options) : runClasses(options);
+}
@@ -0,0 +1,35 @@
+#ifndef QOS_H
+#define QOS_H
+
+#include <cstdint>
+#include <endian.h>
+
+// Start of every packet the qos generator sends, so a receiver can tell
+// packets apart, count losses and measure one-way latency. The rest of the
+// packet is padding up to the configured size.
+//
+// All fields are in network byte order on the wire.
+
+#define QOS_MAGIC 0x514f5332 // "QOS2"
+
+struct QosHeader {
+    uint32_t magic;     // QOS_MAGIC
+    uint32_t flow;      // Traffic class the packet belongs to
+    uint64_t run;       // CLOCK_REALTIME the sender started at, in nanoseconds; a restarted sender has a later one
+    uint64_t sequence;  // Counts up from 0 in each flow of a run
+    uint64_t sentNs;    // CLOCK_REALTIME when the packet was handed to the kernel, in nanoseconds
+};
+
+static_assert(sizeof(QosHeader) == 32, "Wire structs must not be padded");
+
+// Convert between host and wire byte order; the function is its own inverse
+inline QosHeader swapHeader(QosHeader header) {
+    header.magic = htobe32(header.magic);
+    header.flow = htobe32(header.flow);
+    header.run = htobe64(header.run);
+    header.sequence = htobe64(header.sequence);
+    header.sentNs = htobe64(header.sentNs);
+    return header;
+}
+
+#endif // QOS_H
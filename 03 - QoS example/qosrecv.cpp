@@ -0,0 +1,430 @@
+// qosrecv.cpp
+// Receiver for the traffic qos.cpp generates, to measure what the marking
+// achieves. Every packet is timestamped by the kernel on arrival
+// (SO_TIMESTAMPNS, or the NIC's clock with -H), and its DSCP is read from the
+// IP_TOS control message. Against the send time and sequence number in the
+// packet's QosHeader (see qos.h), each DSCP class records:
+//   - one-way latency, arrival minus send time, in an HDR histogram
+//   - jitter, the change in latency between consecutive packets of a flow
+//     (IPDV), in a second histogram, plus the RFC 3550 smoothed jitter
+//   - loss and reordering, from gaps in and returns to each flow's sequence;
+//     a packet already seen is a duplicate, and a packet from a later run of
+//     the sender starts the flow over
+// One-way latency is only meaningful when the sender's and receiver's
+// clocks are synchronized, e.g. by PTP; latencies below zero are counted,
+// not recorded. Hardware timestamps are in the NIC's clock, which has to be
+// kept on CLOCK_REALTIME with phc2sys.
+//
+// Packets are read with recvmmsg() in batches, into buffers only large enough
+// for the header; the rest of each datagram is discarded by the kernel.
+//
+// Build: g++ -std=c++20 -O2 -o qosrecv qosrecv.cpp
+// Usage: ./qosrecv [-p port] [-i report seconds] [-d seconds] [-H interface]
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <vector>
+#include <bitset>
+#include <unordered_map>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <csignal>
+#include <ctime>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
+#include <linux/errqueue.h>
+#include <unistd.h>
+#include "qos.h"
+#include "hdrhistogram.h"
+
+#define DEST_PORT 9000
+#define BATCH 256                   // Datagrams per recvmmsg()
+#define SLOT_SIZE 64                // Bytes kept of each datagram, enough for the QosHeader
+#define RECEIVE_BUFFER (32 << 20)   // Socket receive buffer, capped by net.core.rmem_max
+#define HIGHEST_NS 60000000000ull   // Largest latency the histograms track, 60 s
+#define DIGITS 3                    // Significant digits the histograms keep
+#define REORDER_WINDOW 4096         // Late packets are matched against this many sequence numbers back
+
+// Sequence tracking and jitter state of one flow, i.e. one class of one sender
+struct FlowState {
+    uint64_t run = 0;               // Run of the sender the sequence numbers belong to
+    uint64_t expected = 0;          // Next sequence number
+    uint64_t first = 0;             // Sequence number the flow was first seen at
+    int64_t lastLatency = 0;        // Of the previous packet, for jitter
+    std::bitset<REORDER_WINDOW> seen; // Sequences below expected that arrived, by sequence % REORDER_WINDOW
+    bool started = false;
+};
+
+// Everything measured for one DSCP value
+struct ClassStats {
+    HdrHistogram latency{1, HIGHEST_NS, DIGITS};  // This interval, in ns
+    HdrHistogram jitter{1, HIGHEST_NS, DIGITS};   // |latency change| between consecutive packets, in ns
+    HdrHistogram totalLatency{1, HIGHEST_NS, DIGITS};
+    HdrHistogram totalJitter{1, HIGHEST_NS, DIGITS};
+    double smoothedJitter = 0;      // RFC 3550 interarrival jitter, in ns
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    uint64_t lost = 0;              // Sequence numbers skipped and not seen since
+    uint64_t reordered = 0;         // Packets that arrived after a later one of their flow
+    uint64_t duplicates = 0;        // Packets whose sequence number had already arrived
+    uint64_t restarts = 0;          // Flows whose sender started a new run
+    uint64_t stale = 0;             // Packets of an earlier run, after a later one had arrived
+    uint64_t negative = 0;          // Packets that arrived before they were sent, by the clocks
+    uint64_t reported = 0;          // packets at the last report
+};
+
+// Command line options
+struct ReceiverOptions {
+    int port = DEST_PORT;
+    int interval = 1;               // Seconds between reports
+    int duration = 0;               // Seconds to run, 0 until interrupted
+    const char *hardware = nullptr; // Interface whose NIC timestamps packets
+};
+
+volatile sig_atomic_t stopped = 0;
+
+void stop(int) {
+    stopped = 1;
+}
+
+bool parseOptions(int argc, char *argv[], ReceiverOptions &options) {
+    int opt;
+    while ((opt = getopt(argc, argv, "p:i:d:H:")) != -1) {
+        switch (opt) {
+            case 'p':
+                options.port = std::atoi(optarg);
+                break;
+            case 'i':
+                options.interval = std::atoi(optarg);
+                break;
+            case 'd':
+                options.duration = std::atoi(optarg);
+                break;
+            case 'H':
+                options.hardware = optarg;
+                break;
+            default:
+                return false;
+        }
+    }
+    return optind == argc && options.interval > 0 && options.duration >= 0;
+}
+
+uint64_t nowNs(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Ask the NIC behind an interface to timestamp every received packet
+bool enableHardwareTimestamps(int sockfd, const char *interface) {
+    struct hwtstamp_config config;
+    memset(&config, 0, sizeof(config));
+    config.tx_type = HWTSTAMP_TX_OFF;
+    config.rx_filter = HWTSTAMP_FILTER_ALL;
+    struct ifreq request;
+    memset(&request, 0, sizeof(request));
+    strncpy(request.ifr_name, interface, sizeof(request.ifr_name) - 1);
+    request.ifr_data = reinterpret_cast<char *>(&config);
+    if (ioctl(sockfd, SIOCSHWTSTAMP, &request) < 0) {
+        perror("ioctl SIOCSHWTSTAMP");
+        return false;
+    }
+    int flags = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE |
+                SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0) {
+        perror("setsockopt SO_TIMESTAMPING");
+        return false;
+    }
+    return true;
+}
+
+// Returns -1 after printing the reason on failure
+int openSocket(const ReceiverOptions &options) {
+    int sockfd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (sockfd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    int size = RECEIVE_BUFFER;
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    int on = 1;
+    if (setsockopt(sockfd, IPPROTO_IP, IP_RECVTOS, &on, sizeof(on)) < 0) {
+        perror("setsockopt IP_RECVTOS");
+        close(sockfd);
+        return -1;
+    }
+    if (options.hardware != nullptr) {
+        if (!enableHardwareTimestamps(sockfd, options.hardware)) {
+            close(sockfd);
+            return -1;
+        }
+    } else if (setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0) {
+        perror("setsockopt SO_TIMESTAMPNS");
+        close(sockfd);
+        return -1;
+    }
+    // Wake up at least every 100 ms so reports are on time when traffic stops
+    struct timeval timeout = {0, 100000};
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(options.port);
+    if (bind(sockfd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("bind failed");
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+class Receiver {
+public:
+    explicit Receiver(int sockfd) : sockfd(sockfd) {
+        for (int i = 0; i < BATCH; i++) {
+            iovecs[i].iov_base = slots[i];
+            iovecs[i].iov_len = SLOT_SIZE;
+        }
+    }
+
+    // Read one batch and account for every packet in it. Returns false on a socket error.
+    bool receive() {
+        for (int i = 0; i < BATCH; i++) {
+            struct msghdr &msg = messages[i].msg_hdr;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iovecs[i];
+            msg.msg_iovlen = 1;
+            msg.msg_control = controls[i];
+            msg.msg_controllen = sizeof(controls[i]);
+        }
+        // MSG_TRUNC makes msg_len the full datagram length although only the header is kept
+        int count = recvmmsg(sockfd, messages, BATCH, MSG_WAITFORONE | MSG_TRUNC, nullptr);
+        if (count < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return true;
+            }
+            perror("recvmmsg");
+            return false;
+        }
+        for (int i = 0; i < count; i++) {
+            account(messages[i].msg_hdr, slots[i], messages[i].msg_len);
+        }
+        return true;
+    }
+
+    // Print a line per class: this interval's figures, or with final those of the whole run
+    void report(double seconds, bool final) {
+        for (int dscp = 0; dscp < 64; dscp++) {
+            ClassStats *stats = classes[dscp].get();
+            if (stats == nullptr) {
+                continue;
+            }
+            if (final) {
+                fold(*stats);
+            }
+            const HdrHistogram &latency = final ? stats->totalLatency : stats->latency;
+            const HdrHistogram &jitter = final ? stats->totalJitter : stats->jitter;
+            uint64_t packets = final ? stats->packets : stats->packets - stats->reported;
+            std::cout << "dscp " << std::setw(2) << dscp << ": " << std::fixed << std::setprecision(0) << std::setw(8)
+                      << packets / seconds << " packets/s";
+            if (final) {
+                std::cout << ", " << stats->packets << " received, " << stats->lost << " lost, " << stats->reordered << " reordered";
+                if (stats->duplicates > 0) {
+                    std::cout << ", " << stats->duplicates << " duplicated";
+                }
+                if (stats->restarts > 0) {
+                    std::cout << ", " << stats->restarts << " sender restarts";
+                }
+                if (stats->stale > 0) {
+                    std::cout << ", " << stats->stale << " from an earlier run";
+                }
+                if (stats->negative > 0) {
+                    std::cout << ", " << stats->negative << " before being sent (clocks not synchronized?)";
+                }
+            }
+            std::cout << std::endl << std::setprecision(1)
+                      << "         latency us: min " << latency.getMin() / 1e3 << " p50 " << latency.valueAtPercentile(50) / 1e3
+                      << " p99 " << latency.valueAtPercentile(99) / 1e3 << " p99.9 " << latency.valueAtPercentile(99.9) / 1e3
+                      << " max " << latency.getMax() / 1e3 << std::endl
+                      << "         jitter us: p50 " << jitter.valueAtPercentile(50) / 1e3 << " p99 " << jitter.valueAtPercentile(99) / 1e3
+                      << " max " << jitter.getMax() / 1e3 << " RFC 3550 " << stats->smoothedJitter / 1e3 << std::endl;
+            if (!final) {
+                fold(*stats);
+            }
+            stats->reported = stats->packets;
+        }
+    }
+
+private:
+    int sockfd;
+    struct mmsghdr messages[BATCH];
+    struct iovec iovecs[BATCH];
+    uint8_t slots[BATCH][SLOT_SIZE];
+    // Room for the TOS byte and the largest timestamp message
+    uint8_t controls[BATCH][CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(struct scm_timestamping))];
+    std::unique_ptr<ClassStats> classes[64];        // By DSCP, created on the first packet
+    std::unordered_map<uint64_t, FlowState> flows;  // By DSCP << 32 | flow
+
+    // Move the interval's histograms into the totals
+    void fold(ClassStats &stats) {
+        stats.totalLatency.add(stats.latency);
+        stats.totalJitter.add(stats.jitter);
+        stats.latency.reset();
+        stats.jitter.reset();
+    }
+
+    void account(const struct msghdr &msg, const uint8_t *data, size_t length) {
+        QosHeader header;
+        if (length < sizeof(header)) {
+            return;
+        }
+        memcpy(&header, data, sizeof(header));
+        header = swapHeader(header);
+        if (header.magic != QOS_MAGIC) {
+            return;
+        }
+
+        int tos = 0;
+        uint64_t arrival = 0;
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(const_cast<struct msghdr *>(&msg), cmsg)) {
+            if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_TOS) {
+                tos = *CMSG_DATA(cmsg);
+            } else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+                struct timespec ts;
+                memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+                arrival = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+            } else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+                // ts[2] is the NIC's raw hardware time, ts[0] the software time if the NIC gave none
+                struct scm_timestamping stamps;
+                memcpy(&stamps, CMSG_DATA(cmsg), sizeof(stamps));
+                const struct timespec &ts = (stamps.ts[2].tv_sec || stamps.ts[2].tv_nsec) ? stamps.ts[2] : stamps.ts[0];
+                arrival = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+            }
+        }
+        if (arrival == 0) {
+            arrival = nowNs(CLOCK_REALTIME);
+        }
+
+        int dscp = tos >> 2;
+        if (!classes[dscp]) {
+            classes[dscp] = std::make_unique<ClassStats>();
+        }
+        ClassStats &stats = *classes[dscp];
+        ++stats.packets;
+        stats.bytes += length;
+
+        int64_t latency = (int64_t)(arrival - header.sentNs);
+        if (latency < 0) {
+            ++stats.negative;
+        } else {
+            stats.latency.record(latency);
+        }
+
+        FlowState &flow = flows[(uint64_t)dscp << 32 | header.flow];
+        if (flow.started && header.run != flow.run) {
+            if (header.run < flow.run) {
+                // The previous run's tail, overtaken by the new one; its sequence numbers mean nothing here
+                ++stats.stale;
+                return;
+            }
+            // The sender started over; what its previous run still had in flight is unknown
+            ++stats.restarts;
+            flow = FlowState();
+        }
+        size_t slot = header.sequence % REORDER_WINDOW;
+        if (!flow.started) {
+            flow.started = true;
+            flow.run = header.run;
+            flow.first = header.sequence;
+        } else if (header.sequence < flow.first) {
+            // From before the flow was first seen, so it was never counted as lost
+            ++stats.reordered;
+            return;
+        } else if (header.sequence < flow.expected) {
+            if (flow.seen[slot]) {
+                ++stats.duplicates;
+                return;
+            }
+            // Counted as lost when the later packet arrived
+            flow.seen[slot] = true;
+            ++stats.reordered;
+            --stats.lost;
+            return;
+        } else {
+            // RFC 3550: D is the change in transit time, J moves 1/16 of the way towards |D|
+            uint64_t change = std::abs(latency - flow.lastLatency);
+            stats.jitter.record(change);
+            stats.smoothedJitter += (change - stats.smoothedJitter) / 16;
+            uint64_t skipped = header.sequence - flow.expected;
+            stats.lost += skipped;
+            // The skipped sequences have not arrived; after a gap wider than the window none has
+            if (skipped >= REORDER_WINDOW) {
+                flow.seen.reset();
+            } else {
+                for (uint64_t sequence = flow.expected; sequence < header.sequence; ++sequence) {
+                    flow.seen[sequence % REORDER_WINDOW] = false;
+                }
+            }
+        }
+        flow.seen[slot] = true;
+        flow.expected = header.sequence + 1;
+        flow.lastLatency = latency;
+    }
+};
+
+int main(int argc, char *argv[]) {
+    ReceiverOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0] << " [-p port] [-i report seconds] [-d seconds, 0 until interrupted] [-H interface (hardware timestamps)]" << std::endl;
+        return 1;
+    }
+
+    int sockfd = openSocket(options);
+    if (sockfd < 0) {
+        return 1;
+    }
+
+    // No SA_RESTART, so an interrupt ends the wait in recvmmsg()
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    std::cout << "Listening on UDP port " << options.port << " with " << (options.hardware ? "hardware" : "software")
+              << " timestamps" << std::endl;
+    auto receiver = std::make_unique<Receiver>(sockfd);
+    uint64_t start = nowNs(CLOCK_MONOTONIC);
+    uint64_t interval = (uint64_t)options.interval * 1000000000;
+    uint64_t nextReport = start + interval;
+    while (!stopped) {
+        if (!receiver->receive()) {
+            break;
+        }
+        uint64_t now = nowNs(CLOCK_MONOTONIC);
+        if (now >= nextReport) {
+            std::cout << "After " << (nextReport - start) / 1000000000 << " s:" << std::endl;
+            receiver->report(options.interval, false);
+            nextReport += interval;
+        }
+        if (options.duration > 0 && now - start >= (uint64_t)options.duration * 1000000000) {
+            break;
+        }
+    }
+
+    double seconds = (nowNs(CLOCK_MONOTONIC) - start) / 1e9;
+    std::cout << "Total over " << std::fixed << std::setprecision(1) << seconds << " s:" << std::endl;
+    receiver->report(seconds, true);
+    close(sockfd);
+    return 0;
+}
@@ -0,0 +1,149 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/**
+ * @brief Fixed number of equally sized I/O buffers carved out of one mapping
+ * and shared by every thread of the server.
+ *
+ * The pool is the whole memory budget for data in flight: once every buffer
+ * is taken, acquire() fails instead of allocating more, and the caller is
+ * expected to stop reading until one comes back. Threads waiting for that can
+ * subscribe an eventfd, which is signalled when a buffer is released after an
+ * acquire() failed.
+ */
+class BufferPool {
+public:
+    BufferPool() = default;
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    ~BufferPool() {
+        if (buffers != nullptr) {
+            munmap(buffers, count * bufferSize);
+        }
+    }
+
+    /**
+     * @brief Allocate the buffers.
+     * @param count Number of buffers.
+     * @param bufferSize Size of each buffer in bytes.
+     * @return False, after printing the reason, on failure.
+     */
+    bool setup(size_t count, size_t bufferSize) {
+        this->count = count;
+        this->bufferSize = bufferSize;
+        void* memory = mmap(nullptr, count * bufferSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            perror("mmap buffer pool");
+            return false;
+        }
+        buffers = static_cast<uint8_t*>(memory);
+        available.reserve(count);
+        for (size_t i = count; i > 0; i--) {
+            available.push_back(buffers + (i - 1) * bufferSize);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Take a buffer. The most recently released one is handed out first, as it is likely still cached.
+     * @return Buffer of getBufferSize() bytes, or nullptr if all are taken.
+     */
+    uint8_t* acquire() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (available.empty()) {
+            starved = true;
+            return nullptr;
+        }
+        uint8_t* buffer = available.back();
+        available.pop_back();
+        size_t used = count - available.size();
+        inUse.store(used, std::memory_order_relaxed);
+        if (used > peak.load(std::memory_order_relaxed)) {
+            peak.store(used, std::memory_order_relaxed);
+        }
+        return buffer;
+    }
+
+    /**
+     * @brief Give a buffer back, waking the subscribers if an acquire() failed since the last release.
+     * @param buffer Buffer from acquire().
+     */
+    void release(uint8_t* buffer) {
+        std::lock_guard<std::mutex> lock(mutex);
+        available.push_back(buffer);
+        inUse.store(count - available.size(), std::memory_order_relaxed);
+        if (starved) {
+            starved = false;
+            uint64_t one = 1;
+            for (int fd : subscribers) {
+                if (write(fd, &one, sizeof(one)) < 0) {
+                    perror("write eventfd");
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Have an eventfd signalled whenever buffers become available after running out.
+     * @param eventFd Descriptor from eventfd(), owned by the caller and open as long as the pool is used.
+     */
+    void subscribe(int eventFd) {
+        std::lock_guard<std::mutex> lock(mutex);
+        subscribers.push_back(eventFd);
+    }
+
+    /**
+     * @brief Get the number of buffers currently taken.
+     * @return Buffers in use.
+     */
+    size_t getInUse() const {
+        return inUse.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the highest number of buffers ever taken at once.
+     * @return Peak buffers in use.
+     */
+    size_t getPeak() const {
+        return peak.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the number of buffers in the pool.
+     * @return Buffer count.
+     */
+    size_t getCount() const {
+        return count;
+    }
+
+    /**
+     * @brief Get the size of each buffer.
+     * @return Buffer size in bytes.
+     */
+    size_t getBufferSize() const {
+        return bufferSize;
+    }
+
+private:
+    std::mutex mutex;
+    uint8_t* buffers = nullptr;         // count buffers of bufferSize bytes, contiguous
+    size_t count = 0;
+    size_t bufferSize = 0;
+    std::vector<uint8_t*> available;    // Free buffers, used as a stack
+    std::vector<int> subscribers;
+    bool starved = false;               // An acquire() failed since the last release()
+    std::atomic<size_t> inUse{0};       // Readable without the lock, for reports
+    std::atomic<size_t> peak{0};
+};
+
+#endif // BUFFERPOOL_H
@@ -1,37 +1,457 @@
 // client.cpp
 #include <iostream>
-#include <fstream>
+#include <iomanip>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
 #include <cstring>
 #include <cstdlib>
+#include <cerrno>
+#include <csignal>
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <linux/errqueue.h>
+#include "transfer.h"
+#include "xxhash64.h"
+#include "../02 - Ethernet/crc32.h"
 
-#define BUFFER_SIZE 1024
+#define BUFFER_SIZE 65536
+#define SENDFILE_CHUNK 0x7ffff000 // Largest count one sendfile() call transfers
+#define ZEROCOPY_CHUNK (1 << 20)  // Bytes per MSG_ZEROCOPY send, each pins its pages until completion
+
+// How the file is pushed to the socket
+enum class SendMode {
+    Copy,     // read() into a buffer, then send()
+    Sendfile, // sendfile(), the kernel sends straight from the page cache
+    Zerocopy  // send() with MSG_ZEROCOPY from a mapping of the file
+};
+
+// What a transfer took, for the throughput report
+struct SendStats {
+    uint64_t bytes = 0;
+    uint64_t syscalls = 0;    // Calls that moved data, plus error queue reads in zerocopy mode
+    uint64_t completions = 0; // Zerocopy: sends the kernel reported as finished
+    uint64_t copied = 0;      // Zerocopy: finished sends the kernel had to copy anyway, e.g. over loopback
+    uint64_t chunks = 0;      // Multi-stream: chunks in the file
+    uint64_t skipped = 0;     // Multi-stream: chunks the server already held and did not need again
+};
+
+// Copy mode: one read and at least one send per buffer, resuming after short sends
+bool sendCopy(int sock, int file, SendStats &stats) {
+    char buffer[BUFFER_SIZE];
+    while (true) {
+        ssize_t valread = read(file, buffer, BUFFER_SIZE);
+        ++stats.syscalls;
+        if (valread < 0 && errno == EINTR) {
+            continue;
+        }
+        if (valread < 0) {
+            perror("read");
+            return false;
+        }
+        if (valread == 0) {
+            return true;
+        }
+        for (ssize_t sent = 0; sent < valread;) {
+            ssize_t n = send(sock, buffer + sent, valread - sent, MSG_NOSIGNAL);
+            ++stats.syscalls;
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                perror("send");
+                return false;
+            }
+            sent += n;
+            stats.bytes += n;
+        }
+    }
+}
+
+// Sendfile mode: send [offset, end) of the file. The kernel advances the offset, so a short
+// transfer just continues where it stopped.
+bool sendFile(int sock, int file, off_t offset, off_t end, SendStats &stats) {
+    while (offset < end) {
+        ssize_t n = sendfile(sock, file, &offset, std::min<off_t>(end - offset, SENDFILE_CHUNK));
+        ++stats.syscalls;
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            perror("sendfile");
+            return false;
+        }
+        if (n == 0) {
+            std::cerr << "File shrank while sending" << std::endl;
+            return false;
+        }
+        stats.bytes += n;
+    }
+    return true;
+}
+
+// Read every zerocopy completion queued on the socket error queue. Each one covers a range
+// of send calls, numbered from 0 in the order they were made.
+bool reapCompletions(int sock, SendStats &stats) {
+    while (true) {
+        char control[128];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("recvmsg MSG_ERRQUEUE");
+            return false;
+        }
+        ++stats.syscalls;
+
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                  (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) {
+                continue;
+            }
+            struct sock_extended_err err;
+            memcpy(&err, CMSG_DATA(cm), sizeof(err));
+            if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY || err.ee_errno != 0) {
+                continue;
+            }
+            uint64_t count = (uint32_t)(err.ee_data - err.ee_info) + 1;
+            stats.completions += count;
+            if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                stats.copied += count;
+            }
+        }
+    }
+}
+
+// Zerocopy mode: the socket sends straight from the mapped file pages. The pages stay pinned
+// until the kernel posts a completion, so the mapping is only released once every send completed.
+bool sendZerocopy(int sock, int file, off_t size, SendStats &stats) {
+    int one = 1;
+    if (setsockopt(sock, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) < 0) {
+        perror("setsockopt SO_ZEROCOPY");
+        return false;
+    }
+    if (size == 0) {
+        return true;
+    }
+    void *mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, file, 0);
+    if (mapping == MAP_FAILED) {
+        perror("mmap");
+        return false;
+    }
+    const char *data = static_cast<const char *>(mapping);
+
+    bool ok = true;
+    uint64_t sends = 0;
+    for (off_t offset = 0; ok && offset < size;) {
+        ssize_t n = send(sock, data + offset, std::min<off_t>(size - offset, ZEROCOPY_CHUNK), MSG_ZEROCOPY | MSG_NOSIGNAL);
+        ++stats.syscalls;
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && errno == ENOBUFS) {
+            // Too many pinned sends for the socket's optmem budget, wait for some to finish
+            struct pollfd pfd = {sock, 0, 0};
+            poll(&pfd, 1, -1);
+            ok = reapCompletions(sock, stats);
+            continue;
+        }
+        if (n < 0) {
+            perror("send MSG_ZEROCOPY");
+            ok = false;
+            break;
+        }
+        ++sends;
+        offset += n;
+        stats.bytes += n;
+        ok = reapCompletions(sock, stats);
+    }
+
+    // POLLERR is always reported, it signals a non-empty error queue
+    while (ok && stats.completions < sends) {
+        struct pollfd pfd = {sock, 0, 0};
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+        ok = reapCompletions(sock, stats);
+    }
+    munmap(mapping, size);
+    return ok;
+}
+
+bool parseMode(const char *name, SendMode &mode) {
+    std::string value = name;
+    if (value == "copy") {
+        mode = SendMode::Copy;
+    } else if (value == "sendfile") {
+        mode = SendMode::Sendfile;
+    } else if (value == "zerocopy") {
+        mode = SendMode::Zerocopy;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Connect and wait for the server's "ready\n". Returns the socket, or -1 after printing the reason.
+int connectToServer(const struct sockaddr_in &serv_addr) {
+    int sock;
+    if ((sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+        perror("Socket creation error");
+        return -1;
+    }
+
+    if (connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+        perror("Connection failed");
+        close(sock);
+        return -1;
+    }
+
+    // "ready\n" may arrive in pieces
+    char buffer[16];
+    size_t received = 0;
+    while (received < 6) {
+        ssize_t valread = read(sock, buffer + received, 6 - received);
+        if (valread <= 0) {
+            break;
+        }
+        received += valread;
+    }
+    if (received != 6 || memcmp(buffer, "ready\n", 6) != 0) {
+        std::cerr << "Did not receive 'ready' message from server" << std::endl;
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// Read one line, without the newline, e.g. the server's answer to a multi-stream transfer
+std::string readLine(int sock) {
+    std::string line;
+    char c;
+    while (read(sock, &c, 1) == 1 && c != '\n') {
+        line += c;
+    }
+    return line;
+}
+
+// Derive the transfer id from the file's path, size and modification time, so an upload
+// restarted after an interruption joins the manifest the server kept for it
+uint64_t transferId(const char *filename, const struct stat &info) {
+    char *path = realpath(filename, nullptr);
+    XXHash64 hash;
+    hash.update(std::span<const uint8_t>(reinterpret_cast<const uint8_t *>(path ? path : filename), strlen(path ? path : filename)));
+    free(path);
+    uint64_t fields[2] = {(uint64_t)info.st_size, (uint64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec};
+    hash.update(std::span<const uint8_t>(reinterpret_cast<const uint8_t *>(fields), sizeof(fields)));
+    return hash.digest();
+}
+
+// Read the manifest the server answers a hello with: XXH64 and length of each kept chunk, by offset
+bool receiveManifest(int sock, std::unordered_map<uint64_t, ManifestEntry> &manifest) {
+    uint32_t count;
+    if (!receiveAll(sock, &count, sizeof(count))) {
+        return false;
+    }
+    for (uint32_t i = be32toh(count); i > 0; i--) {
+        ManifestEntry entry;
+        if (!receiveAll(sock, &entry, sizeof(entry))) {
+            return false;
+        }
+        entry = swapEntry(entry);
+        manifest[entry.offset] = entry;
+    }
+    return true;
+}
+
+// Multi-stream mode (see transfer.h): chunk i of the file goes out with sendfile() on stream
+// i % streams, one thread per stream. A hasher thread walks the file in order, computing the
+// CRC32 and XXH64 of every chunk. A chunk the server's manifest lists with the same hash is
+// skipped; only those wait for the hasher, all others are sent at once. Once the hasher is done,
+// every stream ends with the CRC of the whole file and waits for the server's verdict.
+bool sendStreams(const struct sockaddr_in &serv_addr, int file, const char *filename, const struct stat &info,
+                 unsigned streams, uint64_t chunkSize, SendStats &stats) {
+    off_t size = info.st_size;
+    std::vector<int> socks;
+    std::unordered_map<uint64_t, ManifestEntry> manifest;
+    TransferHello hello = {TRANSFER_MAGIC, 0, (uint16_t)streams, transferId(filename, info), (uint64_t)size};
+    for (unsigned i = 0; i < streams; i++) {
+        int sock = connectToServer(serv_addr);
+        hello.stream = i;
+        TransferHello wire = swapHello(hello);
+        // Every stream gets the same manifest, only the first copy is kept
+        std::unordered_map<uint64_t, ManifestEntry> copy;
+        if (sock < 0 || !sendAll(sock, &wire, sizeof(wire)) || !receiveManifest(sock, i == 0 ? manifest : copy)) {
+            if (sock >= 0) {
+                std::cerr << "Stream " << i << ": the server did not send its manifest" << std::endl;
+                close(sock);
+            }
+            for (int open : socks) {
+                close(open);
+            }
+            return false;
+        }
+        socks.push_back(sock);
+    }
+
+    const uint8_t *data = nullptr;
+    if (size > 0) {
+        void *mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, file, 0);
+        if (mapping == MAP_FAILED) {
+            perror("mmap");
+            for (int sock : socks) {
+                close(sock);
+            }
+            return false;
+        }
+        data = static_cast<const uint8_t *>(mapping);
+    }
+
+    uint64_t chunks = (size + chunkSize - 1) / chunkSize;
+    auto chunkLength = [&](uint64_t chunk) { return std::min<uint64_t>(chunkSize, size - chunk * chunkSize); };
+    std::vector<uint32_t> crcs(chunks);
+    std::vector<uint64_t> hashes(chunks);
+    uint32_t fileCRC = 0;
+    std::atomic<uint64_t> hashed{0}; // Chunks whose crcs and hashes are filled in; fileCRC is set once all are
+    std::thread hasher([&]() {
+        for (uint64_t chunk = 0; chunk < chunks; chunk++) {
+            std::span<const uint8_t> bytes(data + chunk * chunkSize, chunkLength(chunk));
+            crcs[chunk] = CRC32::update(0, bytes);
+            hashes[chunk] = XXHash64::hash(bytes);
+            fileCRC = CRC32::combine(fileCRC, crcs[chunk], bytes.size());
+            hashed.store(chunk + 1, std::memory_order_release);
+            hashed.notify_all();
+        }
+    });
+    auto waitHashed = [&](uint64_t count) {
+        uint64_t done;
+        while ((done = hashed.load(std::memory_order_acquire)) < count) {
+            hashed.wait(done);
+        }
+    };
+
+    std::vector<SendStats> results(streams);
+    std::vector<std::string> answers(streams);
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < streams; i++) {
+        threads.emplace_back([&, i]() {
+            int sock = socks[i];
+            bool ok = true;
+            for (uint64_t chunk = i; ok && chunk < chunks; chunk += streams) {
+                uint64_t offset = chunk * chunkSize;
+                uint64_t length = chunkLength(chunk);
+                auto kept = manifest.find(offset);
+                if (kept != manifest.end() && kept->second.length == length) {
+                    waitHashed(chunk + 1);
+                    if (kept->second.hash == hashes[chunk]) {
+                        FrameHeader skip = swapFrame({FRAME_SKIP, (uint32_t)length, offset});
+                        ok = sendAll(sock, &skip, sizeof(skip));
+                        ++results[i].skipped;
+                        continue;
+                    }
+                }
+                FrameHeader frame = swapFrame({FRAME_CHUNK, (uint32_t)length, offset});
+                ok = sendAll(sock, &frame, sizeof(frame)) && sendFile(sock, file, offset, offset + length, results[i]);
+            }
+            waitHashed(chunks);
+            FrameHeader end = swapFrame({FRAME_END, 0, fileCRC});
+            if (ok && sendAll(sock, &end, sizeof(end))) {
+                answers[i] = readLine(sock);
+            } else {
+                answers[i] = "error send failed";
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    hasher.join();
+    for (int sock : socks) {
+        close(sock);
+    }
+    if (data != nullptr) {
+        munmap(const_cast<uint8_t *>(data), size);
+    }
+
+    bool ok = true;
+    stats.chunks = chunks;
+    for (unsigned i = 0; i < streams; i++) {
+        stats.bytes += results[i].bytes;
+        stats.syscalls += results[i].syscalls;
+        stats.skipped += results[i].skipped;
+        if (answers[i].compare(0, 3, "ok ") != 0) {
+            std::cerr << "Stream " << i << ": " << (answers[i].empty() ? "no answer from server" : answers[i]) << std::endl;
+            ok = false;
+        }
+    }
+    if (ok) {
+        std::cout << "Server verified " << streams << " streams, CRC32 " << answers[0].substr(3) << std::endl;
+    }
+    return ok;
+}
 
 int main(int argc, char *argv[]) {
-    if (argc != 4) {
-        std::cerr << "Usage: " << argv[0] << " <IP> <Port> <File>" << std::endl;
+    SendMode mode = SendMode::Sendfile;
+    bool modeSet = false;
+    unsigned streams = 0;
+    uint64_t chunkSize = DEFAULT_CHUNK_SIZE;
+    bool valid = true;
+    int opt;
+    while (valid && (opt = getopt(argc, argv, "m:n:c:")) != -1) {
+        switch (opt) {
+            case 'm':
+                valid = parseMode(optarg, mode);
+                modeSet = true;
+                break;
+            case 'n':
+                streams = std::atoi(optarg);
+                valid = streams > 0 && streams <= MAX_STREAMS;
+                break;
+            case 'c':
+                chunkSize = std::strtoull(optarg, nullptr, 10);
+                valid = chunkSize > 0 && chunkSize <= MAX_CHUNK_SIZE;
+                break;
+            default:
+                valid = false;
+        }
+    }
+    // Multi-stream transfers always use sendfile()
+    if (!valid || argc - optind != 3 || (streams > 0 && modeSet)) {
+        std::cerr << "Usage: " << argv[0] << " [-m copy|sendfile|zerocopy | -n streams [-c chunk bytes]] <IP> <Port> <File>" << std::endl;
         return 1;
     }
 
-    const char *server_ip = argv[1];
-    int server_port = std::atoi(argv[2]);
-    const char *filename = argv[3];
+    const char *server_ip = argv[optind];
+    int server_port = std::atoi(argv[optind + 1]);
+    const char *filename = argv[optind + 2];
 
-    int sock = 0;
     struct sockaddr_in serv_addr;
-    char buffer[BUFFER_SIZE];
-    std::ifstream file(filename);
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    int file = open(filename, O_RDONLY | O_CLOEXEC);
+    struct stat info;
 
-    if (!file.is_open()) {
+    if (file < 0 || fstat(file, &info) < 0) {
         std::cerr << "Could not open file: " << filename << std::endl;
         return 1;
     }
-
-    if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-        perror("Socket creation error");
-        return 1;
-    }
+    posix_fadvise(file, 0, 0, POSIX_FADV_SEQUENTIAL);
 
     serv_addr.sin_family = AF_INET;
     serv_addr.sin_port = htons(server_port);
@@ -41,26 +461,52 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    if (connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
-        perror("Connection failed");
-        return 1;
+    // sendfile() has no MSG_NOSIGNAL, so a server that hangs up must not kill the client
+    signal(SIGPIPE, SIG_IGN);
+
+    SendStats stats;
+    auto start = std::chrono::steady_clock::now();
+    bool ok = false;
+    if (streams > 0) {
+        ok = sendStreams(serv_addr, file, filename, info, streams, chunkSize, stats);
+    } else {
+        int sock = connectToServer(serv_addr);
+        if (sock < 0) {
+            return 1;
+        }
+        switch (mode) {
+            case SendMode::Copy:
+                ok = sendCopy(sock, file, stats);
+                break;
+            case SendMode::Sendfile:
+                ok = sendFile(sock, file, 0, info.st_size, stats);
+                break;
+            case SendMode::Zerocopy:
+                ok = sendZerocopy(sock, file, info.st_size, stats);
+                break;
+        }
+        close(sock);
     }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
 
-    int valread = read(sock, buffer, BUFFER_SIZE);
-    buffer[valread] = '\0';
-    if (strcmp(buffer, "ready\n") != 0) {
-        std::cerr << "Did not receive 'ready' message from server" << std::endl;
+    close(file);
+    if (!ok) {
         return 1;
     }
 
-    while (file.good()) {
-        file.read(buffer, BUFFER_SIZE);
-        send(sock, buffer, file.gcount(), 0);
+    double seconds = elapsed.count() > 0 ? elapsed.count() : 1e-9;
+    std::cout << "File sent successfully" << std::endl
+              << std::fixed << std::setprecision(1)
+              << stats.bytes << " bytes in " << std::setprecision(3) << elapsed.count() << " s, "
+              << std::setprecision(1) << stats.bytes / seconds / 1048576 << " MB/s ("
+              << std::setprecision(2) << stats.bytes * 8 / seconds / 1e9 << " Gbit/s), "
+              << stats.syscalls << " syscalls" << std::endl;
+    if (mode == SendMode::Zerocopy) {
+        std::cout << stats.completions << " zerocopy sends completed, " << stats.copied << " of them copied by the kernel" << std::endl;
+    }
+    if (streams > 0) {
+        std::cout << stats.skipped << " of " << stats.chunks << " chunks already held by the server" << std::endl;
     }
-
-    file.close();
-    close(sock);
-    std::cout << "File sent successfully" << std::endl;
 
     return 0;
 }
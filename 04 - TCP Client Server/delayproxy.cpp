@@ -0,0 +1,371 @@
+// delayproxy.cpp
+// Userspace stand-in for a long-fat network link, to benchmark the
+// multi-stream transfer over loopback without netem. Every connection to the
+// listening port is forwarded to the target, and the bytes read in each
+// direction are held back for the configured one-way delay before being
+// written on. Each direction holds at most a window of bytes, so one
+// connection can move at most window / delay bytes per second, like a TCP
+// flow limited by its congestion or receive window on a real long link.
+// Several parallel connections each get their own window.
+//
+// Build: g++ -std=c++20 -O2 -o delayproxy delayproxy.cpp
+// Usage: ./delayproxy [-d delay ms] [-w window bytes] <Listen port> <Target IP> <Target port>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+
+#define DEFAULT_DELAY_MS 25          // One way, so the round trip is twice this
+#define DEFAULT_WINDOW (1 << 20)
+#define READ_SIZE 65536
+#define MAX_EVENTS 256
+
+typedef std::chrono::steady_clock Clock;
+
+// Bytes read from one side, held back until their delivery time
+struct Segment {
+    Clock::time_point due;
+    std::vector<char> data;
+    size_t sent = 0;
+};
+
+// One direction of a proxied connection
+struct Direction {
+    int from;
+    int to;
+    std::deque<Segment> queue;
+    size_t queued = 0;          // Bytes read but not written yet
+    bool eof = false;           // from has no more data
+    bool shutdown = false;      // EOF passed on to the other side
+    bool writeBlocked = false;  // to has no send buffer space, wait for EPOLLOUT
+};
+
+struct Connection {
+    Direction up;   // Client to target
+    Direction down; // Target to client
+    bool failed = false;
+    bool connecting = false;   // The connect to the target has not completed yet
+    uint32_t clientEvents = 0; // Current epoll interest of each side
+    uint32_t targetEvents = 0;
+};
+
+class DelayProxy {
+public:
+    DelayProxy(Clock::duration delay, size_t window) : delay(delay), window(window) {}
+
+    bool start(int port, const struct sockaddr_in &target) {
+        this->target = target;
+        if ((server_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+            perror("socket failed");
+            return false;
+        }
+        int reuse = 1;
+        setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = INADDR_ANY;
+        address.sin_port = htons(port);
+        if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+            perror("bind failed");
+            return false;
+        }
+        if (listen(server_fd, SOMAXCONN) < 0) {
+            perror("listen failed");
+            return false;
+        }
+
+        if ((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+            perror("epoll_create1");
+            return false;
+        }
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = nullptr;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_fd, &event);
+        return true;
+    }
+
+    void run() {
+        struct epoll_event events[MAX_EVENTS];
+        while (true) {
+            int count = epoll_wait(epoll_fd, events, MAX_EVENTS, nextTimeout());
+            if (count < 0 && errno != EINTR) {
+                perror("epoll_wait");
+                return;
+            }
+
+            for (int i = 0; i < count; i++) {
+                Connection *connection = static_cast<Connection *>(events[i].data.ptr);
+                if (connection == nullptr) {
+                    acceptClient();
+                    continue;
+                }
+                if (connection->connecting) {
+                    checkConnected(*connection);
+                    if (connection->failed) {
+                        continue;
+                    }
+                }
+                // Which side the event is for is not recorded, so serve both; reads and writes are non-blocking
+                if (!connection->connecting && (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+                    connection->up.writeBlocked = false;
+                    connection->down.writeBlocked = false;
+                }
+                if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                    receive(*connection, connection->up);
+                    receive(*connection, connection->down);
+                }
+            }
+
+            // Deliver everything that is due, then drop finished connections
+            for (auto &connection : connections) {
+                deliver(*connection, connection->up);
+                deliver(*connection, connection->down);
+                updateEvents(*connection);
+            }
+            std::erase_if(connections, [this](const std::unique_ptr<Connection> &connection) {
+                bool done = connection->failed || (connection->up.shutdown && connection->down.shutdown);
+                if (done) {
+                    close(connection->up.from);
+                    close(connection->down.from);
+                }
+                return done;
+            });
+        }
+    }
+
+private:
+    Clock::duration delay;
+    size_t window;
+    struct sockaddr_in target;
+    int server_fd = -1;
+    int epoll_fd = -1;
+    std::vector<std::unique_ptr<Connection>> connections;
+
+    void acceptClient() {
+        while (true) {
+            int client = accept4(server_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (client < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    perror("accept4");
+                }
+                return;
+            }
+            // The connect completes in the background, signalled by EPOLLOUT on upstream
+            int upstream = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            int connected = upstream < 0 ? -1 : connect(upstream, (struct sockaddr *)&target, sizeof(target));
+            if (connected < 0 && (upstream < 0 || errno != EINPROGRESS)) {
+                perror("connect to target");
+                close(client);
+                if (upstream >= 0) {
+                    close(upstream);
+                }
+                continue;
+            }
+
+            auto connection = std::make_unique<Connection>();
+            connection->up.from = connection->down.to = client;
+            connection->up.to = connection->down.from = upstream;
+            // Until the target is reached, what the client sends is queued as if the target's send buffer were full
+            connection->connecting = connected < 0;
+            connection->up.writeBlocked = connection->connecting;
+            connection->clientEvents = EPOLLIN;
+            connection->targetEvents = connection->connecting ? EPOLLIN | EPOLLOUT : EPOLLIN;
+            int one = 1;
+            for (int sd : {client, upstream}) {
+                setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                struct epoll_event event;
+                event.events = (sd == client) ? connection->clientEvents : connection->targetEvents;
+                event.data.ptr = connection.get();
+                epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sd, &event);
+            }
+            connections.push_back(std::move(connection));
+        }
+    }
+
+    // Finish the connect to the target once it has succeeded or failed; until then nothing is written upstream
+    void checkConnected(Connection &connection) {
+        int upstream = connection.up.to;
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (getsockopt(upstream, SOL_SOCKET, SO_ERROR, &error, &length) < 0) {
+            error = errno;
+        }
+        if (error != 0) {
+            std::cerr << "connect to target: " << strerror(error) << std::endl;
+            connection.failed = true;
+            return;
+        }
+        // No error and no peer yet: the event was for the client, and the connect is still in progress
+        struct sockaddr_in peer;
+        socklen_t size = sizeof(peer);
+        if (getpeername(upstream, (struct sockaddr *)&peer, &size) < 0) {
+            return;
+        }
+        connection.connecting = false;
+        connection.up.writeBlocked = false;
+    }
+
+    // Read as much as the window allows, stamping it with its delivery time
+    void receive(Connection &connection, Direction &direction) {
+        while (!direction.eof && direction.queued < window) {
+            Segment segment;
+            segment.data.resize(std::min<size_t>(READ_SIZE, window - direction.queued));
+            ssize_t n = read(direction.from, segment.data.data(), segment.data.size());
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return;
+            }
+            if (n < 0) {
+                connection.failed = true;
+                return;
+            }
+            if (n == 0) {
+                direction.eof = true;
+                return;
+            }
+            segment.data.resize(n);
+            segment.due = Clock::now() + delay;
+            direction.queued += n;
+            direction.queue.push_back(std::move(segment));
+        }
+    }
+
+    // Write every segment whose time has come
+    void deliver(Connection &connection, Direction &direction) {
+        // Not even a client's EOF can be passed on before the target is connected
+        if (connection.connecting) {
+            return;
+        }
+        auto now = Clock::now();
+        while (!direction.writeBlocked && !direction.queue.empty() && direction.queue.front().due <= now) {
+            Segment &segment = direction.queue.front();
+            ssize_t n = send(direction.to, segment.data.data() + segment.sent, segment.data.size() - segment.sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                direction.writeBlocked = true;
+                return;
+            }
+            if (n < 0) {
+                connection.failed = true;
+                return;
+            }
+            segment.sent += n;
+            direction.queued -= n;
+            if (segment.sent == segment.data.size()) {
+                direction.queue.pop_front();
+            }
+        }
+        if (direction.eof && direction.queue.empty() && !direction.shutdown) {
+            shutdown(direction.to, SHUT_WR);
+            direction.shutdown = true;
+        }
+    }
+
+    // Read only while the window has room, wait for send space only while a write is blocked
+    void updateEvents(Connection &connection) {
+        auto wanted = [this](const Direction &reading, const Direction &writing) {
+            uint32_t events = 0;
+            if (!reading.eof && reading.queued < window) {
+                events |= EPOLLIN;
+            }
+            if (writing.writeBlocked) {
+                events |= EPOLLOUT;
+            }
+            return events;
+        };
+        uint32_t client = wanted(connection.up, connection.down);
+        uint32_t upstream = wanted(connection.down, connection.up);
+        if (client != connection.clientEvents) {
+            modify(connection, connection.up.from, client);
+            connection.clientEvents = client;
+        }
+        if (upstream != connection.targetEvents) {
+            modify(connection, connection.down.from, upstream);
+            connection.targetEvents = upstream;
+        }
+    }
+
+    void modify(Connection &connection, int sd, uint32_t events) {
+        struct epoll_event event;
+        event.events = events;
+        event.data.ptr = &connection;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, sd, &event);
+    }
+
+    // Milliseconds until the earliest queued segment is due, or -1 to wait for I/O only
+    int nextTimeout() const {
+        bool any = false;
+        Clock::time_point earliest;
+        for (const auto &connection : connections) {
+            for (const Direction *direction : {&connection->up, &connection->down}) {
+                if (!direction->writeBlocked && !direction->queue.empty() && (!any || direction->queue.front().due < earliest)) {
+                    earliest = direction->queue.front().due;
+                    any = true;
+                }
+            }
+        }
+        if (!any) {
+            return -1;
+        }
+        auto wait = std::chrono::ceil<std::chrono::milliseconds>(earliest - Clock::now());
+        return std::max<int>(0, wait.count());
+    }
+};
+
+int main(int argc, char *argv[]) {
+    int delay = DEFAULT_DELAY_MS;
+    size_t window = DEFAULT_WINDOW;
+    bool valid = true;
+    int opt;
+    while (valid && (opt = getopt(argc, argv, "d:w:")) != -1) {
+        switch (opt) {
+            case 'd':
+                delay = std::atoi(optarg);
+                break;
+            case 'w':
+                window = std::strtoull(optarg, nullptr, 10);
+                valid = window > 0;
+                break;
+            default:
+                valid = false;
+        }
+    }
+    if (!valid || argc - optind != 3) {
+        std::cerr << "Usage: " << argv[0] << " [-d delay ms] [-w window bytes] <Listen port> <Target IP> <Target port>" << std::endl;
+        return 1;
+    }
+
+    struct sockaddr_in target;
+    memset(&target, 0, sizeof(target));
+    target.sin_family = AF_INET;
+    target.sin_port = htons(std::atoi(argv[optind + 2]));
+    if (inet_pton(AF_INET, argv[optind + 1], &target.sin_addr) <= 0) {
+        perror("Invalid address/ Address not supported");
+        return 1;
+    }
+
+    DelayProxy proxy(std::chrono::milliseconds(delay), window);
+    if (!proxy.start(std::atoi(argv[optind]), target)) {
+        return 1;
+    }
+    std::cout << "Forwarding port " << argv[optind] << " to " << argv[optind + 1] << ":" << argv[optind + 2]
+              << " with " << delay << " ms one-way delay and a " << window << " byte window" << std::endl;
+    proxy.run();
+    return 0;
+}
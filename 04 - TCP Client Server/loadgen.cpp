@@ -0,0 +1,143 @@
+// loadgen.cpp
+// Connection-rate load generator for the upload server. It keeps a fixed
+// number of connection attempts in flight, waits for each one to receive
+// "ready\n" (which the server sends right after accept), then closes it and
+// opens the next. It reports connections per second and the distribution of
+// connect-to-ready latency, which is dominated by how quickly the server
+// drains its accept queue.
+//
+// Build: g++ -std=c++20 -O2 -o loadgen loadgen.cpp
+// Usage: ./loadgen <IP> <Port> <Connections> [Concurrency]
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+
+#define DEFAULT_CONCURRENCY 256
+#define MAX_EVENTS 256
+
+typedef std::chrono::steady_clock Clock;
+
+// One in-flight connection attempt
+struct Attempt {
+    Clock::time_point started; // When connect() was issued
+    size_t received = 0;       // Bytes of "ready\n" seen so far
+};
+
+int main(int argc, char *argv[]) {
+    if (argc != 4 && argc != 5) {
+        std::cerr << "Usage: " << argv[0] << " <IP> <Port> <Connections> [Concurrency]" << std::endl;
+        return 1;
+    }
+
+    struct sockaddr_in serv_addr;
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_port = htons(std::atoi(argv[2]));
+    if (inet_pton(AF_INET, argv[1], &serv_addr.sin_addr) <= 0) {
+        perror("Invalid address/ Address not supported");
+        return 1;
+    }
+    size_t total = std::strtoull(argv[3], nullptr, 10);
+    size_t concurrency = (argc == 5) ? std::strtoull(argv[4], nullptr, 10) : DEFAULT_CONCURRENCY;
+    if (concurrency == 0) {
+        // Nothing would ever be started and the loop would wait forever
+        std::cerr << "Concurrency must be at least 1" << std::endl;
+        return 1;
+    }
+
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    int epoll_fd = epoll_create1(0);
+    if (epoll_fd < 0) {
+        perror("epoll_create1");
+        return 1;
+    }
+
+    std::vector<Attempt> attempts;       // Indexed by socket descriptor
+    std::vector<double> latencies;       // Connect-to-ready time of each completed connection, in microseconds
+    latencies.reserve(total);
+    size_t started = 0, inFlight = 0, failed = 0;
+
+    auto open = [&]() {
+        int sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (sock < 0) {
+            perror("socket");
+            exit(1);
+        }
+        if ((size_t)sock >= attempts.size()) {
+            attempts.resize(sock + 1);
+        }
+        attempts[sock] = Attempt();
+        attempts[sock].started = Clock::now();
+        if (connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0 && errno != EINPROGRESS) {
+            perror("connect");
+            close(sock);
+            ++failed;
+            return;
+        }
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = sock;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sock, &event);
+        ++inFlight;
+    };
+
+    auto begin = Clock::now();
+    struct epoll_event events[MAX_EVENTS];
+    while (latencies.size() + failed < total) {
+        while (inFlight < concurrency && started < total) {
+            ++started;
+            open();
+        }
+
+        int count = epoll_wait(epoll_fd, events, MAX_EVENTS, 1000);
+        for (int i = 0; i < count; i++) {
+            int sock = events[i].data.fd;
+            char buffer[16];
+            ssize_t n = read(sock, buffer, sizeof(buffer));
+            if (n < 0 && errno == EAGAIN) {
+                continue;
+            }
+            if (n > 0) {
+                attempts[sock].received += n;
+                if (attempts[sock].received < 6) {
+                    continue;
+                }
+                std::chrono::duration<double, std::micro> elapsed = Clock::now() - attempts[sock].started;
+                latencies.push_back(elapsed.count());
+            } else {
+                ++failed;
+            }
+            close(sock);
+            --inFlight;
+        }
+    }
+    std::chrono::duration<double> elapsed = Clock::now() - begin;
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        return latencies.empty() ? 0.0 : latencies[std::min(latencies.size() - 1, (size_t)(p * latencies.size()))];
+    };
+
+    std::cout << std::fixed << std::setprecision(1)
+              << "Connections: " << latencies.size() << " ok, " << failed << " failed, concurrency " << concurrency << std::endl
+              << "Rate: " << latencies.size() / elapsed.count() << " connections/s" << std::endl
+              << "Latency (us): p50 " << percentile(0.50) << ", p99 " << percentile(0.99)
+              << ", max " << (latencies.empty() ? 0.0 : latencies.back()) << std::endl;
+
+    close(epoll_fd);
+    return 0;
+}
@@ -1,44 +1,390 @@
 // server.cpp
 #include <iostream>
-#include <fstream>
+#include <iomanip>
+#include <string>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+#include <thread>
+#include <chrono>
 #include <cstring>
 #include <cstdlib>
+#include <cerrno>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/eventfd.h>
 #include <fcntl.h>
-#include <sys/select.h>
+#include <sched.h>
+#include <pthread.h>
+#include "uring.h"
+#include "bufferpool.h"
+#include "transfer.h"
+#include "xxhash64.h"
+#include "../02 - Ethernet/crc32.h"
 
 #define PORT 9001
-#define BUFFER_SIZE 1024
-#define MAX_CLIENTS 10
+#define BUFFER_SIZE 65536
+#define DEFAULT_BACKLOG 4096
+#define MAX_EVENTS 256
+#define URING_ENTRIES 4096
+#define URING_BUFFER_SIZE 65536
+#define URING_BUFFER_COUNT 256
+#define SPLICE_PIPE_SIZE (1 << 20) // Capped by /proc/sys/fs/pipe-max-size
+#define STATS_INTERVAL 5           // Seconds between transfer counter reports
+#define DEFAULT_BUDGET_MB 64       // Received data waiting for the disk, across all workers
+#define MAX_QUEUED_BUFFERS 32      // Buffers one client may have waiting, so one fast client cannot take the whole pool
+#define HASH_READ_SIZE (1 << 20)   // Bytes read back at a time when hashing a received chunk
+#define MANIFEST_MAGIC 0x4d414e31  // "MAN1"
 
-void setNonBlocking(int sockfd) {
-    int flags = fcntl(sockfd, F_GETFL, 0);
-    fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);
+// A chunk written by a multi-stream transfer, kept to verify the file once all streams end.
+// Also the record format of the manifest file, in host order.
+struct ChunkRecord {
+    uint64_t offset;
+    uint32_t length; // 0 in the manifest marks the chunk at offset as being overwritten
+    uint32_t crc;    // CRC32 of the chunk data alone
+    uint64_t hash;   // XXH64 of the chunk data alone
+};
+
+// Start of a manifest file, followed by ChunkRecords
+struct ManifestHeader {
+    uint64_t magic;  // MANIFEST_MAGIC
+    uint64_t size;   // Size of the file the records describe
+};
+
+// One multi-stream transfer. Its streams may be accepted by different workers,
+// so it is shared between them and locked.
+struct Transfer {
+    std::mutex mutex;
+    uint64_t id;
+    uint64_t size;                   // File size announced by the client
+    unsigned streams;                // Streams the client opens
+    int file = -1;                   // Written with pwrite() by every stream, read back by the hasher
+    std::string filename;
+    std::string manifestName;        // Removed once the file is verified, so the next upload sends it all
+    int manifestFile = -1;           // Appended a ChunkRecord for every chunk hashed
+    std::unordered_map<uint64_t, ChunkRecord> manifest; // Chunks kept from earlier attempts, by offset
+    std::vector<int> sockets;        // Streams still connected, which get the final answer
+    std::vector<bool> joined;        // Stream indices seen so far, guarded by the registry lock instead
+    std::vector<ChunkRecord> chunks;
+    unsigned ended = 0;              // Streams that sent FRAME_END
+    uint32_t expectedCRC = 0;        // CRC32 of the whole file announced by the client
+    bool failed = false;             // A stream disconnected early or the streams announced different CRCs
+    bool finished = false;           // Verified and answered
+
+    ~Transfer() {
+        if (file >= 0) {
+            close(file);
+        }
+        if (manifestFile >= 0) {
+            close(manifestFile);
+        }
+    }
+};
+
+// Write-behind state of a client, shared with the DiskWriter
+struct WriteQueue {
+    std::atomic<unsigned> buffers{0};  // Buffers queued and not yet written
+    std::atomic<bool> failed{false};   // A write failed, so the client is dropped
+};
+
+// State kept for each connected client, looked up by socket descriptor
+struct Client {
+    int socket;             // Connected socket
+    int file = -1;          // File receiving everything the client sends, unused in multi-stream mode
+    std::string filename;
+    int pipe[2] = {-1, -1}; // Splice mode: the data passes through this pipe from the socket to the file
+    std::shared_ptr<WriteQueue> queue; // Copy mode: data read but not yet written
+    bool stalled = false;   // Copy mode: parked until a buffer is free, with its socket not drained
+
+    // Multi-stream mode
+    std::shared_ptr<Transfer> transfer;          // Joined once the hello is complete
+    uint8_t header[sizeof(TransferHello)];       // Hello or frame header being received
+    size_t headerFill = 0;                       // Bytes of it received so far
+    bool inChunk = false;                        // Receiving the data of frame
+    FrameHeader frame;                           // Current chunk, in host order
+    uint32_t chunkReceived = 0;
+    bool ended = false;                          // FRAME_END received
+    std::vector<uint8_t> output;                 // Manifest bytes the socket had no room for yet
+    size_t outputSent = 0;                       // Bytes of output already sent
+    bool watchingOutput = false;                 // EPOLLOUT is in the socket's epoll events
+};
+
+// Payload moved to disk by one worker and the read, write and splice calls it took
+struct TransferCounters {
+    uint64_t bytes = 0;
+    uint64_t syscalls = 0;
+    uint64_t stalls = 0;    // Times a client was parked because its queue or the buffer pool was full
+};
+
+// Command line options
+struct ServerOptions {
+    int port = PORT;                // TCP port to listen on
+    int backlog = DEFAULT_BACKLOG;  // Length of the kernel accept queue
+    bool quiet = false;             // Skip per-connection logging, e.g. when benchmarking
+    int workers = 1;                // Event loops to run, 0 for one per CPU
+    bool uring = false;             // Use the io_uring backend instead of epoll
+    bool splice = false;            // Epoll backend: move data with splice() instead of read() and write()
+    bool multiStream = false;       // Epoll backend: clients speak the multi-stream transfer protocol
+    size_t budget = (size_t)DEFAULT_BUDGET_MB << 20; // Epoll backend: bytes of buffer pool for data waiting for the disk
+};
+
+// Allow as many open descriptors as the hard limit permits so tens of
+// thousands of clients can be connected at once
+void raiseFileLimit() {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
 }
 
-int main() {
-    int server_fd, new_socket, client_socket[MAX_CLIENTS], max_sd, activity, valread, sd;
-    struct sockaddr_in address;
-    fd_set readfds;
-    char buffer[BUFFER_SIZE];
-    std::ofstream clientFiles[MAX_CLIENTS];
-    char filename[64];
+bool parseOptions(int argc, char *argv[], ServerOptions &options) {
+    int opt;
+    while ((opt = getopt(argc, argv, "p:b:qw:usmM:")) != -1) {
+        switch (opt) {
+            case 'p':
+                options.port = std::atoi(optarg);
+                break;
+            case 'b':
+                options.backlog = std::atoi(optarg);
+                break;
+            case 'q':
+                options.quiet = true;
+                break;
+            case 'w':
+                options.workers = std::atoi(optarg);
+                break;
+            case 'u':
+                options.uring = true;
+                break;
+            case 's':
+                options.splice = true;
+                break;
+            case 'm':
+                options.multiStream = true;
+                break;
+            case 'M':
+                options.budget = std::strtoull(optarg, nullptr, 10) << 20;
+                if (options.budget < BUFFER_SIZE) {
+                    return false;
+                }
+                break;
+            default:
+                return false;
+        }
+    }
+    return optind == argc && options.uring + options.splice + options.multiStream <= 1;
+}
 
-    // Initialize all client_socket to 0
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        client_socket[i] = 0;
+// Numbers the output files across all workers
+std::string nextFilename() {
+    static std::atomic<unsigned> nextFile{0};
+    return "/tmp/file_" + std::to_string(nextFile++) + ".txt";
+}
+
+// Transfers in progress, by id, shared by all workers
+class TransferRegistry {
+public:
+    // Add a stream to its transfer, creating the transfer and its file for the first stream.
+    // Returns nullptr with the reason in error if the hello does not match the transfer.
+    static std::shared_ptr<Transfer> join(const TransferHello &hello, int sd, std::string &error) {
+        std::shared_ptr<Transfer> transfer;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            // A stream index seen before, or a different stream count, means the client restarted the
+            // upload while the streams of its last attempt are still draining. That attempt can only
+            // fail, so the new streams start a fresh one.
+            auto found = transfers.find(hello.id);
+            if (found != transfers.end() && found->second->streams == hello.streams && !found->second->joined[hello.stream]) {
+                transfer = found->second;
+            } else {
+                transfer = std::make_shared<Transfer>();
+                transfer->id = hello.id;
+                transfer->size = hello.size;
+                transfer->streams = hello.streams;
+                transfer->joined.resize(hello.streams);
+                // Named after the id so a restarted transfer finds the data and manifest of the last attempt
+                char name[32];
+                snprintf(name, sizeof(name), "/tmp/file_%016llx", (unsigned long long)hello.id);
+                transfer->filename = std::string(name) + ".txt";
+                transfer->file = open(transfer->filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+                if (transfer->file < 0) {
+                    error = strerror(errno);
+                    return nullptr;
+                }
+                // Size the file up front so chunks can land anywhere in it
+                if (ftruncate(transfer->file, hello.size) < 0 || !openManifest(*transfer, std::string(name) + ".manifest")) {
+                    error = strerror(errno);
+                    return nullptr;
+                }
+                transfers[hello.id] = transfer;
+            }
+            transfer->joined[hello.stream] = true;
+        }
+
+        std::lock_guard<std::mutex> lock(transfer->mutex);
+        if (transfer->size != hello.size || transfer->finished) {
+            error = "stream does not match the transfer";
+            return nullptr;
+        }
+        transfer->sockets.push_back(sd);
+        return transfer;
+    }
+
+    // Forget a transfer, unless a newer attempt with the same id has taken its place
+    static void remove(const Transfer *transfer) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = transfers.find(transfer->id);
+        if (found != transfers.end() && found->second.get() == transfer) {
+            transfers.erase(found);
+        }
+    }
+
+private:
+    static inline std::mutex mutex;
+    static inline std::unordered_map<uint64_t, std::shared_ptr<Transfer>> transfers;
+
+    // Load the chunks an earlier attempt left, then keep the manifest open for appending.
+    // A manifest for a different file size is started over.
+    static bool openManifest(Transfer &transfer, const std::string &path) {
+        transfer.manifestName = path;
+        transfer.manifestFile = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (transfer.manifestFile < 0) {
+            return false;
+        }
+        ManifestHeader header;
+        if (pread(transfer.manifestFile, &header, sizeof(header), 0) == sizeof(header) &&
+            header.magic == MANIFEST_MAGIC && header.size == transfer.size) {
+            // Later records replace earlier ones; a torn record at the end is ignored
+            ChunkRecord record;
+            for (off_t at = sizeof(header); pread(transfer.manifestFile, &record, sizeof(record), at) == sizeof(record); at += sizeof(record)) {
+                if (record.length == 0) {
+                    transfer.manifest.erase(record.offset);
+                } else if (record.offset <= transfer.size && record.length <= transfer.size - record.offset) {
+                    transfer.manifest[record.offset] = record;
+                }
+            }
+            return true;
+        }
+        header = {MANIFEST_MAGIC, transfer.size};
+        return ftruncate(transfer.manifestFile, 0) == 0 && write(transfer.manifestFile, &header, sizeof(header)) == sizeof(header);
     }
+};
 
-    // Create server socket
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
+// Hashes received chunks on one background thread, so the event loops only
+// write. Each chunk is read back, mostly from the page cache, and its CRC32 and
+// XXH64 are appended to the transfer's manifest. Other work, such as verifying
+// a transfer, can be queued behind the chunks with post(); jobs run in order.
+class ChunkHasher {
+public:
+    // Never destroyed, its thread serves all workers until the process exits
+    static ChunkHasher &instance() {
+        static ChunkHasher *hasher = new ChunkHasher();
+        return *hasher;
+    }
+
+    void hash(std::shared_ptr<Transfer> transfer, uint64_t offset, uint32_t length) {
+        post([this, transfer, offset, length]() { hashChunk(*transfer, offset, length); });
+    }
+
+    // Mark the record of a chunk as no longer valid, ahead of the record of its new data
+    void invalidate(std::shared_ptr<Transfer> transfer, uint64_t offset) {
+        post([transfer, offset]() { appendRecord(*transfer, {offset, 0, 0, 0}); });
+    }
+
+    void post(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        ready.notify_one();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::function<void()>> jobs;
+    std::vector<uint8_t> buffer;
+
+    ChunkHasher() : buffer(HASH_READ_SIZE) {
+        std::thread([this]() { run(); }).detach();
+    }
+
+    void run() {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait(lock, [this]() { return !jobs.empty(); });
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+    void hashChunk(Transfer &transfer, uint64_t offset, uint32_t length) {
+        ChunkRecord record = {offset, length, 0, 0};
+        XXHash64 hash;
+        for (uint32_t done = 0; done < length; ) {
+            ssize_t n = pread(transfer.file, buffer.data(), std::min<size_t>(buffer.size(), length - done), offset + done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                perror("pread");
+                std::lock_guard<std::mutex> lock(transfer.mutex);
+                transfer.failed = true;
+                return;
+            }
+            std::span<const uint8_t> data(buffer.data(), n);
+            record.crc = CRC32::update(record.crc, data);
+            hash.update(data);
+            done += n;
+        }
+        record.hash = hash.digest();
+        appendRecord(transfer, record);
+        std::lock_guard<std::mutex> lock(transfer.mutex);
+        transfer.chunks.push_back(record);
+    }
+
+    static void appendRecord(Transfer &transfer, const ChunkRecord &record) {
+        if (write(transfer.manifestFile, &record, sizeof(record)) != sizeof(record)) {
+            perror("write manifest");
+        }
+    }
+};
+
+// Open the listening socket, sharing the port through SO_REUSEPORT when there
+// are several workers. Returns -1 after printing the reason on failure.
+int openListenSocket(const ServerOptions &options) {
+    int server_fd;
+    if ((server_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0) {
         perror("socket failed");
-        exit(EXIT_FAILURE);
+        return -1;
+    }
+
+    int reuse = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (options.workers != 1 && setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) < 0) {
+        perror("setsockopt SO_REUSEPORT");
+        close(server_fd);
+        return -1;
     }
 
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(PORT);
+    address.sin_port = htons(options.port);
 
     if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
         // Common reasons for failure
@@ -48,79 +394,1128 @@ int main() {
         //    * The port is already in use by another process
         perror("bind failed");
         close(server_fd);
-        exit(EXIT_FAILURE);
+        return -1;
     }
 
-    if (listen(server_fd, 3) < 0) {
+    // The backlog is capped by net.core.somaxconn
+    if (listen(server_fd, options.backlog) < 0) {
         perror("listen failed");
         close(server_fd);
-        exit(EXIT_FAILURE);
+        return -1;
+    }
+    return server_fd;
+}
+
+// Writes received data to the clients' files on a thread of its own, one per
+// worker, so a slow disk never blocks an event loop. Jobs run in order, so
+// each file is written in order and closed only after the data queued before
+// the close. Every written buffer goes back to the pool, and the worker is
+// woken through its eventfd when a client it parked for a full queue drops
+// below the limit, or its writes fail.
+class DiskWriter {
+public:
+    explicit DiskWriter(BufferPool &pool) : pool(pool) {}
+
+    // Runs until the process exits, like the worker it serves
+    void start(int wakeFd) {
+        this->wakeFd = wakeFd;
+        std::thread([this]() { run(); }).detach();
+    }
+
+    // Take ownership of a pool buffer holding length bytes for file
+    void write(const std::shared_ptr<WriteQueue> &queue, int file, uint8_t *buffer, size_t length) {
+        queue->buffers.fetch_add(1, std::memory_order_relaxed);
+        post({queue, file, buffer, length});
+    }
+
+    void close(int file) {
+        post({nullptr, file, nullptr, 0});
     }
 
-    setNonBlocking(server_fd);
+    uint64_t getSyscalls() const {
+        return syscalls.load(std::memory_order_relaxed);
+    }
 
-    std::cout << "Server listening on port " << PORT << std::endl;
+private:
+    struct Job {
+        std::shared_ptr<WriteQueue> queue;
+        int file;
+        uint8_t *buffer;  // nullptr to close file
+        size_t length;
+    };
 
-    while (true) {
-        FD_ZERO(&readfds);
-        FD_SET(server_fd, &readfds);
-        max_sd = server_fd;
+    BufferPool &pool;
+    int wakeFd = -1;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<Job> jobs;
+    std::atomic<uint64_t> syscalls{0};
 
-        // Add child sockets to set
-        for (int i = 0; i < MAX_CLIENTS; i++) {
-            sd = client_socket[i];
+    void post(Job job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        ready.notify_one();
+    }
 
-            if (sd > 0) {
-                FD_SET(sd, &readfds);
+    void run() {
+        std::deque<Job> batch;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait(lock, [this]() { return !jobs.empty(); });
+                std::swap(batch, jobs);
+            }
+            for (Job &job : batch) {
+                if (job.buffer == nullptr) {
+                    ::close(job.file);
+                    continue;
+                }
+                bool failed = job.queue->failed.load(std::memory_order_relaxed);
+                if (!failed && !writeAll(job.file, job.buffer, job.length)) {
+                    perror("write");
+                    job.queue->failed.store(true, std::memory_order_relaxed);
+                    failed = true;
+                }
+                pool.release(job.buffer);
+                if (job.queue->buffers.fetch_sub(1, std::memory_order_release) == MAX_QUEUED_BUFFERS || failed) {
+                    uint64_t one = 1;
+                    if (::write(wakeFd, &one, sizeof(one)) < 0) {
+                        perror("write eventfd");
+                    }
+                }
             }
+            batch.clear();
+        }
+    }
 
-            if (sd > max_sd) {
-                max_sd = sd;
+    bool writeAll(int file, const uint8_t *data, size_t length) {
+        while (length > 0) {
+            ssize_t written = ::write(file, data, length);
+            syscalls.fetch_add(1, std::memory_order_relaxed);
+            if (written < 0 && errno == EINTR) {
+                continue;
             }
+            if (written <= 0) {
+                return false;
+            }
+            data += written;
+            length -= written;
+        }
+        return true;
+    }
+};
+
+// One event loop, run by one worker thread
+class Worker {
+public:
+    virtual ~Worker() = default;
+    virtual bool start() = 0;
+    virtual void run() = 0;
+};
+
+// Single-threaded, edge-triggered epoll server. Each client gets an entry in
+// a table indexed by its descriptor, so finding the client for an event is
+// O(1) and nothing is rescanned per wakeup, unlike select() with a fixed array.
+//
+// With several workers, each one is an independent UploadServer on its own
+// thread with its own listening socket bound to the same port through
+// SO_REUSEPORT. The kernel spreads incoming connections across the sockets,
+// so workers share no accept lock and no state apart from the file counter.
+//
+// In splice mode each client also gets a pipe. splice() moves the socket data
+// into the pipe and from the pipe into the file by passing page references,
+// so the payload is never copied to user space. A client whose file does not
+// support splice falls back to the copy path.
+// In multi-stream mode every connection carries part of a transfer (see
+// transfer.h); chunks are written with pwrite() straight from the receive
+// buffer at the offset in their header.
+//
+// In copy mode data is read into buffers from a pool shared by all workers and
+// written behind by the worker's DiskWriter. The pool is the memory budget:
+// when it is empty, or a client already has MAX_QUEUED_BUFFERS waiting, the
+// client is parked with data left in its socket, so TCP flow control slows the
+// sender down. Parked clients are resumed when the pool or the DiskWriter
+// signals the worker's eventfd.
+//
+// Every STATS_INTERVAL seconds with traffic, the worker reports the bytes it
+// moved and the system calls it needed per MB, and in copy mode the pool
+// occupancy and how often clients were parked.
+class UploadServer : public Worker {
+public:
+    UploadServer(const ServerOptions &options, int worker, BufferPool &pool)
+        : options(options), worker(worker), pool(pool), writer(pool) {}
+
+    ~UploadServer() {
+        if (epoll_fd >= 0) {
+            close(epoll_fd);
+        }
+        if (server_fd >= 0) {
+            close(server_fd);
+        }
+    }
+
+    bool start() override {
+        if ((server_fd = openListenSocket(options)) < 0) {
+            return false;
         }
 
-        activity = select(max_sd + 1, &readfds, NULL, NULL, NULL);
+        if ((epoll_fd = epoll_create1(0)) < 0) {
+            perror("epoll_create1");
+            return false;
+        }
 
-        if ((activity < 0) && (errno != EINTR)) {
-            std::cerr << "select error" << std::endl;
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLET;
+        event.data.fd = server_fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_fd, &event) < 0) {
+            perror("epoll_ctl");
+            return false;
         }
 
-        if (FD_ISSET(server_fd, &readfds)) {
-            if ((new_socket = accept(server_fd, NULL, NULL)) < 0) {
-                perror("accept");
-                exit(EXIT_FAILURE);
+        if (!options.multiStream) {
+            if ((wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+                perror("eventfd");
+                return false;
+            }
+            event.events = EPOLLIN;
+            event.data.fd = wake_fd;
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event) < 0) {
+                perror("epoll_ctl");
+                return false;
             }
+            pool.subscribe(wake_fd);
+            writer.start(wake_fd);
+        }
+
+        std::cout << "Worker " << worker << " listening on port " << options.port << " (backlog " << options.backlog << ")" << std::endl;
+        return true;
+    }
 
-            setNonBlocking(new_socket);
+    void run() override {
+        struct epoll_event events[MAX_EVENTS];
+        auto lastReport = std::chrono::steady_clock::now();
+        uint64_t reportedBytes = 0;
 
-            for (int i = 0; i < MAX_CLIENTS; i++) {
-                if (client_socket[i] == 0) {
-                    client_socket[i] = new_socket;
-                    snprintf(filename, sizeof(filename), "/tmp/file_%d.txt", i);
-                    clientFiles[i].open(filename);
-                    send(new_socket, "ready\n", 6, 0);
-                    std::cout << "New connection, file created: " << filename << std::endl;
-                    break;
+        while (true) {
+            int count = epoll_wait(epoll_fd, events, MAX_EVENTS, STATS_INTERVAL * 1000);
+            if (count < 0) {
+                if (errno != EINTR) {
+                    perror("epoll_wait");
                 }
+                continue;
+            }
+
+            for (int i = 0; i < count; i++) {
+                if (events[i].data.fd == server_fd) {
+                    acceptClients();
+                } else if (events[i].data.fd == wake_fd) {
+                    resumeStalled();
+                } else {
+                    int sd = events[i].data.fd;
+                    if ((events[i].events & EPOLLOUT) && !resumeOutput(sd)) {
+                        continue;
+                    }
+                    if (events[i].events & ~EPOLLOUT) {
+                        receive(sd);
+                    }
+                }
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            if (now - lastReport >= std::chrono::seconds(STATS_INTERVAL) &&
+                (counters.bytes != reportedBytes || pool.getInUse() > 0)) {
+                report();
+                lastReport = now;
+                reportedBytes = counters.bytes;
             }
         }
+    }
 
-        for (int i = 0; i < MAX_CLIENTS; i++) {
-            sd = client_socket[i];
+private:
+    ServerOptions options;
+    int worker;                                   // Index of this event loop
+    int server_fd = -1;
+    int epoll_fd = -1;
+    std::vector<std::unique_ptr<Client>> clients; // Indexed by socket descriptor
+    char buffer[BUFFER_SIZE];                     // Multi-stream mode and the splice fallback
+    bool acceptBlocked = false;                   // Accept queue not drained because descriptors ran out
+    TransferCounters counters;
+    BufferPool &pool;                             // Shared by all workers
+    DiskWriter writer;
+    int wake_fd = -1;                             // Signalled when parked clients may continue
+    std::vector<int> stalled;                     // Sockets of parked clients
 
-            if (FD_ISSET(sd, &readfds)) {
-                if ((valread = read(sd, buffer, BUFFER_SIZE)) == 0) {
-                    close(sd);
-                    client_socket[i] = 0;
-                    clientFiles[i].close();
-                    std::cout << "Client disconnected, file closed: " << i << std::endl;
-                } else {
-                    buffer[valread] = '\0';
-                    clientFiles[i] << buffer;
+    void report() {
+        double megabytes = counters.bytes / 1048576.0;
+        uint64_t syscalls = counters.syscalls + writer.getSyscalls();
+        std::cout << "Worker " << worker << ": " << std::fixed << std::setprecision(1) << megabytes << " MB received, "
+                  << (megabytes > 0 ? syscalls / megabytes : 0.0) << " syscalls/MB"
+                  << (options.splice ? " (splice)" : "");
+        if (!options.multiStream) {
+            std::cout << ", pool " << pool.getInUse() << "/" << pool.getCount() << " buffers (peak " << pool.getPeak()
+                      << "), " << counters.stalls << " stalls";
+        }
+        std::cout << std::endl;
+    }
+
+    // Edge-triggered: keep accepting until the queue is empty or we would miss connections
+    void acceptClients() {
+        while (true) {
+            int new_socket = accept4(server_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (new_socket < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                if (errno == EMFILE || errno == ENFILE) {
+                    // Edge-triggered, so no new event will come for the connections still
+                    // queued; retry when a client disconnects and frees a descriptor
+                    acceptBlocked = true;
+                } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    perror("accept4");
+                }
+                return;
+            }
+
+            auto client = std::make_unique<Client>();
+            client->socket = new_socket;
+            if (!options.multiStream) {
+                client->filename = nextFilename();
+                client->file = open(client->filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                if (client->file < 0) {
+                    perror("open");
+                    close(new_socket);
+                    continue;
+                }
+            }
+            // Without a pipe, e.g. when descriptors run out, the client just uses the copy path
+            if (options.splice && pipe2(client->pipe, O_CLOEXEC) == 0) {
+                fcntl(client->pipe[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+            }
+            if (!options.multiStream) {
+                client->queue = std::make_shared<WriteQueue>();
+            }
+
+            struct epoll_event event;
+            event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+            event.data.fd = new_socket;
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, new_socket, &event) < 0) {
+                perror("epoll_ctl");
+                closeFiles(client.get());
+                close(new_socket);
+                continue;
+            }
+
+            if ((size_t)new_socket >= clients.size()) {
+                clients.resize(new_socket + 1);
+            }
+            send(new_socket, "ready\n", 6, MSG_NOSIGNAL);
+            if (!options.quiet && !options.multiStream) {
+                std::cout << "New connection, file created: " << client->filename << std::endl;
+            }
+            clients[new_socket] = std::move(client);
+        }
+    }
+
+    // Edge-triggered: read until the socket is drained, or the next event never comes
+    void receive(int sd) {
+        Client *client = ((size_t)sd < clients.size()) ? clients[sd].get() : nullptr;
+        if (client == nullptr) {
+            return;
+        }
+
+        if (client->pipe[0] >= 0 && spliceClient(sd, client)) {
+            return;
+        }
+        if (!options.multiStream) {
+            receiveQueued(sd, client);
+            return;
+        }
+
+        while (true) {
+            ssize_t valread = read(sd, buffer, BUFFER_SIZE);
+            ++counters.syscalls;
+            if (valread > 0) {
+                if (!consume(client, (const uint8_t *)buffer, valread)) {
+                    disconnect(sd);
+                    return;
+                }
+                continue;
+            }
+            if (valread < 0 && errno == EINTR) {
+                continue;
+            }
+            if (valread < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return;
+            }
+            disconnect(sd);
+            return;
+        }
+    }
+
+    // Copy mode: read into pool buffers and hand them to the DiskWriter until the socket is
+    // drained, or park the client when no buffer may be taken
+    void receiveQueued(int sd, Client *client) {
+        while (true) {
+            if (client->queue->failed.load(std::memory_order_relaxed)) {
+                disconnect(sd);
+                return;
+            }
+            uint8_t *data = nullptr;
+            if (client->queue->buffers.load(std::memory_order_acquire) >= MAX_QUEUED_BUFFERS ||
+                (data = pool.acquire()) == nullptr) {
+                if (!client->stalled) {
+                    client->stalled = true;
+                    stalled.push_back(sd);
+                    ++counters.stalls;
+                }
+                return;
+            }
+
+            ssize_t valread = read(sd, data, pool.getBufferSize());
+            ++counters.syscalls;
+            if (valread > 0) {
+                counters.bytes += valread;
+                writer.write(client->queue, client->file, data, valread);
+                continue;
+            }
+            pool.release(data);
+            if (valread < 0 && errno == EINTR) {
+                continue;
+            }
+            if (valread < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return;
+            }
+            disconnect(sd);
+            return;
+        }
+    }
+
+    // Multi-stream mode: the socket has room for more of a queued manifest. Returns false if
+    // the client was disconnected.
+    bool resumeOutput(int sd) {
+        Client *client = ((size_t)sd < clients.size()) ? clients[sd].get() : nullptr;
+        if (client == nullptr || sendOutput(client)) {
+            return true;
+        }
+        disconnect(sd);
+        return false;
+    }
+
+    // Retry every parked client; those that still find no buffer park again
+    void resumeStalled() {
+        uint64_t signals;
+        if (read(wake_fd, &signals, sizeof(signals)) < 0 && errno != EAGAIN) {
+            perror("read eventfd");
+        }
+        std::vector<int> waiting;
+        std::swap(waiting, stalled);
+        for (int sd : waiting) {
+            Client *client = clients[sd].get();
+            // The client may have gone, and its descriptor been reused, since it was parked
+            if (client != nullptr && client->stalled) {
+                client->stalled = false;
+                receive(sd);
+            }
+        }
+    }
+
+    // Edge-triggered splice loop. Returns false if the client had to switch to the buffered path.
+    bool spliceClient(int sd, Client *client) {
+        while (true) {
+            ssize_t received = splice(sd, NULL, client->pipe[1], NULL, SPLICE_PIPE_SIZE, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            ++counters.syscalls;
+            if (received > 0) {
+                if (!drainPipe(client, received)) {
+                    disconnect(sd);
+                    return true;
+                }
+                if (client->pipe[0] < 0) {
+                    return false;
                 }
+                continue;
+            }
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            // The pipe is always drained, so this means the socket is
+            if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return true;
             }
+            if (received < 0 && (errno == EINVAL || errno == ENOSYS)) {
+                stopSplicing(client);
+                return false;
+            }
+            disconnect(sd);
+            return true;
         }
     }
 
+    // Move everything in the pipe to the file. If the file cannot be spliced to, copy it through
+    // the buffer instead and stop splicing. Returns false on a write error.
+    bool drainPipe(Client *client, size_t length) {
+        while (length > 0) {
+            ssize_t written = splice(client->pipe[0], NULL, client->file, NULL, length, SPLICE_F_MOVE);
+            ++counters.syscalls;
+            if (written > 0) {
+                length -= written;
+                counters.bytes += written;
+                continue;
+            }
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written < 0 && (errno == EINVAL || errno == ENOSYS)) {
+                while (length > 0) {
+                    ssize_t valread = read(client->pipe[0], buffer, std::min(length, (size_t)BUFFER_SIZE));
+                    ++counters.syscalls;
+                    if (valread <= 0 || !writeFile(client, buffer, valread)) {
+                        return false;
+                    }
+                    length -= valread;
+                }
+                stopSplicing(client);
+                return true;
+            }
+            perror("splice");
+            return false;
+        }
+        return true;
+    }
+
+    void stopSplicing(Client *client) {
+        close(client->pipe[0]);
+        close(client->pipe[1]);
+        client->pipe[0] = client->pipe[1] = -1;
+        if (!options.quiet) {
+            std::cout << "Splice unsupported, using buffered copies for " << client->filename << std::endl;
+        }
+    }
+
+    // Write all of data, resuming after short writes. Returns false on error.
+    bool writeFile(Client *client, const char *data, size_t length) {
+        while (length > 0) {
+            ssize_t written = write(client->file, data, length);
+            ++counters.syscalls;
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                perror("write");
+                return false;
+            }
+            data += written;
+            length -= written;
+            counters.bytes += written;
+        }
+        return true;
+    }
+
+    // Parse multi-stream protocol bytes, writing chunk data as it arrives and leaving the hashing
+    // to the ChunkHasher. Returns false if the stream has to be dropped.
+    bool consume(Client *client, const uint8_t *data, size_t length) {
+        while (length > 0) {
+            if (client->ended) {
+                return false;
+            }
+
+            if (client->inChunk) {
+                size_t take = std::min<size_t>(length, client->frame.length - client->chunkReceived);
+                if (!pwriteAll(client->transfer->file, data, take, client->frame.offset + client->chunkReceived)) {
+                    perror("pwrite");
+                    return false;
+                }
+                ++counters.syscalls;
+                counters.bytes += take;
+                client->chunkReceived += take;
+                data += take;
+                length -= take;
+                if (client->chunkReceived == client->frame.length) {
+                    ChunkHasher::instance().hash(client->transfer, client->frame.offset, client->frame.length);
+                    client->inChunk = false;
+                }
+                continue;
+            }
+
+            size_t headerSize = client->transfer ? sizeof(FrameHeader) : sizeof(TransferHello);
+            size_t take = std::min(length, headerSize - client->headerFill);
+            memcpy(client->header + client->headerFill, data, take);
+            client->headerFill += take;
+            data += take;
+            length -= take;
+            if (client->headerFill < headerSize) {
+                return true;
+            }
+            client->headerFill = 0;
+
+            if (!client->transfer) {
+                if (!joinTransfer(client)) {
+                    return false;
+                }
+                continue;
+            }
+
+            FrameHeader frame;
+            memcpy(&frame, client->header, sizeof(frame));
+            frame = swapFrame(frame);
+            Transfer &transfer = *client->transfer;
+            if (frame.type == FRAME_END) {
+                client->ended = true;
+                endStream(client, (uint32_t)frame.offset);
+            } else if (frame.type == FRAME_SKIP) {
+                std::lock_guard<std::mutex> lock(transfer.mutex);
+                auto kept = transfer.manifest.find(frame.offset);
+                if (kept == transfer.manifest.end() || kept->second.length != frame.length) {
+                    reply(client->socket, "error skipped chunk is not in the manifest\n");
+                    return false;
+                }
+                transfer.chunks.push_back(kept->second);
+            } else if (frame.type == FRAME_CHUNK && frame.length > 0 && frame.length <= MAX_CHUNK_SIZE &&
+                       frame.offset <= transfer.size && frame.length <= transfer.size - frame.offset) {
+                // A chunk an earlier attempt recorded is about to be overwritten, so a later attempt must
+                // not trust that record. The hasher appends the invalidation in order, before the new record.
+                {
+                    std::lock_guard<std::mutex> lock(transfer.mutex);
+                    if (transfer.manifest.erase(frame.offset)) {
+                        ChunkHasher::instance().invalidate(client->transfer, frame.offset);
+                    }
+                }
+                client->frame = frame;
+                client->inChunk = true;
+                client->chunkReceived = 0;
+            } else {
+                reply(client->socket, "error bad frame\n");
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool joinTransfer(Client *client) {
+        TransferHello hello;
+        memcpy(&hello, client->header, sizeof(hello));
+        hello = swapHello(hello);
+        std::string error = "bad hello";
+        if (hello.magic == TRANSFER_MAGIC && hello.streams > 0 && hello.streams <= MAX_STREAMS && hello.stream < hello.streams) {
+            client->transfer = TransferRegistry::join(hello, client->socket, error);
+        }
+        if (!client->transfer) {
+            reply(client->socket, "error " + error + "\n");
+            return false;
+        }
+        if (!sendManifest(client)) {
+            return false;
+        }
+        if (!options.quiet) {
+            std::cout << "Stream " << hello.stream << "/" << hello.streams << " of transfer " << std::hex << hello.id
+                      << std::dec << " joined, file: " << client->transfer->filename << std::endl;
+        }
+        return true;
+    }
+
+    // Tell the client which chunks are kept from earlier attempts. A manifest too large for the
+    // socket buffer is queued and finished on EPOLLOUT; the client reads all of it before it sends
+    // any frame, so nothing else is sent meanwhile.
+    bool sendManifest(Client *client) {
+        std::vector<uint8_t> &message = client->output;
+        message.resize(sizeof(uint32_t));
+        {
+            std::lock_guard<std::mutex> lock(client->transfer->mutex);
+            uint32_t count = htobe32(client->transfer->manifest.size());
+            memcpy(message.data(), &count, sizeof(count));
+            for (const auto &[offset, record] : client->transfer->manifest) {
+                ManifestEntry entry = swapEntry({record.offset, record.length, 0, record.hash});
+                const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&entry);
+                message.insert(message.end(), bytes, bytes + sizeof(entry));
+            }
+        }
+        client->outputSent = 0;
+        return sendOutput(client);
+    }
+
+    // Send as much queued output as the socket takes, and watch for room for the rest.
+    // Returns false if the socket failed.
+    bool sendOutput(Client *client) {
+        while (client->outputSent < client->output.size()) {
+            ssize_t sent = send(client->socket, client->output.data() + client->outputSent,
+                                client->output.size() - client->outputSent, MSG_NOSIGNAL | MSG_DONTWAIT);
+            ++counters.syscalls;
+            if (sent > 0) {
+                client->outputSent += sent;
+                continue;
+            }
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+            if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return watchOutput(client, true);
+            }
+            return false;
+        }
+        std::vector<uint8_t>().swap(client->output);
+        client->outputSent = 0;
+        return watchOutput(client, false);
+    }
+
+    bool watchOutput(Client *client, bool watch) {
+        if (client->watchingOutput == watch) {
+            return true;
+        }
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLRDHUP | EPOLLET | (watch ? (uint32_t)EPOLLOUT : 0u);
+        event.data.fd = client->socket;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client->socket, &event) < 0) {
+            perror("epoll_ctl");
+            return false;
+        }
+        client->watchingOutput = watch;
+        return true;
+    }
+
+    // Once every stream has ended, verify the file and answer all of them. That is left to the
+    // ChunkHasher, after the chunks it still has queued.
+    void endStream(Client *client, uint32_t crc) {
+        std::shared_ptr<Transfer> transfer = client->transfer;
+        {
+            std::lock_guard<std::mutex> lock(transfer->mutex);
+            if (transfer->ended == 0) {
+                transfer->expectedCRC = crc;
+            } else if (crc != transfer->expectedCRC) {
+                transfer->failed = true;
+            }
+            if (++transfer->ended < transfer->streams) {
+                return;
+            }
+        }
+
+        bool quiet = options.quiet;
+        ChunkHasher::instance().post([transfer, quiet]() {
+            std::lock_guard<std::mutex> lock(transfer->mutex);
+            std::string answer = verify(*transfer);
+            // A complete file needs no resuming; its records would only turn the next upload into a no-op
+            if (answer.starts_with("ok") && unlink(transfer->manifestName.c_str()) < 0) {
+                perror("unlink manifest");
+            }
+            // Sent under the lock so no stream can disconnect, and its descriptor be reused, meanwhile
+            for (int sd : transfer->sockets) {
+                reply(sd, answer);
+            }
+            transfer->finished = true;
+            TransferRegistry::remove(transfer.get());
+            if (!quiet) {
+                std::cout << "Transfer " << std::hex << transfer->id << std::dec << " to " << transfer->filename << ": " << answer << std::flush;
+            }
+        });
+    }
+
+    // Check that the chunks tile the file exactly and that their combined CRC32 matches
+    static std::string verify(Transfer &transfer) {
+        if (transfer.failed) {
+            return "error streams disagree or a chunk was lost\n";
+        }
+        std::sort(transfer.chunks.begin(), transfer.chunks.end(),
+                  [](const ChunkRecord &a, const ChunkRecord &b) { return a.offset < b.offset; });
+        uint64_t covered = 0;
+        uint32_t crc = 0;
+        for (const ChunkRecord &chunk : transfer.chunks) {
+            if (chunk.offset != covered) {
+                return "error chunks overlap or leave a gap\n";
+            }
+            crc = CRC32::combine(crc, chunk.crc, chunk.length);
+            covered += chunk.length;
+        }
+        if (covered != transfer.size) {
+            return "error missing data\n";
+        }
+        if (crc != transfer.expectedCRC) {
+            return "error checksum mismatch\n";
+        }
+        char answer[32];
+        snprintf(answer, sizeof(answer), "ok %08x\n", crc);
+        return answer;
+    }
+
+    static void reply(int sd, const std::string &answer) {
+        send(sd, answer.data(), answer.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    }
+
+    // Detach a stream from its transfer before its descriptor is closed. An unfinished transfer
+    // has failed, so it is forgotten at once and a restarted upload starts a fresh attempt even
+    // while other streams of this one are still draining.
+    void leaveTransfer(Client *client) {
+        Transfer &transfer = *client->transfer;
+        std::lock_guard<std::mutex> lock(transfer.mutex);
+        std::erase(transfer.sockets, client->socket);
+        if (!transfer.finished) {
+            transfer.failed = true;
+            TransferRegistry::remove(&transfer);
+        }
+    }
+
+    void closeFiles(Client *client) {
+        if (client->transfer) {
+            leaveTransfer(client);
+            client->transfer.reset();
+        }
+        // Queued data still has to reach the file, so the DiskWriter closes it after that
+        if (client->file >= 0 && client->queue) {
+            writer.close(client->file);
+        } else if (client->file >= 0) {
+            close(client->file);
+        }
+        if (client->pipe[0] >= 0) {
+            close(client->pipe[0]);
+            close(client->pipe[1]);
+        }
+    }
+
+    void disconnect(int sd) {
+        // Closing the socket also removes it from the epoll set
+        closeFiles(clients[sd].get());
+        close(sd);
+        if (!options.quiet && !options.multiStream) {
+            std::cout << "Client disconnected, file closed: " << clients[sd]->filename << std::endl;
+        }
+        clients[sd].reset();
+
+        if (acceptBlocked) {
+            acceptBlocked = false;
+            acceptClients();
+        }
+    }
+};
+
+// State kept for each client of the io_uring backend, looked up by socket descriptor
+struct UringClient {
+    int socket;                 // Connected socket
+    int file;                   // Descriptor of the file receiving everything the client sends
+    std::string filename;
+    uint64_t offset = 0;        // File offset of the next received byte
+    unsigned pendingWrites = 0; // Writes submitted but not completed
+    bool receiving = true;      // False once the client closed the connection or it failed
+    bool failed = false;        // A write to the file failed, so the rest of the data is discarded
+};
+
+// A received buffer on its way to disk, looked up by buffer id
+struct PendingWrite {
+    int socket;      // Client the data came from
+    uint32_t length; // Bytes received into the buffer
+    uint32_t done;   // Bytes written so far, less than length after a short write
+    uint64_t offset; // File offset of the first byte in the buffer
+};
+
+// io_uring server. The listening socket has a multishot accept and every
+// client a multishot receive, so each of them is submitted once and then
+// keeps posting completions. Receives take a 64 KiB buffer from a group of
+// provided buffers only when data arrives, and each filled buffer is written to
+// the client's file at an explicit offset, then handed back to the ring.
+// Submissions and completions are batched, so one io_uring_enter call
+// replaces a read and a write system call per chunk.
+//
+// Workers share the port through SO_REUSEPORT exactly like UploadServer.
+class UringUploadServer : public Worker {
+public:
+    UringUploadServer(const ServerOptions &options, int worker)
+        : options(options), worker(worker), writes(URING_BUFFER_COUNT) {}
+
+    ~UringUploadServer() {
+        if (server_fd >= 0) {
+            close(server_fd);
+        }
+    }
+
+    bool start() override {
+        if ((server_fd = openListenSocket(options)) < 0) {
+            return false;
+        }
+        if (!ring.setup(URING_ENTRIES) ||
+            !buffers.setup(ring, 0, URING_BUFFER_COUNT, URING_BUFFER_SIZE, userData(PROVIDE_BUFFERS, 0))) {
+            return false;
+        }
+        armAccept();
+
+        std::cout << "Worker " << worker << " listening on port " << options.port << " (backlog " << options.backlog
+                  << ", io_uring)" << std::endl;
+        return true;
+    }
+
+    void run() override {
+        if (!ring.enable()) {
+            return;
+        }
+        while (true) {
+            int ret = ring.submitAndWait(1);
+            if (ret < 0 && ret != -EINTR) {
+                std::cerr << "io_uring_enter: " << strerror(-ret) << std::endl;
+            }
+
+            recycled = false;
+            ring.forEachCompletion([this](const struct io_uring_cqe &cqe) { complete(cqe); });
+
+            // Receives that ran out of buffers resume once writes have returned some
+            if (recycled && !starved.empty()) {
+                for (int sd : starved) {
+                    armReceive(sd);
+                }
+                starved.clear();
+            }
+        }
+    }
+
+private:
+    // Request type, kept in the upper half of the user data
+    enum Operation : uint64_t {
+        ACCEPT,
+        RECEIVE, // Lower half is the socket descriptor
+        WRITE,   // Lower half is the buffer id
+        PROVIDE_BUFFERS
+    };
+
+    ServerOptions options;
+    int worker;                                        // Index of this event loop
+    int server_fd = -1;
+    IoUring ring;
+    BufferGroup buffers;
+    std::vector<std::unique_ptr<UringClient>> clients; // Indexed by socket descriptor
+    std::vector<PendingWrite> writes;                  // Indexed by buffer id
+    std::vector<int> starved;                          // Sockets whose receive stopped for lack of buffers
+    bool recycled = false;                             // A buffer went back to the ring in this batch
+    bool acceptBlocked = false;                        // Accept stopped because descriptors ran out
+
+    static uint64_t userData(Operation operation, uint32_t index) {
+        return (uint64_t)operation << 32 | index;
+    }
+
+    void armAccept() {
+        struct io_uring_sqe *sqe = ring.getSqe();
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = server_fd;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_CLOEXEC;
+        sqe->user_data = userData(ACCEPT, 0);
+    }
+
+    void armReceive(int sd) {
+        struct io_uring_sqe *sqe = ring.getSqe();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = sd;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = buffers.getGroup();
+        sqe->user_data = userData(RECEIVE, sd);
+    }
+
+    void submitWrite(unsigned id) {
+        PendingWrite &write = writes[id];
+        struct io_uring_sqe *sqe = ring.getSqe();
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = clients[write.socket]->file;
+        sqe->addr = (uint64_t)(buffers.get(id) + write.done);
+        sqe->len = write.length - write.done;
+        sqe->off = write.offset + write.done;
+        sqe->user_data = userData(WRITE, id);
+    }
+
+    void complete(const struct io_uring_cqe &cqe) {
+        uint32_t index = (uint32_t)cqe.user_data;
+        bool more = cqe.flags & IORING_CQE_F_MORE;
+        switch (cqe.user_data >> 32) {
+            case ACCEPT:
+                accepted(cqe.res, more);
+                break;
+            case RECEIVE:
+                received(index, cqe.res, cqe.flags, more);
+                break;
+            case WRITE:
+                written(index, cqe.res);
+                break;
+            case PROVIDE_BUFFERS:
+                // Only failures post a completion
+                std::cerr << "provide buffers: " << strerror(-cqe.res) << std::endl;
+                break;
+        }
+    }
+
+    void accepted(int res, bool more) {
+        if (res >= 0) {
+            addClient(res);
+        } else if (res == -EMFILE || res == -ENFILE) {
+            // The multishot accept ends here; rearm it when a client disconnects and frees a descriptor
+            acceptBlocked = true;
+        } else if (res != -ECONNABORTED && res != -EINTR) {
+            std::cerr << "accept: " << strerror(-res) << std::endl;
+        }
+        if (!more && !acceptBlocked) {
+            armAccept();
+        }
+    }
+
+    void addClient(int sd) {
+        auto client = std::make_unique<UringClient>();
+        client->socket = sd;
+        client->filename = nextFilename();
+        client->file = open(client->filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (client->file < 0) {
+            perror("open");
+            close(sd);
+            return;
+        }
+
+        if ((size_t)sd >= clients.size()) {
+            clients.resize(sd + 1);
+        }
+        send(sd, "ready\n", 6, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (!options.quiet) {
+            std::cout << "New connection, file created: " << client->filename << std::endl;
+        }
+        clients[sd] = std::move(client);
+        armReceive(sd);
+    }
+
+    void received(int sd, int res, uint32_t flags, bool more) {
+        UringClient *client = clients[sd].get();
+        if (res > 0 && client->failed) {
+            // Received before the shutdown took effect; there is no file to put it in
+            buffers.recycle(flags >> IORING_CQE_BUFFER_SHIFT);
+            recycled = true;
+        } else if (res > 0) {
+            unsigned id = flags >> IORING_CQE_BUFFER_SHIFT;
+            writes[id] = PendingWrite{sd, (uint32_t)res, 0, client->offset};
+            client->offset += res;
+            ++client->pendingWrites;
+            submitWrite(id);
+        }
+        if (more) {
+            return;
+        }
+
+        if (res > 0) {
+            // The kernel may end a multishot receive at any time, e.g. when the completion queue fills
+            armReceive(sd);
+        } else if (res == -ENOBUFS) {
+            starved.push_back(sd);
+        } else {
+            // 0 is an orderly shutdown by the client
+            if (res < 0 && !options.quiet) {
+                std::cerr << "recv " << client->filename << ": " << strerror(-res) << std::endl;
+            }
+            client->receiving = false;
+            finishIfIdle(sd);
+        }
+    }
+
+    void written(unsigned id, int res) {
+        PendingWrite &write = writes[id];
+        UringClient *client = clients[write.socket].get();
+        if (res == -EINTR || res == -EAGAIN) {
+            submitWrite(id);
+            return;
+        }
+        if (res > 0) {
+            write.done += res;
+            if (write.done < write.length) {
+                submitWrite(id);
+                return;
+            }
+        } else if (!client->failed) {
+            // The file now has a hole, so the upload has failed: the client is cut off, which also
+            // ends its multishot receive, and whatever it still sends is dropped
+            std::cerr << "write " << client->filename << ": " << (res < 0 ? strerror(-res) : "no progress")
+                      << ", dropping the client" << std::endl;
+            client->failed = true;
+            shutdown(write.socket, SHUT_RDWR);
+        }
+
+        buffers.recycle(id);
+        recycled = true;
+        --client->pendingWrites;
+        finishIfIdle(write.socket);
+    }
+
+    // The socket is only closed once no request refers to it, so its descriptor cannot be reused too early
+    void finishIfIdle(int sd) {
+        UringClient *client = clients[sd].get();
+        if (client->receiving || client->pendingWrites > 0) {
+            return;
+        }
+        close(client->file);
+        close(sd);
+        if (client->failed) {
+            std::cerr << "Client dropped, file incomplete: " << client->filename << std::endl;
+        } else if (!options.quiet) {
+            std::cout << "Client disconnected, file closed: " << client->filename << std::endl;
+        }
+        clients[sd].reset();
+
+        if (acceptBlocked) {
+            acceptBlocked = false;
+            armAccept();
+        }
+    }
+};
+
+int main(int argc, char *argv[]) {
+    ServerOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0] << " [-p port] [-b backlog] [-w workers] [-u | -s | -m] [-M budget MB] [-q]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    raiseFileLimit();
+
+    // CPUs this process may run on; with -w 0 there is one worker per CPU
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    std::vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed)) {
+            cpus.push_back(cpu);
+        }
+    }
+    if (options.workers <= 0) {
+        options.workers = cpus.size();
+    }
+
+    // The epoll workers' copy path shares one pool, so the budget holds for the whole server
+    BufferPool pool;
+    if (!options.uring && !options.multiStream && !pool.setup(options.budget / BUFFER_SIZE, BUFFER_SIZE)) {
+        return EXIT_FAILURE;
+    }
+
+    // Open every listening socket up front so a bind failure stops the server before it starts serving
+    std::vector<std::unique_ptr<Worker>> servers;
+    for (int i = 0; i < options.workers; i++) {
+        if (options.uring) {
+            servers.push_back(std::make_unique<UringUploadServer>(options, i));
+        } else {
+            servers.push_back(std::make_unique<UploadServer>(options, i, pool));
+        }
+        if (!servers.back()->start()) {
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // A single worker keeps the original single-threaded behaviour with no affinity
+    if (options.workers == 1) {
+        servers[0]->run();
+        return 0;
+    }
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < options.workers; i++) {
+        threads.emplace_back([&servers, i]() { servers[i]->run(); });
+
+        // Pin each worker to its own CPU so its connections stay cache-local
+        cpu_set_t cpu;
+        CPU_ZERO(&cpu);
+        CPU_SET(cpus[i % cpus.size()], &cpu);
+        pthread_setaffinity_np(threads.back().native_handle(), sizeof(cpu), &cpu);
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
     return 0;
 }
@@ -0,0 +1,145 @@
+#ifndef TRANSFER_H
+#define TRANSFER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cerrno>
+#include <endian.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+// Multi-stream transfer protocol spoken by `client -n` and `server -m`.
+//
+// The client opens several connections for one file. After the usual
+// "ready\n" from the server, each connection sends a TransferHello naming the
+// transfer. The server answers with its manifest: a count followed by one
+// ManifestEntry per chunk of this transfer it already holds from an earlier,
+// interrupted attempt. The client then sends a frame for every chunk: either
+// FRAME_SKIP if the server holds the chunk with the same XXH64 hash, or
+// FRAME_CHUNK followed by the data. Each stream finishes with one FRAME_END
+// carrying the CRC32 of the whole file. Chunks may arrive on any stream in any
+// order; the server writes each one at its offset. Once every stream has
+// ended, the server checks that the chunks cover the file exactly once and
+// that their combined CRC32 matches, and answers each stream with
+// "ok <crc>\n" or "error <reason>\n".
+//
+// The transfer id is derived from the file's path, size and modification
+// time, so a restarted upload of an unchanged file finds its manifest.
+//
+// All fields are in network byte order on the wire.
+
+#define TRANSFER_MAGIC 0x58465232      // "XFR2"
+#define DEFAULT_CHUNK_SIZE (4 << 20)
+#define MAX_CHUNK_SIZE (1u << 30)
+#define MAX_STREAMS 256
+
+// First thing a stream sends after "ready\n"
+struct TransferHello {
+    uint32_t magic;   // TRANSFER_MAGIC
+    uint16_t stream;  // Index of this stream, below streams
+    uint16_t streams; // Number of streams carrying the transfer
+    uint64_t id;      // Identifies the file, the same on every stream
+    uint64_t size;    // File size in bytes
+};
+
+enum FrameType : uint32_t {
+    FRAME_CHUNK = 1, // length bytes of file data at offset follow
+    FRAME_END = 2,   // No data follows; offset holds the CRC32 of the whole file
+    FRAME_SKIP = 3   // No data follows; the chunk at offset from the manifest is kept
+};
+
+struct FrameHeader {
+    uint32_t type;   // FrameType
+    uint32_t length; // Data bytes following the header
+    uint64_t offset; // File offset of the data
+};
+
+// A chunk the server already holds, as listed in its manifest
+struct ManifestEntry {
+    uint64_t offset;
+    uint32_t length;
+    uint32_t reserved;
+    uint64_t hash;   // XXH64 of the chunk data
+};
+
+static_assert(sizeof(TransferHello) == 24 && sizeof(FrameHeader) == 16 && sizeof(ManifestEntry) == 24,
+              "Wire structs must not be padded");
+
+// Convert between host and wire byte order; each function is its own inverse
+inline TransferHello swapHello(TransferHello hello) {
+    hello.magic = htobe32(hello.magic);
+    hello.stream = htobe16(hello.stream);
+    hello.streams = htobe16(hello.streams);
+    hello.id = htobe64(hello.id);
+    hello.size = htobe64(hello.size);
+    return hello;
+}
+
+inline FrameHeader swapFrame(FrameHeader frame) {
+    frame.type = htobe32(frame.type);
+    frame.length = htobe32(frame.length);
+    frame.offset = htobe64(frame.offset);
+    return frame;
+}
+
+inline ManifestEntry swapEntry(ManifestEntry entry) {
+    entry.offset = htobe64(entry.offset);
+    entry.length = htobe32(entry.length);
+    entry.hash = htobe64(entry.hash);
+    return entry;
+}
+
+// Read exactly length bytes from a blocking socket
+inline bool receiveAll(int sock, void *data, size_t length) {
+    char *bytes = static_cast<char *>(data);
+    while (length > 0) {
+        ssize_t n = recv(sock, bytes, length, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        bytes += n;
+        length -= n;
+    }
+    return true;
+}
+
+// Send all of data on a blocking socket, resuming after short sends
+inline bool sendAll(int sock, const void *data, size_t length) {
+    const char *bytes = static_cast<const char *>(data);
+    while (length > 0) {
+        ssize_t n = send(sock, bytes, length, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        bytes += n;
+        length -= n;
+    }
+    return true;
+}
+
+// Write all of data at offset, resuming after short writes
+inline bool pwriteAll(int file, const void *data, size_t length, uint64_t offset) {
+    const char *bytes = static_cast<const char *>(data);
+    while (length > 0) {
+        ssize_t n = pwrite(file, bytes, length, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        bytes += n;
+        length -= n;
+        offset += n;
+    }
+    return true;
+}
+
+#endif // TRANSFER_H
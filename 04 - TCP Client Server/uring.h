@@ -0,0 +1,312 @@
+#ifndef URING_H
+#define URING_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <cstdio>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/**
+ * @brief Minimal io_uring instance driven through the raw system calls, so no
+ * liburing is needed.
+ *
+ * Submission entries are queued with getSqe() and handed to the kernel in one
+ * batch by submitAndWait(), which also waits for completions. Completions are
+ * consumed with forEachCompletion(). The instance is meant to be used by a
+ * single thread, which calls enable() before its first submission.
+ */
+class IoUring {
+public:
+    IoUring() = default;
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    ~IoUring() {
+        if (sqes != nullptr) {
+            munmap(sqes, sqesSize);
+        }
+        if (cqRing != nullptr && cqRing != sqRing) {
+            munmap(cqRing, cqRingSize);
+        }
+        if (sqRing != nullptr) {
+            munmap(sqRing, sqRingSize);
+        }
+        if (ring_fd >= 0) {
+            close(ring_fd);
+        }
+    }
+
+    /**
+     * @brief Create the ring and map its queues.
+     * @param entries Submission queue size; the completion queue gets four times as many
+     *                entries because multishot requests post several completions each.
+     * @return False, after printing the reason, if io_uring is unavailable.
+     */
+    bool setup(unsigned entries) {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        params.cq_entries = entries * 4;
+        // Completions are only reaped by the submitting thread, so the kernel can defer
+        // its work until we enter the ring instead of interrupting us. That thread is
+        // only known once enable() is called.
+        params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN |
+                       IORING_SETUP_R_DISABLED;
+        ring_fd = syscall(__NR_io_uring_setup, entries, &params);
+        if (ring_fd < 0 && errno == EINVAL) {
+            // Kernels before 6.1 do not know the task run flags
+            params.flags = IORING_SETUP_CQSIZE;
+            ring_fd = syscall(__NR_io_uring_setup, entries, &params);
+        }
+        if (ring_fd < 0) {
+            perror("io_uring_setup");
+            return false;
+        }
+        flags = params.flags;
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        }
+        sqRing = map(sqRingSize, IORING_OFF_SQ_RING);
+        if (sqRing == nullptr) {
+            return false;
+        }
+        cqRing = (params.features & IORING_FEAT_SINGLE_MMAP) ? sqRing : map(cqRingSize, IORING_OFF_CQ_RING);
+        if (cqRing == nullptr) {
+            return false;
+        }
+        sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+        sqes = static_cast<struct io_uring_sqe*>(map(sqesSize, IORING_OFF_SQES));
+        if (sqes == nullptr) {
+            return false;
+        }
+
+        uint8_t* sq = static_cast<uint8_t*>(sqRing);
+        sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqEntries = params.sq_entries;
+        // Slot i of the indirection array always names SQE i, so it is filled once
+        unsigned* array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        for (unsigned i = 0; i < sqEntries; i++) {
+            array[i] = i;
+        }
+
+        uint8_t* cq = static_cast<uint8_t*>(cqRing);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    /**
+     * @brief Bind the ring to the calling thread, the only one allowed to submit from now on.
+     * @return False, after printing the reason, on failure.
+     */
+    bool enable() {
+        if ((flags & IORING_SETUP_R_DISABLED) &&
+            syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_ENABLE_RINGS, nullptr, 0) < 0) {
+            perror("io_uring_register ENABLE_RINGS");
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Get a cleared submission entry to fill in. Submits the queued entries first if the queue is full.
+     * @return Entry that is submitted by the next submitAndWait().
+     */
+    struct io_uring_sqe* getSqe() {
+        if (sqLocalTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+            submitAndWait(0);
+        }
+        struct io_uring_sqe* sqe = &sqes[sqLocalTail & sqMask];
+        memset(sqe, 0, sizeof(*sqe));
+        ++sqLocalTail;
+        return sqe;
+    }
+
+    /**
+     * @brief Submit every queued entry and wait until completions are available.
+     * @param waitFor Number of completions to wait for, 0 to only submit.
+     * @return Number of entries submitted, or -errno.
+     */
+    int submitAndWait(unsigned waitFor) {
+        unsigned toSubmit = sqLocalTail - *sqTail;
+        __atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+        unsigned enterFlags = 0;
+        // Deferred task work only runs when completions are asked for
+        if (waitFor > 0 || (flags & IORING_SETUP_DEFER_TASKRUN)) {
+            enterFlags |= IORING_ENTER_GETEVENTS;
+        }
+        if (toSubmit == 0 && enterFlags == 0) {
+            return 0;
+        }
+        int ret = syscall(__NR_io_uring_enter, ring_fd, toSubmit, waitFor, enterFlags, nullptr, 0);
+        return ret < 0 ? -errno : ret;
+    }
+
+    /**
+     * @brief Consume every available completion.
+     * @param callback Called with each const io_uring_cqe&.
+     * @return Number of completions consumed.
+     */
+    template<typename Callback>
+    unsigned forEachCompletion(Callback&& callback) {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        for (unsigned i = head; i != tail; i++) {
+            callback(cqes[i & cqMask]);
+        }
+        __atomic_store_n(cqHead, tail, __ATOMIC_RELEASE);
+        return tail - head;
+    }
+
+    /**
+     * @brief Get the ring descriptor, for io_uring_register.
+     * @return Ring descriptor.
+     */
+    int getDescriptor() const {
+        return ring_fd;
+    }
+
+private:
+    int ring_fd = -1;
+    unsigned flags = 0;             // Setup flags the kernel accepted
+    void* sqRing = nullptr;
+    void* cqRing = nullptr;         // Same mapping as sqRing with IORING_FEAT_SINGLE_MMAP
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    size_t sqesSize = 0;
+    struct io_uring_sqe* sqes = nullptr;
+    struct io_uring_cqe* cqes = nullptr;
+    unsigned* sqHead = nullptr;     // Advanced by the kernel as it consumes entries
+    unsigned* sqTail = nullptr;     // Published to the kernel by submitAndWait()
+    unsigned sqLocalTail = 0;       // Includes entries not yet published
+    unsigned sqMask = 0;
+    unsigned sqEntries = 0;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+
+    void* map(size_t size, off_t offset) {
+        void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, offset);
+        if (address == MAP_FAILED) {
+            perror("mmap io_uring");
+            return nullptr;
+        }
+        return address;
+    }
+};
+
+/**
+ * @brief Group of equally sized buffers the kernel picks from for requests
+ * submitted with IOSQE_BUFFER_SELECT.
+ *
+ * The kernel takes a buffer at the moment data arrives and reports its id in
+ * the completion flags, so idle connections hold no memory. A buffer belongs
+ * to the application until it is handed back with recycle(), which queues an
+ * IORING_OP_PROVIDE_BUFFERS request. That request goes out with the next
+ * submission batch and posts a completion only if it fails.
+ */
+class BufferGroup {
+public:
+    BufferGroup() = default;
+    BufferGroup(const BufferGroup&) = delete;
+    BufferGroup& operator=(const BufferGroup&) = delete;
+
+    ~BufferGroup() {
+        if (buffers != nullptr) {
+            munmap(buffers, count * bufferSize);
+        }
+    }
+
+    /**
+     * @brief Allocate the buffers and queue a request providing all of them to the kernel.
+     * @param uring Ring the buffers are provided through.
+     * @param group Buffer group id that requests select from.
+     * @param count Number of buffers, at most 65536.
+     * @param bufferSize Size of each buffer in bytes.
+     * @param userData User data of the completion posted if providing buffers fails.
+     * @return False, after printing the reason, on failure.
+     */
+    bool setup(IoUring& uring, uint16_t group, unsigned count, size_t bufferSize, uint64_t userData) {
+        this->uring = &uring;
+        this->group = group;
+        this->count = count;
+        this->bufferSize = bufferSize;
+        this->userData = userData;
+
+        void* memory = mmap(nullptr, count * bufferSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            perror("mmap buffers");
+            return false;
+        }
+        buffers = static_cast<uint8_t*>(memory);
+        provide(0, count);
+        return true;
+    }
+
+    /**
+     * @brief Get a buffer by the id reported in a completion.
+     * @param id Buffer id, i.e. cqe.flags >> IORING_CQE_BUFFER_SHIFT.
+     * @return Start of the buffer.
+     */
+    uint8_t* get(unsigned id) const {
+        return buffers + id * bufferSize;
+    }
+
+    /**
+     * @brief Hand a buffer back to the kernel with the next submission batch.
+     * @param id Buffer id.
+     */
+    void recycle(unsigned id) {
+        provide(id, 1);
+    }
+
+    /**
+     * @brief Get the buffer group id.
+     * @return Group id to put in sqe->buf_group.
+     */
+    uint16_t getGroup() const {
+        return group;
+    }
+
+    /**
+     * @brief Get the size of each buffer.
+     * @return Buffer size in bytes.
+     */
+    size_t getBufferSize() const {
+        return bufferSize;
+    }
+
+private:
+    IoUring* uring = nullptr;
+    uint8_t* buffers = nullptr; // count buffers of bufferSize bytes, contiguous
+    uint16_t group = 0;
+    unsigned count = 0;
+    size_t bufferSize = 0;
+    uint64_t userData = 0;
+
+    void provide(unsigned first, unsigned number) {
+        struct io_uring_sqe* sqe = uring->getSqe();
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+        sqe->fd = number;
+        sqe->addr = reinterpret_cast<uint64_t>(get(first));
+        sqe->len = bufferSize;
+        sqe->off = first;
+        sqe->buf_group = group;
+        sqe->user_data = userData;
+    }
+};
+
+#endif // URING_H
@@ -0,0 +1,148 @@
+#ifndef XXHASH64_H
+#define XXHASH64_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <span>
+
+/**
+ * @brief XXH64, a fast non-cryptographic 64-bit hash, computed incrementally.
+ *
+ * Output is identical to the reference XXH64, so manifests can be checked
+ * with the xxhsum tool. Data may be fed in pieces of any size.
+ */
+class XXHash64 {
+public:
+    /**
+     * @brief Constructor for an empty hash.
+     * @param seed Hash seed.
+     */
+    explicit XXHash64(uint64_t seed = 0) : seed(seed) {
+        lanes[0] = seed + PRIME1 + PRIME2;
+        lanes[1] = seed + PRIME2;
+        lanes[2] = seed;
+        lanes[3] = seed - PRIME1;
+    }
+
+    /**
+     * @brief Hash a whole buffer at once.
+     * @param data Bytes to hash.
+     * @param seed Hash seed.
+     * @return XXH64 of data.
+     */
+    static uint64_t hash(std::span<const uint8_t> data, uint64_t seed = 0) {
+        XXHash64 state(seed);
+        state.update(data);
+        return state.digest();
+    }
+
+    /**
+     * @brief Add bytes to the hash.
+     * @param data Next bytes.
+     */
+    void update(std::span<const uint8_t> data) {
+        const uint8_t* p = data.data();
+        size_t length = data.size();
+        total += length;
+
+        if (buffered + length < STRIPE) {
+            std::memcpy(buffer + buffered, p, length);
+            buffered += length;
+            return;
+        }
+        if (buffered > 0) {
+            size_t fill = STRIPE - buffered;
+            std::memcpy(buffer + buffered, p, fill);
+            consume(buffer);
+            p += fill;
+            length -= fill;
+            buffered = 0;
+        }
+        for (; length >= STRIPE; p += STRIPE, length -= STRIPE) {
+            consume(p);
+        }
+        std::memcpy(buffer, p, length);
+        buffered = length;
+    }
+
+    /**
+     * @brief Get the hash of everything added so far. More data may still be added afterwards.
+     * @return XXH64 value.
+     */
+    uint64_t digest() const {
+        uint64_t h;
+        if (total >= STRIPE) {
+            h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+            for (uint64_t lane : lanes) {
+                h = (h ^ round(0, lane)) * PRIME1 + PRIME4;
+            }
+        } else {
+            h = seed + PRIME5;
+        }
+        h += total;
+
+        const uint8_t* p = buffer;
+        size_t length = buffered;
+        for (; length >= 8; p += 8, length -= 8) {
+            h = rotl(h ^ round(0, load64(p)), 27) * PRIME1 + PRIME4;
+        }
+        if (length >= 4) {
+            h = rotl(h ^ (load32(p) * PRIME1), 23) * PRIME2 + PRIME3;
+            p += 4;
+            length -= 4;
+        }
+        for (; length > 0; ++p, --length) {
+            h = rotl(h ^ (*p * PRIME5), 11) * PRIME1;
+        }
+
+        h ^= h >> 33;
+        h *= PRIME2;
+        h ^= h >> 29;
+        h *= PRIME3;
+        h ^= h >> 32;
+        return h;
+    }
+
+private:
+    static const uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+    static const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+    static const uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+    static const uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+    static const uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+    static const size_t STRIPE = 32; // Bytes consumed per step, 8 for each of the 4 lanes
+
+    uint64_t seed;
+    uint64_t lanes[4];
+    uint8_t buffer[STRIPE];     // Bytes not yet forming a whole stripe
+    size_t buffered = 0;
+    uint64_t total = 0;         // Bytes added so far
+
+    static uint64_t rotl(uint64_t x, int r) {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    static uint64_t load64(const uint8_t* p) {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    static uint64_t load32(const uint8_t* p) {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    static uint64_t round(uint64_t lane, uint64_t input) {
+        return rotl(lane + input * PRIME2, 31) * PRIME1;
+    }
+
+    void consume(const uint8_t* stripe) {
+        for (int i = 0; i < 4; ++i) {
+            lanes[i] = round(lanes[i], load64(stripe + 8 * i));
+        }
+    }
+};
+
+#endif // XXHASH64_H
@@ -0,0 +1,359 @@
+#ifndef LPM_H
+#define LPM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <bit>
+#include <numeric>
+#include <vector>
+#include <endian.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include "netlinkroutes.h"
+
+#define LPM_INTERLEAVE 8    // IPv6 lookups a batch walks down the trie side by side
+
+#define NO_ROUTE UINT32_MAX // Lookup result when no route matches
+
+/**
+ * @brief Order in which routes are written into a table: by prefix length,
+ * and for the same prefix the preferred route (lowest metric, then first in
+ * the list) last, so that later writes override earlier ones exactly where
+ * they should win.
+ * @param routes Routes.
+ * @return Route indexes in write order.
+ */
+template <typename Route>
+std::vector<uint32_t> writeOrder(const std::vector<Route>& routes) {
+    std::vector<uint32_t> order(routes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        if (routes[a].length != routes[b].length) {
+            return routes[a].length < routes[b].length;
+        }
+        if (routes[a].metric != routes[b].metric) {
+            return routes[a].metric > routes[b].metric;
+        }
+        return a > b;
+    });
+    return order;
+}
+
+/**
+ * @brief IPv4 longest-prefix match, DIR-24-8.
+ *
+ * The first 24 bits of the address index a table of 2^24 entries holding
+ * either the matching route or, for the few /24s that contain longer
+ * prefixes, a group of 256 entries indexed by the last 8 bits. A lookup is
+ * one memory access, or two for a destination covered by a prefix longer
+ * than /24. The table is built once from a snapshot of routes and is
+ * read-only afterwards, so any number of threads can look up at once.
+ *
+ * Results are indexes into the route vector the table was built from. Where
+ * several routes have the same prefix, the lowest metric wins.
+ */
+class Ipv4Lpm {
+public:
+    /**
+     * @brief Build the table.
+     * @param routes Routes, usually of one routing table.
+     */
+    explicit Ipv4Lpm(const std::vector<RouteInfo>& routes) : tbl24(1 << 24, 0) {
+        for (uint32_t index : writeOrder(routes)) {
+            const RouteInfo& route = routes[index];
+            uint32_t length = std::min<uint32_t>(route.length, 32);
+            uint32_t prefix = ntohl(route.prefix) & (length ? ~0u << (32 - length) : 0);
+            uint32_t entry = index + 1;
+            if (length <= 24) {
+                // Shorter prefixes are all written before any group exists
+                std::fill_n(tbl24.begin() + (prefix >> 8), 1u << (24 - length), entry);
+                continue;
+            }
+            uint32_t& first = tbl24[prefix >> 8];
+            if (!(first & GROUP)) {
+                // The group starts out with whatever covered the whole /24
+                uint32_t group = tbl8.size() / 256;
+                tbl8.resize(tbl8.size() + 256, first);
+                first = GROUP | group;
+            }
+            uint32_t group = first & ~GROUP;
+            std::fill_n(tbl8.begin() + group * 256 + (prefix & 0xFF), 1u << (32 - length), entry);
+        }
+        tbl8.shrink_to_fit();
+    }
+
+    /**
+     * @brief Find the route for one destination.
+     * @param address Destination, in network byte order.
+     * @return Index of the route, or NO_ROUTE.
+     */
+    uint32_t lookup(uint32_t address) const {
+        address = ntohl(address);
+        uint32_t entry = tbl24[address >> 8];
+        if (entry & GROUP) {
+            entry = tbl8[(entry & ~GROUP) << 8 | (address & 0xFF)];
+        }
+        return entry - 1;
+    }
+
+    /**
+     * @brief Find the routes for many destinations. Every first-level entry is
+     * loaded before any group is, so their cache misses overlap whatever the
+     * caller does between destinations.
+     * @param addresses Destinations, in network byte order.
+     * @param results Set to the index of each one's route, or NO_ROUTE.
+     * @param count Number of destinations.
+     */
+    void lookup(const uint32_t* addresses, uint32_t* results, size_t count) const {
+        for (size_t i = 0; i < count; i++) {
+            results[i] = tbl24[ntohl(addresses[i]) >> 8];
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (results[i] & GROUP) {
+                results[i] = tbl8[(results[i] & ~GROUP) << 8 | (ntohl(addresses[i]) & 0xFF)];
+            }
+            results[i]--;
+        }
+    }
+
+    /**
+     * @brief Get the memory taken by the table.
+     * @return Bytes.
+     */
+    size_t getMemory() const {
+        return (tbl24.capacity() + tbl8.capacity()) * sizeof(uint32_t);
+    }
+
+    /**
+     * @brief Get the number of /24s with prefixes longer than /24.
+     * @return Second-level groups.
+     */
+    size_t getGroups() const {
+        return tbl8.size() / 256;
+    }
+
+private:
+    static constexpr uint32_t GROUP = 1u << 31;     // Entry is a tbl8 group number, not a route
+
+    std::vector<uint32_t> tbl24;    // Route index + 1, 0 for none, or GROUP | group
+    std::vector<uint32_t> tbl8;     // Groups of 256 route indexes + 1
+};
+
+/**
+ * @brief IPv6 longest-prefix match, a Poptrie.
+ *
+ * The first 16 bits of the address index a table of 2^16 entries, each a
+ * route or the root of a trie consuming 6 more bits per node. A node covers
+ * its 64 children with two bitmaps instead of pointers: one marks children
+ * that are nodes, which are stored consecutively so the popcount of the
+ * bits below a child gives its position; the other marks where a run of
+ * identical routes starts among the remaining children, whose routes are
+ * likewise stored once per run. A node is 24 bytes whatever it holds, so
+ * the trie stays small enough for caches even for full tables, and a lookup
+ * costs one access per 6 bits of the matched prefix beyond /16.
+ *
+ * Like Ipv4Lpm it is built once, read-only afterwards, and returns indexes
+ * into the route vector it was built from.
+ */
+class Ipv6Lpm {
+public:
+    /**
+     * @brief Build the trie.
+     * @param routes Routes, usually of one routing table.
+     */
+    explicit Ipv6Lpm(const std::vector<RouteInfo6>& routes) : top(1 << TOP_BITS, 0) {
+        keys.reserve(routes.size());
+        lengths.reserve(routes.size());
+        for (const RouteInfo6& route : routes) {
+            uint8_t length = std::min<uint8_t>(route.length, 128);
+            unsigned __int128 mask = length ? ~(unsigned __int128)0 << (128 - length) : 0;
+            keys.push_back(load(route.prefix) & mask);
+            lengths.push_back(length);
+        }
+        std::vector<std::vector<uint32_t>> children;
+        fill(writeOrder(routes), 0, TOP_BITS, top.data(), children);
+        for (uint32_t slot = 0; slot < children.size(); slot++) {
+            if (!children[slot].empty()) {
+                uint32_t node = nodes.size();
+                nodes.emplace_back();
+                build(node, children[slot], TOP_BITS, top[slot]);
+                top[slot] = NODE | node;
+            }
+        }
+        nodes.shrink_to_fit();
+        leaves.shrink_to_fit();
+        keys = {};
+        lengths = {};
+    }
+
+    /**
+     * @brief Find the route for one destination.
+     * @param address Destination.
+     * @return Index of the route, or NO_ROUTE.
+     */
+    uint32_t lookup(const struct in6_addr& address) const {
+        unsigned __int128 key = load(address);
+        uint32_t entry = top[key >> (128 - TOP_BITS)];
+        if (!(entry & NODE)) {
+            return entry - 1;
+        }
+        const Node* node = &nodes[entry & ~NODE];
+        for (unsigned depth = TOP_BITS;; depth += STRIDE) {
+            unsigned slot = slotOf(key, depth, STRIDE);
+            uint64_t upTo = (2ull << slot) - 1;
+            if (node->internal >> slot & 1) {
+                node = &nodes[node->nodeBase + std::popcount(node->internal & upTo) - 1];
+                continue;
+            }
+            return leaves[node->leafBase + std::popcount(node->runs & upTo) - 1] - 1;
+        }
+    }
+
+    /**
+     * @brief Find the routes for many destinations. Faster per destination than
+     * lookup() because they are walked down the trie LPM_INTERLEAVE at a time,
+     * one level each in turn, so the cache misses of one overlap with those of
+     * the others instead of each walk waiting on its own.
+     * @param addresses Destinations.
+     * @param results Set to the index of each one's route, or NO_ROUTE.
+     * @param count Number of destinations.
+     */
+    void lookup(const struct in6_addr* addresses, uint32_t* results, size_t count) const {
+        for (size_t base = 0; base < count; base += LPM_INTERLEAVE) {
+            size_t walks = std::min<size_t>(LPM_INTERLEAVE, count - base);
+            unsigned __int128 key[LPM_INTERLEAVE];
+            const Node* node[LPM_INTERLEAVE];
+            size_t active = 0;
+            for (size_t i = 0; i < walks; i++) {
+                key[i] = load(addresses[base + i]);
+                uint32_t entry = top[key[i] >> (128 - TOP_BITS)];
+                node[i] = nullptr;
+                if (!(entry & NODE)) {
+                    results[base + i] = entry - 1;
+                    continue;
+                }
+                node[i] = &nodes[entry & ~NODE];
+                __builtin_prefetch(node[i]);
+                active++;
+            }
+            for (unsigned depth = TOP_BITS; active; depth += STRIDE) {
+                for (size_t i = 0; i < walks; i++) {
+                    if (!node[i]) {
+                        continue;
+                    }
+                    unsigned slot = slotOf(key[i], depth, STRIDE);
+                    uint64_t upTo = (2ull << slot) - 1;
+                    if (node[i]->internal >> slot & 1) {
+                        node[i] = &nodes[node[i]->nodeBase + std::popcount(node[i]->internal & upTo) - 1];
+                        __builtin_prefetch(node[i]);
+                        continue;
+                    }
+                    results[base + i] = leaves[node[i]->leafBase + std::popcount(node[i]->runs & upTo) - 1] - 1;
+                    node[i] = nullptr;
+                    active--;
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Get the memory taken by the trie.
+     * @return Bytes.
+     */
+    size_t getMemory() const {
+        return (top.capacity() + leaves.capacity()) * sizeof(uint32_t) + nodes.capacity() * sizeof(Node);
+    }
+
+    /**
+     * @brief Get the number of trie nodes below the first level.
+     * @return Nodes.
+     */
+    size_t getNodes() const {
+        return nodes.size();
+    }
+
+private:
+    static constexpr unsigned TOP_BITS = 16;
+    static constexpr unsigned STRIDE = 6;           // 64 children, one bit each in a 64-bit bitmap
+    static constexpr uint32_t NODE = 1u << 31;      // Top entry is a node number, not a route
+
+    struct Node {
+        uint64_t internal;      // Children that are nodes
+        uint64_t runs;          // Among the other children, where the route differs from the previous one
+        uint32_t nodeBase;      // First child node
+        uint32_t leafBase;      // Route of the first run
+    };
+
+    std::vector<uint32_t> top;      // Route index + 1, 0 for none, or NODE | node
+    std::vector<Node> nodes;
+    std::vector<uint32_t> leaves;   // Route index + 1, 0 for none
+    // Only while building
+    std::vector<unsigned __int128> keys;
+    std::vector<uint8_t> lengths;
+
+    static unsigned __int128 load(const struct in6_addr& address) {
+        uint64_t high, low;
+        memcpy(&high, address.s6_addr, sizeof(high));
+        memcpy(&low, address.s6_addr + 8, sizeof(low));
+        return (unsigned __int128)be64toh(high) << 64 | be64toh(low);
+    }
+
+    // Bits depth to depth + width of the key, padded with zeros past its end
+    static unsigned slotOf(unsigned __int128 key, unsigned depth, unsigned width) {
+        unsigned __int128 bits = depth + width <= 128 ? key >> (128 - depth - width) : key << (depth + width - 128);
+        return (unsigned)bits & ((1u << width) - 1);
+    }
+
+    // Write the routes ending within bits depth to depth + width into the
+    // slots they cover, in order, and hand each longer one to its slot's list
+    void fill(const std::vector<uint32_t>& order, unsigned depth, unsigned width, uint32_t* slots,
+              std::vector<std::vector<uint32_t>>& children) const {
+        children.assign(1u << width, {});
+        for (uint32_t index : order) {
+            unsigned slot = slotOf(keys[index], depth, width);
+            if (lengths[index] <= depth + width) {
+                std::fill_n(slots + slot, 1u << (depth + width - lengths[index]), index + 1);
+            } else {
+                children[slot].push_back(index);
+            }
+        }
+    }
+
+    // Build node number node from the routes longer than depth beneath it,
+    // which matches inherited where none of them does
+    void build(uint32_t node, const std::vector<uint32_t>& order, unsigned depth, uint32_t inherited) {
+        uint32_t slots[1 << STRIDE];
+        std::fill_n(slots, 1 << STRIDE, inherited);
+        std::vector<std::vector<uint32_t>> children;
+        fill(order, depth, STRIDE, slots, children);
+
+        Node current = {};
+        uint32_t previous = 0;
+        bool first = true;
+        current.leafBase = leaves.size();
+        for (unsigned slot = 0; slot < 1 << STRIDE; slot++) {
+            if (!children[slot].empty()) {
+                current.internal |= 1ull << slot;
+            } else if (first || slots[slot] != previous) {
+                current.runs |= 1ull << slot;
+                leaves.push_back(slots[slot]);
+                previous = slots[slot];
+                first = false;
+            }
+        }
+        // Children are placed together first, then filled in one by one
+        current.nodeBase = nodes.size();
+        nodes.resize(nodes.size() + std::popcount(current.internal));
+        nodes[node] = current;
+        uint32_t child = current.nodeBase;
+        for (unsigned slot = 0; slot < 1 << STRIDE; slot++) {
+            if (!children[slot].empty()) {
+                build(child++, children[slot], depth + STRIDE, slots[slot]);
+            }
+        }
+    }
+};
+
+#endif // LPM_H
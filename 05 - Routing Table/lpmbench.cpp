@@ -0,0 +1,317 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <linux/rtnetlink.h>
+#include "netlinkroutes.h"
+#include "lpm.h"
+
+#define V4_ROUTES 1000000   // Synthetic IPv4 table, about a full Internet table
+#define V6_ROUTES 200000    // Synthetic IPv6 table
+#define LOOKUPS 10000000    // Destinations timed per family
+#define CHECKS 2000         // Destinations checked against a linear scan per family
+#define BATCH 64            // Destinations per batch lookup
+#define RECEIVE_BUFFER (4 << 20)
+
+// Builds the longest-prefix-match tables of lpm.h, IPv4 DIR-24-8 and IPv6
+// Poptrie, checks them against a linear scan of the routes and measures
+// lookups per second, one at a time and in batches. The routes are a
+// synthetic full table shaped like the Internet's, or with -k the kernel's.
+// Destinations given as arguments are looked up and their routes printed.
+//
+// Build: g++ -std=c++20 -O2 -o lpmbench lpmbench.cpp
+
+unsigned __int128 toKey(const struct in6_addr& address) {
+    unsigned __int128 key = 0;
+    for (uint8_t byte : address.s6_addr) {
+        key = key << 8 | byte;
+    }
+    return key;
+}
+
+struct in6_addr fromKey(unsigned __int128 key) {
+    struct in6_addr address;
+    for (int i = 15; i >= 0; i--) {
+        address.s6_addr[i] = (uint8_t)key;
+        key >>= 8;
+    }
+    return address;
+}
+
+// Whether a route's prefix covers a destination
+bool covers(const RouteInfo& route, uint32_t address) {
+    return route.length == 0 || ((ntohl(route.prefix) ^ ntohl(address)) >> (32 - std::min<int>(route.length, 32))) == 0;
+}
+
+bool covers(const RouteInfo6& route, const struct in6_addr& address) {
+    return route.length == 0 || ((toKey(route.prefix) ^ toKey(address)) >> (128 - std::min<int>(route.length, 128))) == 0;
+}
+
+// Function to find the route for a destination by trying every route: the
+// longest prefix, then the lowest metric, then the first in the list
+template <typename Route, typename Address>
+uint32_t linearLookup(const std::vector<Route>& routes, const Address& address) {
+    uint32_t best = NO_ROUTE;
+    for (uint32_t i = 0; i < routes.size(); i++) {
+        if (!covers(routes[i], address)) {
+            continue;
+        }
+        if (best == NO_ROUTE || routes[i].length > routes[best].length ||
+            (routes[i].length == routes[best].length && routes[i].metric < routes[best].metric)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+// Prefix lengths of synthetic routes, weighted roughly like a full Internet table
+int randomLength(std::mt19937_64& random, bool v6) {
+    static const int lengths4[] = {8, 12, 14, 16, 18, 19, 20, 21, 22, 23, 24, 25, 26, 28, 30, 32};
+    static const double weights4[] = {1, 1, 3, 15, 20, 30, 40, 50, 120, 90, 600, 5, 5, 5, 5, 5};
+    static const int lengths6[] = {19, 24, 28, 29, 32, 36, 40, 44, 46, 47, 48, 52, 56, 60, 64, 96, 128};
+    static const double weights6[] = {1, 2, 3, 30, 100, 30, 50, 80, 20, 10, 500, 10, 20, 5, 40, 2, 5};
+    static std::discrete_distribution<int> pick4(std::begin(weights4), std::end(weights4));
+    static std::discrete_distribution<int> pick6(std::begin(weights6), std::end(weights6));
+    return v6 ? lengths6[pick6(random)] : lengths4[pick4(random)];
+}
+
+void makeRoutes(std::vector<RouteInfo>& routes, size_t count, std::mt19937_64& random) {
+    routes.assign(count, RouteInfo{});
+    for (size_t i = 0; i < count; i++) {
+        RouteInfo& route = routes[i];
+        route.length = i == 0 ? 0 : randomLength(random, false);
+        uint32_t prefix = route.length ? (uint32_t)random() & ~0u << (32 - route.length) : 0;
+        route.prefix = htonl(prefix);
+        route.gateway = htonl(0xC0000201);
+        route.ifindex = 1 + random() % 4;
+        route.metric = random() % 4;
+        route.table = RT_TABLE_MAIN;
+        route.type = RTN_UNICAST;
+        route.nexthops = 1;
+    }
+}
+
+void makeRoutes(std::vector<RouteInfo6>& routes, size_t count, std::mt19937_64& random) {
+    routes.assign(count, RouteInfo6{});
+    for (size_t i = 0; i < count; i++) {
+        RouteInfo6& route = routes[i];
+        route.length = i == 0 ? 0 : randomLength(random, true);
+        // Global unicast, 2000::/3, like nearly all of the real table
+        unsigned __int128 key = (unsigned __int128)random() << 64 | random();
+        key = (key >> 3) | (unsigned __int128)1 << 125;
+        key &= route.length ? ~(unsigned __int128)0 << (128 - route.length) : 0;
+        route.prefix = fromKey(key);
+        route.ifindex = 1 + random() % 4;
+        route.metric = random() % 4;
+        route.table = RT_TABLE_MAIN;
+        route.type = RTN_UNICAST;
+        route.nexthops = 1;
+    }
+}
+
+// Destinations to look up: half anywhere, half inside a random route so the
+// deeper levels are exercised as much as the first
+void makeDestinations(const std::vector<RouteInfo>& routes, std::vector<uint32_t>& destinations, size_t count,
+                      std::mt19937_64& random) {
+    destinations.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        uint32_t address = random();
+        if (i % 2 && !routes.empty()) {
+            const RouteInfo& route = routes[random() % routes.size()];
+            uint32_t host = route.length < 32 ? ~0u >> route.length : 0;
+            address = (ntohl(route.prefix) & ~host) | (address & host);
+        }
+        destinations[i] = htonl(address);
+    }
+}
+
+void makeDestinations(const std::vector<RouteInfo6>& routes, std::vector<struct in6_addr>& destinations, size_t count,
+                      std::mt19937_64& random) {
+    destinations.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        unsigned __int128 key = (unsigned __int128)random() << 64 | random();
+        key = (key >> 3) | (unsigned __int128)1 << 125;
+        if (i % 2 && !routes.empty()) {
+            const RouteInfo6& route = routes[random() % routes.size()];
+            unsigned __int128 host = route.length < 128 ? ~(unsigned __int128)0 >> route.length : 0;
+            key = (toKey(route.prefix) & ~host) | (key & host);
+        }
+        destinations[i] = fromKey(key);
+    }
+}
+
+std::string routeToString(const RouteInfo& route) {
+    char prefix[INET_ADDRSTRLEN], gateway[INET_ADDRSTRLEN], ifName[IF_NAMESIZE];
+    inet_ntop(AF_INET, &route.prefix, prefix, sizeof(prefix));
+    inet_ntop(AF_INET, &route.gateway, gateway, sizeof(gateway));
+    return std::string(prefix) + "/" + std::to_string(route.length) + (route.gateway ? std::string(" via ") + gateway : "") +
+           " dev " + (if_indextoname(route.ifindex, ifName) ? ifName : std::to_string(route.ifindex)) +
+           " metric " + std::to_string(route.metric);
+}
+
+std::string routeToString(const RouteInfo6& route) {
+    char prefix[INET6_ADDRSTRLEN], gateway[INET6_ADDRSTRLEN], ifName[IF_NAMESIZE];
+    inet_ntop(AF_INET6, &route.prefix, prefix, sizeof(prefix));
+    inet_ntop(AF_INET6, &route.gateway, gateway, sizeof(gateway));
+    return std::string(prefix) + "/" + std::to_string(route.length) +
+           (IN6_IS_ADDR_UNSPECIFIED(&route.gateway) ? "" : std::string(" via ") + gateway) +
+           " dev " + (if_indextoname(route.ifindex, ifName) ? ifName : std::to_string(route.ifindex)) +
+           " metric " + std::to_string(route.metric);
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Function to build, check and time the table of one family; false if it disagrees with the linear scan
+template <typename Lpm, typename Route, typename Address>
+bool benchmark(const char* name, const std::vector<Route>& routes, size_t lookups, size_t checks, std::mt19937_64& random) {
+    auto start = std::chrono::steady_clock::now();
+    Lpm lpm(routes);
+    double buildSeconds = secondsSince(start);
+    std::cout << std::fixed << std::setprecision(1) << name << ": " << routes.size() << " routes, built in "
+              << buildSeconds * 1000 << " ms, " << lpm.getMemory() / 1048576.0 << " MiB" << std::endl;
+
+    std::vector<Address> destinations;
+    makeDestinations(routes, destinations, checks, random);
+    size_t mismatches = 0;
+    for (const Address& destination : destinations) {
+        uint32_t expected = linearLookup(routes, destination);
+        uint32_t found = lpm.lookup(destination);
+        if (found != expected && mismatches++ < 5) {
+            std::cerr << name << ": mismatch, linear scan found " << (expected == NO_ROUTE ? "none" : routeToString(routes[expected]))
+                      << ", lookup found " << (found == NO_ROUTE ? "none" : routeToString(routes[found])) << std::endl;
+        }
+    }
+    std::cout << "  " << checks << " destinations checked against a linear scan, " << mismatches << " mismatches" << std::endl;
+
+    makeDestinations(routes, destinations, lookups, random);
+    // Both ways store results and sum them alike, so only the lookups differ
+    std::vector<uint32_t> results(BATCH);
+    uint64_t checksum = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < lookups; i += BATCH) {
+        size_t count = std::min<size_t>(BATCH, lookups - i);
+        for (size_t j = 0; j < count; j++) {
+            results[j] = lpm.lookup(destinations[i + j]);
+        }
+        for (size_t j = 0; j < count; j++) {
+            checksum += results[j];
+        }
+    }
+    double singleSeconds = secondsSince(start);
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < lookups; i += BATCH) {
+        size_t count = std::min<size_t>(BATCH, lookups - i);
+        lpm.lookup(&destinations[i], results.data(), count);
+        for (size_t j = 0; j < count; j++) {
+            checksum -= results[j];
+        }
+    }
+    double batchSeconds = secondsSince(start);
+    std::cout << "  " << lookups / singleSeconds / 1e6 << " M lookups/s one at a time, "
+              << lookups / batchSeconds / 1e6 << " M lookups/s in batches of " << BATCH << std::endl;
+    if (checksum != 0) {
+        std::cerr << name << ": batch and single lookups disagree" << std::endl;
+        return false;
+    }
+    return mismatches == 0;
+}
+
+int main(int argc, char* argv[]) {
+    bool kernel = false;
+    uint32_t table = RT_TABLE_MAIN;
+    size_t v4Routes = V4_ROUTES;
+    size_t v6Routes = V6_ROUTES;
+    size_t lookups = LOOKUPS;
+    size_t checks = CHECKS;
+    uint64_t seed = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "kt:4:6:l:c:s:")) != -1) {
+        switch (opt) {
+            case 'k':
+                kernel = true;
+                break;
+            case 't':
+                table = std::strtoul(optarg, nullptr, 10);
+                break;
+            case '4':
+                v4Routes = std::strtoul(optarg, nullptr, 10);
+                break;
+            case '6':
+                v6Routes = std::strtoul(optarg, nullptr, 10);
+                break;
+            case 'l':
+                lookups = std::strtoul(optarg, nullptr, 10);
+                break;
+            case 'c':
+                checks = std::strtoul(optarg, nullptr, 10);
+                break;
+            case 's':
+                seed = std::strtoull(optarg, nullptr, 10);
+                break;
+            default:
+                std::cerr << "Usage: " << argv[0] << " [-k, the kernel's routes] [-t table with -k, 0 for all; main by default]"
+                          << " [-4 synthetic IPv4 routes] [-6 synthetic IPv6 routes] [-l lookups] [-c checks] [-s seed]"
+                          << " [destination...]" << std::endl;
+                return -1;
+        }
+    }
+
+    std::mt19937_64 random(seed);
+    std::vector<RouteInfo> routes;
+    std::vector<RouteInfo6> routes6;
+    if (kernel) {
+        int sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+        if (sock < 0) {
+            perror("socket");
+            return -1;
+        }
+        int size = RECEIVE_BUFFER;
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        bool ok = loadRoutes(sock, table, routes) && loadRoutes(sock, table, routes6);
+        close(sock);
+        if (!ok) {
+            return -1;
+        }
+    } else {
+        makeRoutes(routes, v4Routes, random);
+        makeRoutes(routes6, v6Routes, random);
+    }
+
+    // Look up the destinations given, if any, instead of benchmarking
+    if (optind < argc) {
+        Ipv4Lpm lpm(routes);
+        Ipv6Lpm lpm6(routes6);
+        for (int i = optind; i < argc; i++) {
+            struct in_addr address;
+            struct in6_addr address6;
+            uint32_t found;
+            std::string route;
+            if (inet_pton(AF_INET, argv[i], &address) == 1) {
+                found = lpm.lookup(address.s_addr);
+                route = found == NO_ROUTE ? "" : routeToString(routes[found]);
+            } else if (inet_pton(AF_INET6, argv[i], &address6) == 1) {
+                found = lpm6.lookup(address6);
+                route = found == NO_ROUTE ? "" : routeToString(routes6[found]);
+            } else {
+                std::cerr << argv[i] << ": not an address" << std::endl;
+                continue;
+            }
+            std::cout << argv[i] << ": " << (found == NO_ROUTE ? "no route" : route) << std::endl;
+        }
+        return 0;
+    }
+
+    bool ok = benchmark<Ipv4Lpm, RouteInfo, uint32_t>("IPv4", routes, lookups, checks, random);
+    ok = benchmark<Ipv6Lpm, RouteInfo6, struct in6_addr>("IPv6", routes6, lookups, checks, random) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,199 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <arpa/inet.h>
+#include <linux/rtnetlink.h>
+#include "netlinkroutes.h"
+#include "routemirror.h"
+
+#define MESSAGE_SIZE 1024
+
+// Feeds MirroredRoutes the route notifications the kernel sends when next
+// hops of a route are added and removed one at a time, built by hand as
+// the kernel builds them, and checks the routes it keeps after each one.
+// IPv6 multipath routes lose siblings one RTM_DELROUTE at a time and gain
+// them with NLM_F_APPEND; IPv4 `ip route append` adds a route with the same
+// key instead. Exits with a failure status if any check fails.
+//
+// Build: g++ -std=c++20 -O2 -pthread -o mirrorcheck mirrorcheck.cpp
+
+// A route notification under construction
+class Message {
+public:
+    Message(uint16_t type, uint16_t flags, unsigned char family, const void* prefix, unsigned char length, uint32_t table) {
+        memset(buffer, 0, sizeof(buffer));
+        header()->nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+        header()->nlmsg_type = type;
+        header()->nlmsg_flags = flags;
+        struct rtmsg* rtMsg = (struct rtmsg*)NLMSG_DATA(header());
+        rtMsg->rtm_family = family;
+        rtMsg->rtm_dst_len = length;
+        rtMsg->rtm_table = RT_TABLE_UNSPEC;
+        rtMsg->rtm_protocol = RTPROT_BOOT;
+        rtMsg->rtm_scope = RT_SCOPE_UNIVERSE;
+        rtMsg->rtm_type = RTN_UNICAST;
+        addressSize = family == AF_INET ? 4 : 16;
+        add(RTA_TABLE, &table, sizeof(table));
+        add(RTA_DST, prefix, addressSize);
+    }
+
+    // A single next hop, as RTA_GATEWAY and RTA_OIF
+    Message& via(const void* gateway, uint32_t ifindex) {
+        add(RTA_GATEWAY, gateway, addressSize);
+        add(RTA_OIF, &ifindex, sizeof(ifindex));
+        return *this;
+    }
+
+    // Several next hops, as RTA_MULTIPATH
+    Message& via(const std::vector<std::pair<const void*, uint32_t>>& hops) {
+        struct rtattr* multipath = add(RTA_MULTIPATH, nullptr, 0);
+        for (const auto& hop : hops) {
+            struct rtnexthop* nexthop = (struct rtnexthop*)end();
+            nexthop->rtnh_len = sizeof(*nexthop);
+            nexthop->rtnh_ifindex = hop.second;
+            header()->nlmsg_len += sizeof(*nexthop);
+            struct rtattr* gateway = add(RTA_GATEWAY, hop.first, addressSize);
+            nexthop->rtnh_len += RTA_ALIGN(gateway->rta_len);
+            multipath->rta_len += nexthop->rtnh_len;
+        }
+        return *this;
+    }
+
+    const struct nlmsghdr* get() {
+        return header();
+    }
+
+private:
+    alignas(NLMSG_ALIGNTO) unsigned char buffer[MESSAGE_SIZE];
+    size_t addressSize;
+
+    struct nlmsghdr* header() {
+        return (struct nlmsghdr*)buffer;
+    }
+
+    unsigned char* end() {
+        return buffer + NLMSG_ALIGN(header()->nlmsg_len);
+    }
+
+    struct rtattr* add(unsigned short type, const void* data, size_t size) {
+        struct rtattr* attr = (struct rtattr*)end();
+        attr->rta_type = type;
+        attr->rta_len = RTA_LENGTH(size);
+        if (size) {
+            memcpy(RTA_DATA(attr), data, size);
+        }
+        header()->nlmsg_len = NLMSG_ALIGN(header()->nlmsg_len) + RTA_ALIGN(attr->rta_len);
+        return attr;
+    }
+};
+
+struct in6_addr toAddress6(const char* text) {
+    struct in6_addr address;
+    inet_pton(AF_INET6, text, &address);
+    return address;
+}
+
+uint32_t toAddress(const char* text) {
+    uint32_t address;
+    inet_pton(AF_INET, text, &address);
+    return address;
+}
+
+std::string toString(const struct in6_addr& address) {
+    char buffer[INET6_ADDRSTRLEN];
+    return inet_ntop(AF_INET6, &address, buffer, sizeof(buffer));
+}
+
+std::string toString(uint32_t address) {
+    char buffer[INET_ADDRSTRLEN];
+    return inet_ntop(AF_INET, &address, buffer, sizeof(buffer));
+}
+
+int failures = 0;
+
+// Check the only route kept against the expected number of next hops and first gateway, or that none is kept
+void expect(const MirroredRoutes& mirrored, const char* step, unsigned nexthops, const char* gateway = nullptr) {
+    std::vector<RouteInfo> routes;
+    std::vector<RouteInfo6> routes6;
+    mirrored.copy(routes, routes6);
+    std::string got = "no route";
+    if (routes.size() + routes6.size() > 1) {
+        got = std::to_string(routes.size() + routes6.size()) + " routes";
+    } else if (!routes.empty()) {
+        got = std::to_string(routes[0].nexthops) + " via " + toString(routes[0].gateway);
+    } else if (!routes6.empty()) {
+        got = std::to_string(routes6[0].nexthops) + " via " + toString(routes6[0].gateway);
+    }
+    std::string expected = nexthops ? std::to_string(nexthops) + " via " + gateway : "no route";
+    bool ok = got == expected;
+    std::cout << (ok ? "ok      " : "FAILED  ") << step << ": " << got;
+    if (!ok) {
+        std::cout << ", expected " << expected;
+        failures++;
+    }
+    std::cout << std::endl;
+}
+
+int main() {
+    const uint32_t table = RT_TABLE_MAIN;
+    const uint32_t ifindex = 4;
+    const uint16_t create = NLM_F_CREATE | NLM_F_EXCL;
+    MirroredRoutes mirrored(table);
+
+    // The sequences `ip -6 route add/del/append/replace` produce
+    struct in6_addr prefix6 = toAddress6("2001:db8:1::");
+    struct in6_addr gateways6[] = {toAddress6("fd00::3"), toAddress6("fd00::4"), toAddress6("fd00::5"), toAddress6("fd00::7")};
+    mirrored.apply(Message(RTM_NEWROUTE, create, AF_INET6, &prefix6, 48, table)
+                       .via({{&gateways6[0], ifindex}, {&gateways6[1], ifindex}}).get());
+    expect(mirrored, "IPv6 add with two next hops", 2, "fd00::3");
+    mirrored.apply(Message(RTM_DELROUTE, 0, AF_INET6, &prefix6, 48, table).via(&gateways6[0], ifindex).get());
+    expect(mirrored, "IPv6 delete of one next hop", 1, "fd00::4");
+    mirrored.apply(Message(RTM_DELROUTE, 0, AF_INET6, &prefix6, 48, table).via(&gateways6[0], ifindex).get());
+    expect(mirrored, "IPv6 delete replayed", 1, "fd00::4");
+    mirrored.apply(Message(RTM_NEWROUTE, NLM_F_CREATE | NLM_F_APPEND, AF_INET6, &prefix6, 48, table)
+                       .via({{&gateways6[2], ifindex}, {&gateways6[1], ifindex}}).get());
+    expect(mirrored, "IPv6 append listing every next hop", 2, "fd00::4");
+    mirrored.apply(Message(RTM_NEWROUTE, NLM_F_CREATE | NLM_F_APPEND, AF_INET6, &prefix6, 48, table).via(&gateways6[0], ifindex).get());
+    expect(mirrored, "IPv6 append listing the new next hop", 3, "fd00::4");
+    mirrored.apply(Message(RTM_NEWROUTE, NLM_F_REPLACE, AF_INET6, &prefix6, 48, table).via(&gateways6[3], ifindex).get());
+    expect(mirrored, "IPv6 replace", 1, "fd00::7");
+    mirrored.apply(Message(RTM_DELROUTE, 0, AF_INET6, &prefix6, 48, table).via(&gateways6[3], ifindex).get());
+    expect(mirrored, "IPv6 delete of the last next hop", 0);
+
+    // The sequences `ip route add/append/del` produce, each appended hop a route of its own
+    uint32_t prefix = toAddress("198.51.100.0");
+    uint32_t gateways[] = {toAddress("192.0.2.3"), toAddress("192.0.2.4")};
+    mirrored.apply(Message(RTM_NEWROUTE, create, AF_INET, &prefix, 24, table).via(&gateways[0], ifindex).get());
+    mirrored.apply(Message(RTM_NEWROUTE, NLM_F_CREATE | NLM_F_APPEND, AF_INET, &prefix, 24, table).via(&gateways[1], ifindex).get());
+    expect(mirrored, "IPv4 append of a second route", 2, "192.0.2.3");
+    mirrored.apply(Message(RTM_DELROUTE, 0, AF_INET, &prefix, 24, table).via(&gateways[0], ifindex).get());
+    expect(mirrored, "IPv4 delete of the first route", 1, "192.0.2.4");
+    mirrored.apply(Message(RTM_DELROUTE, 0, AF_INET, &prefix, 24, table).via(&gateways[1], ifindex).get());
+    expect(mirrored, "IPv4 delete of the second route", 0);
+    mirrored.apply(Message(RTM_NEWROUTE, create, AF_INET, &prefix, 24, table)
+                       .via({{&gateways[0], ifindex}, {&gateways[1], ifindex}}).get());
+    expect(mirrored, "IPv4 add with two next hops", 2, "192.0.2.3");
+    mirrored.apply(Message(RTM_DELROUTE, 0, AF_INET, &prefix, 24, table)
+                       .via({{&gateways[0], ifindex}, {&gateways[1], ifindex}}).get());
+    expect(mirrored, "IPv4 delete with two next hops", 0);
+
+    // A dump lists routes sharing a key one by one, so it merges them
+    mirrored.apply(Message(RTM_NEWROUTE, NLM_F_MULTI, AF_INET, &prefix, 24, table).via(&gateways[0], ifindex).get(), true);
+    mirrored.apply(Message(RTM_NEWROUTE, NLM_F_MULTI, AF_INET, &prefix, 24, table).via(&gateways[1], ifindex).get(), true);
+    expect(mirrored, "IPv4 dump of two routes sharing a key", 2, "192.0.2.3");
+    mirrored.clear();
+
+    // Other tables are not kept
+    mirrored.apply(Message(RTM_NEWROUTE, create, AF_INET, &prefix, 24, 100).via(&gateways[0], ifindex).get());
+    expect(mirrored, "IPv4 add to another table", 0);
+
+    if (failures) {
+        std::cout << failures << " checks failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "All checks passed" << std::endl;
+    return EXIT_SUCCESS;
+}
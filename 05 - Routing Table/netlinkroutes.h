@@ -0,0 +1,300 @@
+#ifndef NETLINKROUTES_H
+#define NETLINKROUTES_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <functional>
+#include <vector>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <netinet/in.h>
+#include <iostream>
+
+#define NETLINK_BUFFER_SIZE 32768   // Initial receive buffer, grown to fit larger messages
+#define DUMP_ATTEMPTS 5             // Dumps tried while the table keeps changing underneath
+
+/**
+ * @brief One IPv4 route in 24 bytes, addresses in network byte order.
+ *
+ * A multipath route keeps its first next hop; nexthops says how many it has.
+ */
+struct RouteInfo {
+    static constexpr unsigned char FAMILY = AF_INET;
+
+    uint32_t prefix;        // Destination network
+    uint32_t gateway;       // 0 if directly connected
+    uint32_t ifindex;       // Output interface, 0 if none
+    uint32_t metric;        // RTA_PRIORITY
+    uint32_t table;         // Routing table id, e.g. RT_TABLE_MAIN
+    uint8_t length;         // Prefix length
+    uint8_t protocol;       // RTPROT_*, who installed the route
+    uint8_t type;           // RTN_*, e.g. unicast or blackhole
+    uint8_t nexthops;       // 1, or the number of multipath next hops
+};
+
+static_assert(sizeof(RouteInfo) == 24, "RouteInfo should stay compact");
+
+/**
+ * @brief One IPv6 route in 48 bytes, laid out like RouteInfo.
+ */
+struct RouteInfo6 {
+    static constexpr unsigned char FAMILY = AF_INET6;
+
+    struct in6_addr prefix; // Destination network
+    struct in6_addr gateway;// All zeros if directly connected
+    uint32_t ifindex;       // Output interface, 0 if none
+    uint32_t metric;        // RTA_PRIORITY
+    uint32_t table;         // Routing table id, e.g. RT_TABLE_MAIN
+    uint8_t length;         // Prefix length
+    uint8_t protocol;       // RTPROT_*, who installed the route
+    uint8_t type;           // RTN_*, e.g. unicast or blackhole
+    uint8_t nexthops;       // 1, or the number of multipath next hops
+};
+
+static_assert(sizeof(RouteInfo6) == 48, "RouteInfo6 should stay compact");
+
+/**
+ * @brief One next hop of a route, for the family of Route.
+ */
+template <typename Route>
+struct NextHop {
+    decltype(Route::gateway) gateway;   // All zeros if directly connected
+    uint32_t ifindex;                   // Output interface, 0 if none
+
+    bool operator==(const NextHop& other) const {
+        return memcmp(this, &other, sizeof(*this)) == 0;
+    }
+};
+
+static_assert(sizeof(NextHop<RouteInfo>) == 8 && sizeof(NextHop<RouteInfo6>) == 20, "NextHop must not have padding");
+
+/**
+ * @brief Decode an RTM_NEWROUTE or RTM_DELROUTE message.
+ * @param msg Netlink message.
+ * @param route Set to the route; RouteInfo for IPv4, RouteInfo6 for IPv6.
+ * @param nexthops If given, set to every next hop of the route, not only the first.
+ * @return False if the message is not a route of the route's family.
+ */
+template <typename Route>
+inline bool parseRoute(const struct nlmsghdr* msg, Route& route, std::vector<NextHop<Route>>* nexthops = nullptr) {
+    if ((msg->nlmsg_type != RTM_NEWROUTE && msg->nlmsg_type != RTM_DELROUTE) || msg->nlmsg_len < NLMSG_LENGTH(sizeof(struct rtmsg))) {
+        return false;
+    }
+    const struct rtmsg* rtMsg = (const struct rtmsg*)NLMSG_DATA(msg);
+    if (rtMsg->rtm_family != Route::FAMILY) {
+        return false;
+    }
+    memset(&route, 0, sizeof(route));
+    route.length = rtMsg->rtm_dst_len;
+    route.table = rtMsg->rtm_table;
+    route.protocol = rtMsg->rtm_protocol;
+    route.type = rtMsg->rtm_type;
+    route.nexthops = 1;
+    if (nexthops) {
+        nexthops->clear();
+    }
+    bool multipath = false;
+
+    // Attributes may not be aligned for direct 32-bit loads, so they are copied out
+    const struct rtattr* rtAttr = (const struct rtattr*)RTM_RTA(rtMsg);
+    int rtLen = RTM_PAYLOAD(msg);
+    for (; RTA_OK(rtAttr, rtLen); rtAttr = RTA_NEXT(rtAttr, rtLen)) {
+        switch (rtAttr->rta_type) {
+            case RTA_DST:
+                memcpy(&route.prefix, RTA_DATA(rtAttr), sizeof(route.prefix));
+                break;
+            case RTA_GATEWAY:
+                memcpy(&route.gateway, RTA_DATA(rtAttr), sizeof(route.gateway));
+                break;
+            case RTA_OIF:
+                memcpy(&route.ifindex, RTA_DATA(rtAttr), sizeof(route.ifindex));
+                break;
+            case RTA_PRIORITY:
+                memcpy(&route.metric, RTA_DATA(rtAttr), sizeof(route.metric));
+                break;
+            case RTA_TABLE:
+                // Table ids above 255 only fit here
+                memcpy(&route.table, RTA_DATA(rtAttr), sizeof(route.table));
+                break;
+            case RTA_MULTIPATH: {
+                const struct rtnexthop* nexthop = (const struct rtnexthop*)RTA_DATA(rtAttr);
+                int left = RTA_PAYLOAD(rtAttr);
+                int count = 0;
+                for (; left >= (int)sizeof(*nexthop) && nexthop->rtnh_len >= sizeof(*nexthop) && nexthop->rtnh_len <= left;
+                     left -= RTNH_ALIGN(nexthop->rtnh_len), nexthop = RTNH_NEXT(nexthop)) {
+                    NextHop<Route> hop;
+                    memset(&hop, 0, sizeof(hop));
+                    hop.ifindex = nexthop->rtnh_ifindex;
+                    const struct rtattr* nested = RTNH_DATA(nexthop);
+                    int nestedLen = nexthop->rtnh_len - sizeof(*nexthop);
+                    for (; RTA_OK(nested, nestedLen); nested = RTA_NEXT(nested, nestedLen)) {
+                        if (nested->rta_type == RTA_GATEWAY) {
+                            memcpy(&hop.gateway, RTA_DATA(nested), sizeof(hop.gateway));
+                        }
+                    }
+                    if (count++ == 0) {
+                        route.gateway = hop.gateway;
+                        route.ifindex = hop.ifindex;
+                    }
+                    if (nexthops) {
+                        nexthops->push_back(hop);
+                    }
+                }
+                route.nexthops = count > 255 ? 255 : count;
+                multipath = count > 0;
+                break;
+            }
+        }
+    }
+    if (nexthops && !multipath) {
+        nexthops->push_back({route.gateway, route.ifindex});
+    }
+    return true;
+}
+
+/**
+ * @brief Reads multi-part netlink dumps from a NETLINK_ROUTE socket.
+ *
+ * The kernel answers a dump request with as many datagrams as the table
+ * needs, each packed with messages and the last ending in NLMSG_DONE. They
+ * are read one at a time into a single buffer that is reused throughout and
+ * grown whenever MSG_PEEK | MSG_TRUNC shows the next datagram would not fit,
+ * so nothing is ever truncated.
+ */
+class NetlinkReader {
+public:
+    NetlinkReader() : buffer(NETLINK_BUFFER_SIZE) {}
+
+    /**
+     * @brief Dump every route of a family.
+     * @param sock NETLINK_ROUTE socket.
+     * @param family AF_INET, AF_INET6 or AF_UNSPEC.
+     * @param handler Called with every RTM_NEWROUTE message, in order.
+     * @param interrupted Set if the kernel flagged the dump as inconsistent because the table changed
+     * during it (NLM_F_DUMP_INTR); the caller should dump again.
+     * @return False, after printing the reason, if the dump failed.
+     */
+    bool dumpRoutes(int sock, unsigned char family, const std::function<void(const struct nlmsghdr*)>& handler, bool& interrupted) {
+        struct {
+            struct nlmsghdr nlHdr;
+            struct rtmsg rtMsg;
+        } req;
+        memset(&req, 0, sizeof(req));
+        req.nlHdr.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+        req.nlHdr.nlmsg_type = RTM_GETROUTE;
+        req.nlHdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+        req.nlHdr.nlmsg_seq = ++sequence;
+        req.rtMsg.rtm_family = family;
+        if (send(sock, &req, req.nlHdr.nlmsg_len, 0) < 0) {
+            perror("send");
+            return false;
+        }
+
+        interrupted = false;
+        for (;;) {
+            ssize_t len = receive(sock);
+            if (len < 0) {
+                perror("recv");
+                return false;
+            }
+            for (const struct nlmsghdr* msg = (const struct nlmsghdr*)buffer.data(); NLMSG_OK(msg, len); msg = NLMSG_NEXT(msg, len)) {
+                // Notifications from a subscription on the same socket are not part of the dump
+                if (msg->nlmsg_seq != sequence) {
+                    continue;
+                }
+                if (msg->nlmsg_flags & NLM_F_DUMP_INTR) {
+                    interrupted = true;
+                }
+                if (msg->nlmsg_type == NLMSG_DONE) {
+                    return true;
+                }
+                if (msg->nlmsg_type == NLMSG_ERROR) {
+                    const struct nlmsgerr* error = (const struct nlmsgerr*)NLMSG_DATA(msg);
+                    errno = -error->error;
+                    perror("RTM_GETROUTE");
+                    return false;
+                }
+                handler(msg);
+            }
+        }
+    }
+
+    /**
+     * @brief Receive the next datagram whole.
+     * @param sock Netlink socket.
+     * @return Its length, the data in getBuffer(); -1 with errno set on failure, e.g. EAGAIN when
+     * a non-blocking socket has nothing queued or ENOBUFS when the kernel dropped messages for it.
+     */
+    ssize_t receive(int sock) {
+        for (;;) {
+            ssize_t size = recv(sock, nullptr, 0, MSG_PEEK | MSG_TRUNC);
+            if (size < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return -1;
+            }
+            if ((size_t)size > buffer.size()) {
+                buffer.resize(size);
+            }
+            ssize_t len = recv(sock, buffer.data(), buffer.size(), 0);
+            if (len < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return -1;
+            }
+            return len;
+        }
+    }
+
+    /**
+     * @brief Get the receive buffer, which holds the last datagram received.
+     * @return Buffer.
+     */
+    const char* getBuffer() const {
+        return buffer.data();
+    }
+
+private:
+    std::vector<char> buffer;   // Kept 4-byte aligned by the allocator, as netlink messages need
+    uint32_t sequence = 0;
+};
+
+/**
+ * @brief Load the routes of one family and table into a vector.
+ * @param sock NETLINK_ROUTE socket.
+ * @param table Routing table id, 0 for all.
+ * @param routes Set to the routes; RouteInfo for IPv4, RouteInfo6 for IPv6.
+ * @return False, after printing the reason, if the dump failed.
+ */
+template <typename Route>
+bool loadRoutes(int sock, uint32_t table, std::vector<Route>& routes) {
+    NetlinkReader reader;
+    for (int attempt = 1; attempt <= DUMP_ATTEMPTS; attempt++) {
+        routes.clear();
+        bool interrupted;
+        bool ok = reader.dumpRoutes(sock, Route::FAMILY, [&](const struct nlmsghdr* msg) {
+            Route route;
+            if (parseRoute(msg, route) && (table == 0 || route.table == table)) {
+                routes.push_back(route);
+            }
+        }, interrupted);
+        if (!ok) {
+            return false;
+        }
+        if (!interrupted) {
+            return true;
+        }
+        std::cerr << "Routes changed during the dump, dumping again" << std::endl;
+    }
+    std::cerr << "Routes kept changing, the table may be inconsistent" << std::endl;
+    return true;
+}
+
+#endif // NETLINKROUTES_H
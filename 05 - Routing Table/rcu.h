@@ -0,0 +1,148 @@
+#ifndef RCU_H
+#define RCU_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#define RCU_MAX_READERS 64  // Reader threads that can be registered at once
+
+/**
+ * @brief Read-copy-update publication of immutable objects, epoch based.
+ *
+ * One writer publishes new versions of an object; any number of readers use
+ * the current one without ever locking or waiting. A reader brackets its
+ * use with enter() and exit(), which only store its slot's epoch, and may
+ * keep the pointer enter() returned until exit(). Each publish() swaps in
+ * the new version and retires the old one with the epoch after the swap;
+ * reclaim() deletes retired versions once every reader is either outside
+ * or entered at that epoch or later, and so cannot hold them. A reader
+ * that stays inside only delays reclamation, it never blocks the writer.
+ *
+ * The writer side, publish() and reclaim(), must be called from one thread.
+ */
+template <typename T>
+class Rcu {
+public:
+    Rcu() = default;
+    Rcu(const Rcu&) = delete;
+    Rcu& operator=(const Rcu&) = delete;
+
+    /**
+     * @brief Destructor. No reader may be inside.
+     */
+    ~Rcu() {
+        delete current.load(std::memory_order_relaxed);
+        for (const Retired& retired : retiredList) {
+            delete retired.object;
+        }
+    }
+
+    /**
+     * @brief Claim a reader slot for the calling thread.
+     * @return Slot to pass to enter() and exit(), or -1 if all RCU_MAX_READERS are taken.
+     */
+    int addReader() {
+        for (int slot = 0; slot < RCU_MAX_READERS; slot++) {
+            bool free = false;
+            if (readers[slot].used.compare_exchange_strong(free, true)) {
+                return slot;
+            }
+        }
+        return -1;
+    }
+
+    /**
+     * @brief Release a reader slot; the reader must be outside.
+     * @param slot Slot from addReader().
+     */
+    void removeReader(int slot) {
+        readers[slot].used.store(false, std::memory_order_release);
+    }
+
+    /**
+     * @brief Start using the current version.
+     * @param slot Reader's slot.
+     * @return Current version, valid until exit(); nullptr if none was published yet.
+     */
+    const T* enter(int slot) {
+        // Acquire pairs with publish(): seeing an epoch means seeing the pointer swapped in before it
+        readers[slot].epoch.store(epoch.load(std::memory_order_acquire));
+        return current.load();
+    }
+
+    /**
+     * @brief Stop using the version enter() returned.
+     * @param slot Reader's slot.
+     */
+    void exit(int slot) {
+        readers[slot].epoch.store(QUIESCENT, std::memory_order_release);
+    }
+
+    /**
+     * @brief Make a new version current and retire the previous one. Writer only.
+     * @param next New version.
+     */
+    void publish(std::unique_ptr<T> next) {
+        T* old = current.exchange(next.release());
+        uint64_t retiredAt = epoch.fetch_add(1) + 1;
+        if (old) {
+            retiredList.push_back({old, retiredAt});
+        }
+        reclaim();
+    }
+
+    /**
+     * @brief Delete the retired versions no reader can still hold. Writer only.
+     * @return Versions still waiting for readers to move on.
+     */
+    size_t reclaim() {
+        uint64_t oldest = UINT64_MAX;
+        for (const Reader& reader : readers) {
+            uint64_t entered = reader.epoch.load();
+            if (entered != QUIESCENT && entered < oldest) {
+                oldest = entered;
+            }
+        }
+        size_t kept = 0;
+        for (const Retired& retired : retiredList) {
+            if (retired.epoch <= oldest) {
+                delete retired.object;
+            } else {
+                retiredList[kept++] = retired;
+            }
+        }
+        retiredList.resize(kept);
+        return kept;
+    }
+
+    /**
+     * @brief Get the current version, for the writer, which never sees it deleted under it.
+     * @return Current version, nullptr if none was published yet.
+     */
+    const T* get() const {
+        return current.load(std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr uint64_t QUIESCENT = 0;    // Reader is outside
+
+    struct alignas(64) Reader {
+        std::atomic<uint64_t> epoch{QUIESCENT}; // Epoch it entered at
+        std::atomic<bool> used{false};
+    };
+
+    struct Retired {
+        T* object;
+        uint64_t epoch;     // Readers entered at this epoch or later cannot hold it
+    };
+
+    std::atomic<T*> current{nullptr};
+    std::atomic<uint64_t> epoch{1};
+    Reader readers[RCU_MAX_READERS];
+    std::vector<Retired> retiredList;   // Writer only
+};
+
+#endif // RCU_H
@@ -1,64 +1,166 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <chrono>
+#include <algorithm>
+#include <thread>
+#include <memory>
+#include <random>
+#include <atomic>
 #include <cstring>
+#include <cstdlib>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <net/if.h>
+#include <arpa/inet.h>
 #include <linux/rtnetlink.h>
+#include "netlinkroutes.h"
+#include "routemirror.h"
 
-// Structure to hold route information
-struct RouteInfo {
-    std::string destination; // Destination IP address
-    std::string gateway;     // Gateway IP address
-    std::string interface;   // Network interface name
-};
+#define RECEIVE_BUFFER (4 << 20)
+#define REPORT_INTERVAL 1   // Seconds between reports when following changes
+#define PUBLISH_MS 200      // Shortest time between two snapshots when following changes
+#define LOOKUP_BATCH 64     // Destinations a lookup thread resolves per snapshot it enters
+
+// Build: g++ -std=c++20 -O2 -pthread -o readtable readtable.cpp
 
-// Function to convert an IP address from integer to string
+// Function to convert an IP address in network byte order to a string
 std::string ipToString(uint32_t ip) {
-    char buffer[16];
-    snprintf(buffer, sizeof(buffer), "%d.%d.%d.%d",
-             ip & 0xFF, (ip >> 8) & 0xFF, (ip >> 16) & 0xFF, (ip >> 24) & 0xFF);
+    char buffer[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &ip, buffer, sizeof(buffer));
     return std::string(buffer);
 }
 
-// Function to parse routing information from netlink messages
-void parseRoutes(const struct nlmsghdr* nlMsg, std::vector<RouteInfo>& routes) {
-    // Iterate over all netlink messages
-    for (const struct nlmsghdr* msg = nlMsg; NLMSG_OK(msg, msg->nlmsg_len); msg = NLMSG_NEXT(msg, msg->nlmsg_len)) {
-        if (nlMsg->nlmsg_type == NLMSG_DONE) break; // End of messages
-
-        struct rtmsg* rtMsg = (struct rtmsg*)NLMSG_DATA(nlMsg); // Routing message
-        if (rtMsg->rtm_family != AF_INET || rtMsg->rtm_table != RT_TABLE_MAIN) continue; // Only handle IPv4 main table
+// Interface names by index, looked up once each instead of once per route
+class InterfaceNames {
+public:
+    const std::string& get(uint32_t index) {
+        if (index >= names.size()) {
+            names.resize(index + 1);
+        }
+        if (names[index].empty()) {
+            char ifName[IF_NAMESIZE];
+            names[index] = if_indextoname(index, ifName) ? ifName : (index ? std::to_string(index) : "-");
+        }
+        return names[index];
+    }
 
-        struct rtattr* rtAttr = (struct rtattr*)RTM_RTA(rtMsg); // Route attributes
-        int rtLen = RTM_PAYLOAD(nlMsg); // Length of route attributes
+private:
+    std::vector<std::string> names;
+};
 
-        RouteInfo routeInfo;
-        // Iterate over route attributes
-        for (; RTA_OK(rtAttr, rtLen); rtAttr = RTA_NEXT(rtAttr, rtLen)) {
-            switch (rtAttr->rta_type) {
-                case RTA_DST: // Destination IP address
-                    routeInfo.destination = ipToString(*((uint32_t*)RTA_DATA(rtAttr)));
-                    break;
-                case RTA_GATEWAY: // Gateway IP address
-                    routeInfo.gateway = ipToString(*((uint32_t*)RTA_DATA(rtAttr)));
-                    break;
-                case RTA_OIF: { // Output interface index
-                    char ifName[IF_NAMESIZE];
-                    if_indextoname(*((int*)RTA_DATA(rtAttr)), ifName);
-                    routeInfo.interface = std::string(ifName);
-                    break;
-                }
+// Function for a lookup thread: resolves random destinations through the
+// published snapshots, as a flow annotator would, counting them
+void lookupLoop(Rcu<RouteSnapshot>& snapshots, std::atomic<uint64_t>& lookups, unsigned seed) {
+    int slot = snapshots.addReader();
+    if (slot < 0) {
+        std::cerr << "Too many lookup threads" << std::endl;
+        return;
+    }
+    std::mt19937 random(seed);
+    uint32_t addresses[LOOKUP_BATCH];
+    struct in6_addr addresses6[LOOKUP_BATCH];
+    uint32_t results[LOOKUP_BATCH];
+    for (;;) {
+        for (int i = 0; i < LOOKUP_BATCH; i++) {
+            addresses[i] = random();
+            for (int j = 0; j < 4; j++) {
+                addresses6[i].s6_addr32[j] = random();
             }
         }
-        routes.push_back(routeInfo); // Add route info to the list
+        const RouteSnapshot* snapshot = snapshots.enter(slot);
+        snapshot->lpm.lookup(addresses, results, LOOKUP_BATCH);
+        snapshot->lpm6.lookup(addresses6, results, LOOKUP_BATCH);
+        snapshots.exit(slot);
+        lookups.store(lookups.load(std::memory_order_relaxed) + 2 * LOOKUP_BATCH, std::memory_order_relaxed);
     }
 }
 
-int main() {
+// Function to keep mirroring the routes and report on the mirror until it fails
+int follow(uint32_t table, unsigned interval, unsigned publishMs, unsigned lookupThreads) {
+    RouteMirror mirror(table, publishMs);
+    if (!mirror.start()) {
+        return -1;
+    }
+    // The reporter's slot is taken first, so lookup threads cannot use them all up
+    int slot = mirror.getSnapshots().addReader();
+    if (slot < 0) {
+        std::cerr << "Too many lookup threads" << std::endl;
+        return -1;
+    }
+    std::vector<std::unique_ptr<std::atomic<uint64_t>>> lookups;
+    for (unsigned i = 0; i < lookupThreads; i++) {
+        lookups.push_back(std::make_unique<std::atomic<uint64_t>>(0));
+        std::thread(lookupLoop, std::ref(mirror.getSnapshots()), std::ref(*lookups.back()), i + 1).detach();
+    }
+
+    uint64_t lastUpdates = 0;
+    uint64_t lastLookups = 0;
+    while (mirror.isRunning()) {
+        std::this_thread::sleep_for(std::chrono::seconds(interval));
+        uint64_t updates = mirror.getUpdates();
+        uint64_t lookupCount = 0;
+        for (const auto& count : lookups) {
+            lookupCount += count->load(std::memory_order_relaxed);
+        }
+        const RouteSnapshot* snapshot = mirror.getSnapshots().enter(slot);
+        double age = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - snapshot->taken).count();
+        std::cout << "Routes: " << mirror.getRoutes() << " IPv4, " << mirror.getRoutes6() << " IPv6"
+                  << ", Updates: " << (updates - lastUpdates) / interval << "/s"
+                  << ", Resyncs: " << mirror.getResyncs()
+                  << ", Snapshot: " << snapshot->version << " (" << snapshot->routes.size() << " IPv4, " << snapshot->routes6.size()
+                  << " IPv6, " << updates - snapshot->updates << " updates behind, " << (long)age << " ms old, built in "
+                  << (long)mirror.getBuildMs() << " ms)"
+                  << ", Lookups: " << (lookupCount - lastLookups) / interval << "/s" << std::endl;
+        mirror.getSnapshots().exit(slot);
+        lastUpdates = updates;
+        lastLookups = lookupCount;
+    }
+    // The lookup threads still read the snapshots
+    _exit(-1);
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t table = RT_TABLE_MAIN;
+    bool quiet = false;
+    bool following = false;
+    unsigned interval = REPORT_INTERVAL;
+    unsigned publishMs = PUBLISH_MS;
+    unsigned lookupThreads = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:qfi:p:r:")) != -1) {
+        switch (opt) {
+            case 't':
+                table = std::strtoul(optarg, nullptr, 10);
+                break;
+            case 'q':
+                quiet = true;
+                break;
+            case 'f':
+                following = true;
+                break;
+            case 'i':
+                interval = std::max(1ul, std::strtoul(optarg, nullptr, 10));
+                break;
+            case 'p':
+                publishMs = std::strtoul(optarg, nullptr, 10);
+                break;
+            case 'r':
+                lookupThreads = std::strtoul(optarg, nullptr, 10);
+                break;
+            default:
+                std::cerr << "Usage: " << argv[0] << " [-t table, 0 for all; main by default] [-q, summary only]"
+                          << " [-f, follow changes, IPv4 and IPv6] [-i report interval with -f, seconds]"
+                          << " [-p shortest time between snapshots with -f, ms] [-r lookup threads with -f]" << std::endl;
+                return -1;
+        }
+    }
+    if (following) {
+        return follow(table, interval, publishMs, lookupThreads);
+    }
+
     // Create a netlink socket
-    int sock = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+    int sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
     if (sock < 0) {
         // Most likely reasons for failure are
         // - Permission denied
@@ -68,45 +170,35 @@ int main() {
         perror("socket");
         return -1;
     }
+    // Room for the kernel to run ahead while a large dump is parsed
+    int size = RECEIVE_BUFFER;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
 
-    // Prepare netlink request
-    struct {
-        struct nlmsghdr nlHdr; // Netlink message header
-        struct rtmsg rtMsg;    // Routing message
-    } req;
-
-    memset(&req, 0, sizeof(req));
-    req.nlHdr.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg)); // Message length
-    req.nlHdr.nlmsg_type = RTM_GETROUTE; // Get routing table
-    req.nlHdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP; // Request and dump flags
-    req.rtMsg.rtm_family = AF_INET; // IPv4 family
-
-    // Send netlink request to kernel
-    if (send(sock, &req, req.nlHdr.nlmsg_len, 0) < 0) {
-        perror("send");
-        close(sock);
-        return -1;
-    }
-
-    // Buffer to receive netlink response
-    std::vector<char> buffer(4096);
-    int len = recv(sock, buffer.data(), buffer.size(), 0);
-    if (len < 0) {
-        perror("recv");
+    auto start = std::chrono::steady_clock::now();
+    std::vector<RouteInfo> routes;
+    if (!loadRoutes(sock, table, routes)) {
         close(sock);
         return -1;
     }
-
-    // Parse routes from netlink response
-    std::vector<RouteInfo> routes;
-    parseRoutes((struct nlmsghdr*)buffer.data(), routes);
+    routes.shrink_to_fit();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
     // Print parsed routes
-    for (const auto& route : routes) {
-        std::cout << "Destination: " << route.destination
-                  << ", Gateway: " << route.gateway
-                  << ", Interface: " << route.interface << std::endl;
+    if (!quiet) {
+        InterfaceNames interfaces;
+        for (const auto& route : routes) {
+            std::cout << "Destination: " << ipToString(route.prefix) << "/" << (int)route.length
+                      << ", Gateway: " << (route.gateway ? ipToString(route.gateway) : "-")
+                      << ", Interface: " << interfaces.get(route.ifindex)
+                      << ", Metric: " << route.metric << ", Table: " << route.table;
+            if (route.nexthops > 1) {
+                std::cout << ", Next hops: " << (int)route.nexthops;
+            }
+            std::cout << '\n';
+        }
     }
+    std::cout << "Loaded " << routes.size() << " routes in " << seconds * 1000 << " ms, "
+              << routes.size() * sizeof(RouteInfo) / 1024 << " KiB" << std::endl;
 
     close(sock); // Close netlink socket
     return 0;
@@ -0,0 +1,543 @@
+#ifndef ROUTEMIRROR_H
+#define ROUTEMIRROR_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include "netlinkroutes.h"
+#include "lpm.h"
+#include "rcu.h"
+
+#define MIRROR_RECEIVE_BUFFER (64 << 20)    // Event socket buffer, to ride out bursts while a snapshot builds
+#define MIRROR_POLL_MS 100                  // Longest wait for events, bounding how late stop() is noticed
+
+/**
+ * @brief An immutable copy of the routes with lookup tables over them.
+ */
+struct RouteSnapshot {
+    std::vector<RouteInfo> routes;
+    std::vector<RouteInfo6> routes6;
+    Ipv4Lpm lpm;
+    Ipv6Lpm lpm6;
+    uint64_t version;       // Counts publications from 1
+    uint64_t updates;       // Changes applied before it was taken
+    std::chrono::steady_clock::time_point taken;
+
+    RouteSnapshot(std::vector<RouteInfo>&& routes, std::vector<RouteInfo6>&& routes6, uint64_t version, uint64_t updates)
+        : routes(std::move(routes)), routes6(std::move(routes6)), lpm(this->routes), lpm6(this->routes6),
+          version(version), updates(updates), taken(std::chrono::steady_clock::now()) {}
+
+    /**
+     * @brief Find the route for a destination.
+     * @param address Destination, in network byte order.
+     * @return Route, or nullptr if none matches.
+     */
+    const RouteInfo* lookup(uint32_t address) const {
+        uint32_t index = lpm.lookup(address);
+        return index == NO_ROUTE ? nullptr : &routes[index];
+    }
+
+    /**
+     * @brief Find the route for a destination.
+     * @param address Destination.
+     * @return Route, or nullptr if none matches.
+     */
+    const RouteInfo6* lookup(const struct in6_addr& address) const {
+        uint32_t index = lpm6.lookup(address);
+        return index == NO_ROUTE ? nullptr : &routes6[index];
+    }
+};
+
+/**
+ * @brief The routes of one routing table, or all, kept up to date one
+ * netlink message at a time.
+ *
+ * A route is identified by its table, prefix, length and metric, and holds
+ * the set of next hops the kernel has for it. The kernel does not always
+ * describe a route whole: an IPv6 multipath route loses one sibling at a
+ * time, each with its own RTM_DELROUTE naming only that next hop, and
+ * `ip route append` adds a next hop with NLM_F_APPEND, for IPv6 a sibling
+ * and for IPv4 another route with the same key. So an RTM_DELROUTE removes
+ * only the next hops it names, and the route once none is left, while an
+ * appending RTM_NEWROUTE adds its next hops to those already there. Any
+ * other RTM_NEWROUTE, a new route or a replacement, sets them all.
+ */
+class MirroredRoutes {
+public:
+    /**
+     * @brief Constructor.
+     * @param table Routing table to keep, 0 for all.
+     */
+    explicit MirroredRoutes(uint32_t table) : table(table) {}
+
+    /**
+     * @brief Apply a route notification or a route from a dump.
+     * @param msg RTM_NEWROUTE or RTM_DELROUTE message; others are ignored.
+     * @param merge Add the next hops of an RTM_NEWROUTE to the route's as if it were appending,
+     * as a dump needs since it lists the routes sharing a key, and older kernels the siblings of
+     * an IPv6 multipath route, one by one.
+     * @return True if the message was a route of the kept table.
+     */
+    bool apply(const struct nlmsghdr* msg, bool merge = false) {
+        if (msg->nlmsg_len < NLMSG_LENGTH(sizeof(struct rtmsg))) {
+            return false;
+        }
+        // Cached clones, e.g. IPv6 PMTU exceptions, are not part of any table
+        const struct rtmsg* rtMsg = (const struct rtmsg*)NLMSG_DATA(msg);
+        if (rtMsg->rtm_flags & RTM_F_CLONED) {
+            return false;
+        }
+        bool append = merge || (msg->nlmsg_flags & NLM_F_APPEND);
+        RouteInfo route;
+        RouteInfo6 route6;
+        if (parseRoute(msg, route, &nexthops)) {
+            return apply(msg->nlmsg_type, append, route, nexthops, routes);
+        }
+        if (parseRoute(msg, route6, &nexthops6)) {
+            return apply(msg->nlmsg_type, append, route6, nexthops6, routes6);
+        }
+        return false;
+    }
+
+    /**
+     * @brief Forget every route.
+     */
+    void clear() {
+        routes.clear();
+        routes6.clear();
+    }
+
+    /**
+     * @brief Get the number of IPv4 routes.
+     * @return Routes, a multipath route counting once.
+     */
+    size_t size() const {
+        return routes.size();
+    }
+
+    /**
+     * @brief Get the number of IPv6 routes.
+     * @return Routes, a multipath route counting once.
+     */
+    size_t size6() const {
+        return routes6.size();
+    }
+
+    /**
+     * @brief Copy the routes out, each with its first next hop and the number it has.
+     * @param current Set to the IPv4 routes.
+     * @param current6 Set to the IPv6 routes.
+     */
+    void copy(std::vector<RouteInfo>& current, std::vector<RouteInfo6>& current6) const {
+        copy(routes, current);
+        copy(routes6, current6);
+    }
+
+private:
+    // What identifies a route in its table, as the kernel sees it
+    template <typename Route>
+    struct RouteKey {
+        decltype(Route::prefix) prefix;
+        uint32_t table;
+        uint32_t metric;
+        uint32_t length;
+
+        explicit RouteKey(const Route& route) : prefix(route.prefix), table(route.table), metric(route.metric), length(route.length) {}
+
+        bool operator==(const RouteKey& other) const {
+            return memcmp(this, &other, sizeof(*this)) == 0;
+        }
+    };
+
+    // The keys have no padding, so their bytes identify them
+    template <typename Route>
+    struct RouteKeyHash {
+        size_t operator()(const RouteKey<Route>& key) const {
+            return std::hash<std::string_view>()(std::string_view((const char*)&key, sizeof(key)));
+        }
+    };
+
+    template <typename Route>
+    struct Entry {
+        Route route;                            // Its next hop fields are set when copied out
+        std::vector<NextHop<Route>> nexthops;   // Never empty
+    };
+
+    template <typename Route>
+    using RouteMap = std::unordered_map<RouteKey<Route>, Entry<Route>, RouteKeyHash<Route>>;
+
+    static_assert(sizeof(RouteKey<RouteInfo>) == 16 && sizeof(RouteKey<RouteInfo6>) == 28, "RouteKey must not have padding");
+
+    uint32_t table;
+    RouteMap<RouteInfo> routes;
+    RouteMap<RouteInfo6> routes6;
+    // Reused for every message
+    std::vector<NextHop<RouteInfo>> nexthops;
+    std::vector<NextHop<RouteInfo6>> nexthops6;
+
+    template <typename Route>
+    bool apply(uint16_t type, bool append, const Route& route, const std::vector<NextHop<Route>>& hops, RouteMap<Route>& map) {
+        if (table != 0 && route.table != table) {
+            return false;
+        }
+        RouteKey<Route> key(route);
+        auto it = map.find(key);
+        if (type == RTM_NEWROUTE) {
+            if (it == map.end() || !append) {
+                map.insert_or_assign(key, Entry<Route>{route, hops});
+                return true;
+            }
+            for (const NextHop<Route>& hop : hops) {
+                if (std::find(it->second.nexthops.begin(), it->second.nexthops.end(), hop) == it->second.nexthops.end()) {
+                    it->second.nexthops.push_back(hop);
+                }
+            }
+            return true;
+        }
+        if (it == map.end()) {
+            return true;
+        }
+        // A deletion naming none of the next hops held is one the dump already showed, replayed
+        std::vector<NextHop<Route>>& held = it->second.nexthops;
+        for (const NextHop<Route>& hop : hops) {
+            held.erase(std::remove(held.begin(), held.end(), hop), held.end());
+        }
+        if (held.empty()) {
+            map.erase(it);
+        }
+        return true;
+    }
+
+    template <typename Route>
+    static void copy(const RouteMap<Route>& map, std::vector<Route>& current) {
+        current.clear();
+        current.reserve(map.size());
+        for (const auto& entry : map) {
+            Route route = entry.second.route;
+            route.gateway = entry.second.nexthops.front().gateway;
+            route.ifindex = entry.second.nexthops.front().ifindex;
+            route.nexthops = std::min<size_t>(entry.second.nexthops.size(), 255);
+            current.push_back(route);
+        }
+    }
+};
+
+/**
+ * @brief Keeps a copy of the kernel's IPv4 and IPv6 routes up to date.
+ *
+ * The mirror joins the RTNLGRP_IPV4_ROUTE and RTNLGRP_IPV6_ROUTE groups
+ * before dumping the routes once, so no change can fall between the dump
+ * and the first notification, then applies every RTM_NEWROUTE and
+ * RTM_DELROUTE to its tables as it arrives. Replaying a change the dump
+ * already showed is harmless, since each one just sets, adds or removes the
+ * next hops it names. When the kernel reports ENOBUFS, notifications were dropped
+ * because the socket buffer filled up, and the mirror resynchronises with a
+ * fresh dump on a separate socket; this is the only time it dumps.
+ *
+ * Changes are coalesced: at most one snapshot, with its lookup tables, is
+ * built and published per publish interval, however many changes arrived,
+ * so a burst of tens of thousands of updates costs one rebuild. Snapshots
+ * are published through Rcu, so lookup threads never wait on the mirror.
+ * Everything but the snapshots and statistics belongs to the mirror's thread.
+ */
+class RouteMirror {
+public:
+    /**
+     * @brief Constructor.
+     * @param table Routing table to mirror, 0 for all.
+     * @param publishMs Shortest time between two snapshots, in milliseconds.
+     */
+    RouteMirror(uint32_t table, unsigned publishMs)
+        : table(table), publishInterval(std::chrono::milliseconds(publishMs)), routes(table) {}
+
+    RouteMirror(const RouteMirror&) = delete;
+    RouteMirror& operator=(const RouteMirror&) = delete;
+
+    /**
+     * @brief Destructor. Stops the mirror.
+     */
+    ~RouteMirror() {
+        stop();
+        if (eventSock >= 0) {
+            close(eventSock);
+        }
+        if (dumpSock >= 0) {
+            close(dumpSock);
+        }
+    }
+
+    /**
+     * @brief Subscribe, load the routes, publish the first snapshot and start following changes.
+     * @return False, after printing the reason, on failure.
+     */
+    bool start() {
+        eventSock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_ROUTE);
+        dumpSock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+        if (eventSock < 0 || dumpSock < 0) {
+            perror("socket");
+            return false;
+        }
+        // Forcing the size past rmem_max needs CAP_NET_ADMIN; without it the request is capped
+        int size = MIRROR_RECEIVE_BUFFER;
+        if (setsockopt(eventSock, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0) {
+            setsockopt(eventSock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        }
+        setsockopt(dumpSock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        // Notifications only reach sockets with a port id, which an unbound socket gets on its first send
+        struct sockaddr_nl addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.nl_family = AF_NETLINK;
+        if (bind(eventSock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            perror("bind");
+            return false;
+        }
+        for (int group : {RTNLGRP_IPV4_ROUTE, RTNLGRP_IPV6_ROUTE}) {
+            if (setsockopt(eventSock, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &group, sizeof(group)) < 0) {
+                perror("NETLINK_ADD_MEMBERSHIP");
+                return false;
+            }
+        }
+        if (!resync()) {
+            return false;
+        }
+        publish();
+        running.store(true);
+        thread = std::thread(&RouteMirror::run, this);
+        return true;
+    }
+
+    /**
+     * @brief Stop following changes; the last snapshot stays readable.
+     */
+    void stop() {
+        running.store(false);
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    /**
+     * @brief Check whether changes are still followed.
+     * @return False once stopped, or after the mirror failed and printed why.
+     */
+    bool isRunning() const {
+        return running.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the published snapshots, for lookup threads to read through.
+     * @return Snapshots.
+     */
+    Rcu<RouteSnapshot>& getSnapshots() {
+        return snapshots;
+    }
+
+    /**
+     * @brief Get the number of route changes applied.
+     * @return Changes, counting those of the initial dump and resyncs as one each.
+     */
+    uint64_t getUpdates() const {
+        return updates.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the number of fresh dumps after notifications were lost.
+     * @return Resyncs, not counting the initial dump.
+     */
+    uint64_t getResyncs() const {
+        return resyncs.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the number of snapshots published.
+     * @return Snapshots.
+     */
+    uint64_t getPublished() const {
+        return published.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the number of IPv4 routes mirrored now, published or not.
+     * @return Routes.
+     */
+    size_t getRoutes() const {
+        return routeCount.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the number of IPv6 routes mirrored now, published or not.
+     * @return Routes.
+     */
+    size_t getRoutes6() const {
+        return routeCount6.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the time the last snapshot took to build.
+     * @return Milliseconds.
+     */
+    double getBuildMs() const {
+        return buildMs.load(std::memory_order_relaxed);
+    }
+
+private:
+    uint32_t table;
+    std::chrono::steady_clock::duration publishInterval;
+    int eventSock = -1;                 // Subscribed to route changes
+    int dumpSock = -1;                  // For dumps, so their replies never mix with notifications
+    NetlinkReader reader;               // For notifications
+    NetlinkReader dumpReader;
+    MirroredRoutes routes;
+    bool dirty = false;                 // Changes not yet published
+    std::chrono::steady_clock::time_point lastPublish;
+    Rcu<RouteSnapshot> snapshots;
+    std::thread thread;
+    std::atomic<bool> running{false};
+    // Written by the mirror's thread only
+    std::atomic<uint64_t> updates{0};
+    std::atomic<uint64_t> resyncs{0};
+    std::atomic<uint64_t> published{0};
+    std::atomic<size_t> routeCount{0};
+    std::atomic<size_t> routeCount6{0};
+    std::atomic<double> buildMs{0};
+
+    template <typename Counter>
+    static void bump(std::atomic<Counter>& counter, Counter amount = 1) {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    void run() {
+        while (running.load(std::memory_order_relaxed)) {
+            auto now = std::chrono::steady_clock::now();
+            int timeout = MIRROR_POLL_MS;
+            if (dirty) {
+                auto due = std::chrono::duration_cast<std::chrono::milliseconds>(lastPublish + publishInterval - now).count();
+                timeout = due < 0 ? 0 : std::min<int>(timeout, due);
+            }
+            struct pollfd pfd = {eventSock, POLLIN, 0};
+            if (poll(&pfd, 1, timeout) < 0 && errno != EINTR) {
+                perror("poll");
+                break;
+            }
+            if (!drain()) {
+                break;
+            }
+            if (dirty && std::chrono::steady_clock::now() - lastPublish >= publishInterval) {
+                publish();
+            }
+            snapshots.reclaim();
+        }
+        running.store(false);
+    }
+
+    // Apply every queued notification; false if the mirror cannot go on
+    bool drain() {
+        for (;;) {
+            ssize_t len = reader.receive(eventSock);
+            if (len < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return true;
+                }
+                if (errno == ENOBUFS) {
+                    // Notifications were dropped. The kernel reports no further drops until the queue
+                    // empties, so it is emptied before dumping: everything discarded is older than the
+                    // dump, and anything queued after it is newer and replayed on top of it
+                    if (!discard() || !resync()) {
+                        return false;
+                    }
+                    bump(resyncs);
+                    continue;
+                }
+                perror("recv");
+                return false;
+            }
+            const struct nlmsghdr* msg = (const struct nlmsghdr*)reader.getBuffer();
+            for (; NLMSG_OK(msg, len); msg = NLMSG_NEXT(msg, len)) {
+                apply(msg);
+            }
+        }
+    }
+
+    // Throw away every queued notification; false if the socket failed
+    bool discard() {
+        for (;;) {
+            if (reader.receive(eventSock) < 0 && errno != ENOBUFS) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return true;
+                }
+                perror("recv");
+                return false;
+            }
+        }
+    }
+
+    void apply(const struct nlmsghdr* msg) {
+        if (!routes.apply(msg)) {
+            return;
+        }
+        dirty = true;
+        bump(updates);
+        routeCount.store(routes.size(), std::memory_order_relaxed);
+        routeCount6.store(routes.size6(), std::memory_order_relaxed);
+    }
+
+    // Replace the routes with a fresh dump of the kernel's
+    bool resync() {
+        MirroredRoutes dumped(table);
+        for (int attempt = 1;; attempt++) {
+            dumped.clear();
+            bool interrupted = false;
+            for (unsigned char family : {AF_INET, AF_INET6}) {
+                bool changed;
+                if (!dumpReader.dumpRoutes(dumpSock, family, [&](const struct nlmsghdr* msg) { dumped.apply(msg, true); }, changed)) {
+                    return false;
+                }
+                interrupted |= changed;
+            }
+            if (!interrupted) {
+                break;
+            }
+            if (attempt == DUMP_ATTEMPTS) {
+                std::cerr << "Routes kept changing, the mirror may be inconsistent until they change again" << std::endl;
+                break;
+            }
+        }
+        routes = std::move(dumped);
+        dirty = true;
+        bump(updates);
+        routeCount.store(routes.size(), std::memory_order_relaxed);
+        routeCount6.store(routes.size6(), std::memory_order_relaxed);
+        return true;
+    }
+
+    void publish() {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<RouteInfo> current;
+        std::vector<RouteInfo6> current6;
+        routes.copy(current, current6);
+        uint64_t version = published.load(std::memory_order_relaxed) + 1;
+        snapshots.publish(std::make_unique<RouteSnapshot>(std::move(current), std::move(current6), version, getUpdates()));
+        published.store(version, std::memory_order_relaxed);
+        dirty = false;
+        lastPublish = std::chrono::steady_clock::now();
+        buildMs.store(std::chrono::duration<double, std::milli>(lastPublish - start).count(), std::memory_order_relaxed);
+    }
+};
+
+#endif // ROUTEMIRROR_H
@@ -0,0 +1,294 @@
+#ifndef ARBITRATOR_H
+#define ARBITRATOR_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Where a datagram carries its sequence number.
+ */
+struct SequenceField {
+    size_t offset = 0;          // Bytes from the start of the datagram
+    unsigned width = 8;         // 1, 2, 4 or 8 bytes
+    bool bigEndian = true;
+
+    /**
+     * @brief Parse "offset:width[:be|le]", e.g. "0:8:be".
+     * @param text Description.
+     * @return False if the text is not valid.
+     */
+    bool parse(const std::string& text) {
+        char* end;
+        offset = std::strtoul(text.c_str(), &end, 10);
+        if (*end != ':') {
+            return false;
+        }
+        width = std::strtoul(end + 1, &end, 10);
+        if (width != 1 && width != 2 && width != 4 && width != 8) {
+            return false;
+        }
+        std::string order(end);
+        if (order.empty() || order == ":be") {
+            bigEndian = true;
+        } else if (order == ":le") {
+            bigEndian = false;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Read the sequence number from a datagram.
+     * @param data Datagram.
+     * @param length Its length.
+     * @param sequence Set to the sequence number.
+     * @return False if the datagram is too short to hold it.
+     */
+    bool extract(const uint8_t* data, size_t length, uint64_t& sequence) const {
+        if (length < offset + width) {
+            return false;
+        }
+        sequence = 0;
+        for (unsigned i = 0; i < width; i++) {
+            unsigned byte = bigEndian ? i : width - 1 - i;
+            sequence = sequence << 8 | data[offset + byte];
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief Merges redundant copies of one sequenced feed, e.g. its A and B
+ * lines, into a single stream: the first copy of every sequence number is
+ * passed on, later ones are dropped.
+ *
+ * Sequence numbers are tracked in a sliding window of a fixed number of
+ * slots ending at the highest number seen, as a bitmap of those that arrived
+ * plus, for each missing one, when the gap was noticed. A number skipped by
+ * every line so far is a gap; if any line delivers it while it is still in
+ * the window, the gap is recovered and the time since it was noticed recorded.
+ * Numbers still missing when the window moves past them are lost, and copies
+ * older than the window are stale and dropped. Nothing is allocated after
+ * construction and every arrival costs O(1), except that moving the window
+ * forward touches each slot passed.
+ *
+ * Offers must come from one thread; the statistics can be read from any.
+ */
+class Arbitrator {
+public:
+    enum Verdict {
+        FORWARD,        // First copy, at or beyond the head of the stream
+        RECOVERED,      // First copy of a number reported missing; forward it too
+        DUPLICATE,      // Already forwarded
+        STALE           // Too old to tell, dropped
+    };
+
+    /**
+     * @brief Constructor.
+     * @param window Sequence numbers tracked behind the highest one seen, rounded up to a power of two.
+     */
+    explicit Arbitrator(size_t window) {
+        size_t size = 64;
+        while (size < window) {
+            size <<= 1;
+        }
+        this->window = size;
+        mask = size - 1;
+        seen.resize(size / 64);
+        missingSince.resize(size);
+    }
+
+    /**
+     * @brief Decide what to do with a copy of a sequence number.
+     * @param sequence Its sequence number.
+     * @param nowNs When it arrived, in nanoseconds; gaps are timed with it.
+     * @return Whether to forward or drop it.
+     */
+    Verdict offer(uint64_t sequence, uint64_t nowNs) {
+        if (!started) {
+            started = true;
+            first = sequence;
+            high = sequence;
+            mark(sequence);
+            bump(forwarded);
+            return FORWARD;
+        }
+        if (sequence > high) {
+            advance(sequence, nowNs);
+            bump(forwarded);
+            return FORWARD;
+        }
+        if (high - sequence >= window || sequence < first) {
+            bump(stale);
+            return STALE;
+        }
+        if (isSeen(sequence)) {
+            bump(duplicates);
+            return DUPLICATE;
+        }
+        mark(sequence);
+        uint64_t recovery = nowNs > missingSince[sequence & mask] ? nowNs - missingSince[sequence & mask] : 0;
+        bump(recovered);
+        bump(recoveryNsSum, recovery);
+        if (recovery > recoveryNsMax.load(std::memory_order_relaxed)) {
+            recoveryNsMax.store(recovery, std::memory_order_relaxed);
+        }
+        bump(missing, -1);
+        bump(forwarded);
+        return RECOVERED;
+    }
+
+    /**
+     * @brief Get the number of sequence numbers forwarded.
+     * @return Forwarded, including recovered ones.
+     */
+    uint64_t getForwarded() const {
+        return forwarded.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the number of copies dropped as already forwarded.
+     * @return Duplicates.
+     */
+    uint64_t getDuplicates() const {
+        return duplicates.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the number of sequence numbers skipped when they were due.
+     * @return Gaps, each missing number counted once.
+     */
+    uint64_t getGaps() const {
+        return gaps.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the number of gaps filled late.
+     * @return Recovered sequence numbers.
+     */
+    uint64_t getRecovered() const {
+        return recovered.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the total time recovered gaps stayed open.
+     * @return Sum of recovery times in nanoseconds.
+     */
+    uint64_t getRecoveryNsSum() const {
+        return recoveryNsSum.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the longest time a recovered gap stayed open.
+     * @return Recovery time in nanoseconds.
+     */
+    uint64_t getRecoveryNsMax() const {
+        return recoveryNsMax.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the number of sequence numbers that were never recovered before leaving the window.
+     * @return Lost sequence numbers.
+     */
+    uint64_t getLost() const {
+        return lost.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the number of sequence numbers currently missing within the window.
+     * @return Open gaps.
+     */
+    uint64_t getMissing() const {
+        return missing.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the number of copies too old for the window, or from before the first one seen.
+     * @return Stale copies.
+     */
+    uint64_t getStale() const {
+        return stale.load(std::memory_order_relaxed);
+    }
+
+private:
+    size_t window;
+    uint64_t mask;
+    std::vector<uint64_t> seen;             // Bit per slot: the sequence number mapped there arrived
+    std::vector<uint64_t> missingSince;     // Per slot: when its sequence number was found missing
+    bool started = false;
+    uint64_t first = 0;                     // First sequence number seen
+    uint64_t high = 0;                      // Highest sequence number seen
+    // Written by the offering thread only
+    std::atomic<uint64_t> forwarded{0};
+    std::atomic<uint64_t> duplicates{0};
+    std::atomic<uint64_t> gaps{0};
+    std::atomic<uint64_t> recovered{0};
+    std::atomic<uint64_t> recoveryNsSum{0};
+    std::atomic<uint64_t> recoveryNsMax{0};
+    std::atomic<uint64_t> lost{0};
+    std::atomic<uint64_t> missing{0};
+    std::atomic<uint64_t> stale{0};
+
+    static void bump(std::atomic<uint64_t>& counter, uint64_t amount = 1) {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    bool isSeen(uint64_t sequence) const {
+        uint64_t slot = sequence & mask;
+        return seen[slot / 64] >> (slot % 64) & 1;
+    }
+
+    void mark(uint64_t sequence) {
+        uint64_t slot = sequence & mask;
+        seen[slot / 64] |= 1ull << (slot % 64);
+    }
+
+    void clear(uint64_t sequence) {
+        uint64_t slot = sequence & mask;
+        seen[slot / 64] &= ~(1ull << (slot % 64));
+    }
+
+    // Move the head of the window to sequence, marking what it skips as missing
+    void advance(uint64_t sequence, uint64_t nowNs) {
+        uint64_t from = high + 1;
+        if (sequence - high > window) {
+            // The whole window is pushed out at once: whatever it still misses is lost,
+            // and so is everything skipped that never fits in the new one
+            uint64_t lowest = high - first + 1 < window ? first : high - window + 1;
+            uint64_t leaving = 0;
+            for (uint64_t old = lowest; old <= high; old++) {
+                leaving += !isSeen(old);
+            }
+            uint64_t skipped = sequence - window - high;
+            bump(lost, leaving + skipped);
+            bump(gaps, skipped);
+            bump(missing, -leaving);
+            std::fill(seen.begin(), seen.end(), 0);
+            from = sequence - window + 1;
+        } else {
+            // Each slot passed is taken over from the sequence number one window behind
+            for (uint64_t next = from; next <= sequence; next++) {
+                if (next - first >= window && !isSeen(next)) {
+                    bump(lost);
+                    bump(missing, -1);
+                }
+            }
+        }
+        for (uint64_t next = from; next < sequence; next++) {
+            clear(next);
+            missingSince[next & mask] = nowNs;
+        }
+        bump(gaps, sequence - from);
+        bump(missing, sequence - from);
+        mark(sequence);
+        high = sequence;
+    }
+};
+
+#endif // ARBITRATOR_H
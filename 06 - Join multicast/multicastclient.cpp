@@ -1,87 +1,499 @@
 #include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
 #include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <memory>
+#include <tuple>
+#include <unordered_map>
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
 #include <cstring>
+#include <csignal>
 #include <unistd.h>
+#include <poll.h>
+#include <sched.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include "receiveengine.h"
+#include "arbitrator.h"
 
-#define BUFFER_SIZE 1024
+#define DEFAULT_DURATION 100        // Seconds to receive for
+#define DEFAULT_BATCHES 32          // Batches in each worker's receive ring
+#define BATCH_SIZE 64               // Datagrams per batch
+#define DEFAULT_WINDOW 4096         // Sequence numbers each feed's arbitrator tracks
+#define MAX_LINES 4                 // Redundant lines per feed, A to D
 
-// Main function to join a multicast group using Source-Specific Multicast (SSM)
-// and receive data from the group for 100 seconds
-// The program takes three arguments:
-// - Source IP address
-//     The IP address of the source sending the multicast data
-// - Multicast IP address
-// - Port number
-int main(int argc, char* argv[]) {
-    if (argc != 4) {
-        // Print usage if the number of arguments is incorrect
-        std::cerr << "Usage: " << argv[0] << " <source IP> <multicast IP> <port>" << std::endl;
-        return EXIT_FAILURE;
+// Command line options
+struct ClientOptions {
+    int duration = DEFAULT_DURATION;    // 0 runs until interrupted
+    int interval = 1;                   // Seconds between reports
+    int workers = 1;                    // 0 for one per CPU
+    size_t batches = DEFAULT_BATCHES;
+    const char* channelFile = nullptr;
+    bool verbose = false;
+    bool feeds = false;                 // Arbitrate between the lines of each feed
+    SequenceField sequence;
+    size_t window = DEFAULT_WINDOW;
+};
+
+// A channel as typed: source, group, port
+using ChannelKey = std::tuple<uint32_t, uint32_t, uint16_t>;
+
+struct Feed;
+
+// What each channel of a feed hands the consumer as its context
+struct FeedLine {
+    Feed* feed;
+    int line;                                       // 0 for A, 1 for B, ...
+};
+
+// Redundant channels carrying the same sequenced stream, arbitrated on the consumer thread
+// of the one worker that receives them all
+struct Feed {
+    Feed(const std::string& name, size_t worker, size_t window) : name(name), worker(worker), arbitrator(window) {
+        for (int i = 0; i < MAX_LINES; i++) {
+            contexts[i] = {this, i};
+        }
     }
 
-    const char* source_ip = argv[1];
-    const char* multicast_ip = argv[2];
-    int port = std::atoi(argv[3]);
+    std::string name;
+    size_t worker;
+    Arbitrator arbitrator;
+    std::vector<ChannelKey> lines;                  // In the order they were added
+    FeedLine contexts[MAX_LINES];
+    // Written by the consumer thread
+    std::atomic<uint64_t> firsts[MAX_LINES];        // Sequence numbers each line delivered first
+    std::atomic<uint64_t> malformed{0};             // Datagrams too short for the sequence number
+    uint64_t reportedForwarded = 0;                 // At the last report
+};
 
-    int sockfd;
-    struct sockaddr_in local_addr{};
-    struct ip_mreq_source mreq{};
-    char buffer[BUFFER_SIZE];
+// What the last report had seen of a channel, to report the difference
+struct Reported {
+    uint64_t datagrams = 0;
+    uint64_t bytes = 0;
+    uint64_t consumed = 0;
+    uint64_t latencySum = 0;
+};
 
-    // Create UDP socket
-    if ((sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
-        perror("socket");
-        return EXIT_FAILURE;
+volatile sig_atomic_t stopped = 0;
+
+void stop(int) {
+    stopped = 1;
+}
+
+// Counters with a single writer need no atomic read-modify-write
+inline void bump(std::atomic<uint64_t>& counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+// Parse "source group port". Returns false if that is not what the text holds.
+bool parseChannel(std::istringstream& words, struct in_addr& source, struct in_addr& group, uint16_t& port) {
+    std::string sourceText, groupText;
+    int number = 0;
+    if (!(words >> sourceText >> groupText >> number) || number <= 0 || number > 65535 ||
+        inet_pton(AF_INET, sourceText.c_str(), &source) != 1 || inet_pton(AF_INET, groupText.c_str(), &group) != 1 ||
+        !IN_MULTICAST(ntohl(group.s_addr))) {
+        return false;
     }
+    port = number;
+    return true;
+}
 
-    // Bind the socket to any local address and the specified port
-    local_addr.sin_family = AF_INET;
-    local_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    local_addr.sin_port = htons(port);
+// Spreads channels over the workers and remembers which one has each, so it can be left again
+class Subscriber {
+public:
+    Subscriber(std::vector<std::unique_ptr<ReceiveEngine>>& engines, const ClientOptions& options)
+        : engines(engines), options(options), load(engines.size()) {}
 
-    if (bind(sockfd, (struct sockaddr*)&local_addr, sizeof(local_addr)) < 0) {
-        perror("bind");
-        close(sockfd);
-        return EXIT_FAILURE;
+    // With feeds, a channel without a feed name is a feed of its own
+    void join(struct in_addr source, struct in_addr group, uint16_t port, std::string feedName) {
+        ChannelKey key{source.s_addr, group.s_addr, port};
+        if (owners.count(key)) {
+            std::cerr << "Already joined " << describe(source, group, port) << std::endl;
+            return;
+        }
+        size_t worker = leastLoaded();
+        void* context = nullptr;
+        if (options.feeds) {
+            if (feedName.empty()) {
+                feedName = describe(source, group, port);
+            }
+            auto found = feeds.find(feedName);
+            if (found == feeds.end()) {
+                found = feeds.emplace(feedName, std::make_unique<Feed>(feedName, worker, options.window)).first;
+            }
+            Feed* feed = found->second.get();
+            // Rejoining keeps the line a channel had
+            auto line = std::find(feed->lines.begin(), feed->lines.end(), key);
+            if (line == feed->lines.end()) {
+                if (feed->lines.size() == MAX_LINES) {
+                    std::cerr << "Feed " << feedName << " already has " << MAX_LINES << " lines" << std::endl;
+                    return;
+                }
+                line = feed->lines.insert(feed->lines.end(), key);
+            }
+            // The arbitrator is not thread-safe, so every line goes to the feed's worker
+            worker = feed->worker;
+            context = &feed->contexts[line - feed->lines.begin()];
+        }
+        owners[key] = worker;
+        ++load[worker];
+        engines[worker]->join(source, group, port, context);
+    }
+
+    void leave(struct in_addr source, struct in_addr group, uint16_t port) {
+        auto found = owners.find(ChannelKey{source.s_addr, group.s_addr, port});
+        if (found == owners.end()) {
+            std::cerr << "Not joined to " << describe(source, group, port) << std::endl;
+            return;
+        }
+        engines[found->second]->leave(source, group, port);
+        --load[found->second];
+        owners.erase(found);
+    }
+
+    size_t size() const {
+        return owners.size();
+    }
+
+    const std::map<std::string, std::unique_ptr<Feed>>& getFeeds() const {
+        return feeds;
+    }
+
+    static std::string describe(struct in_addr source, struct in_addr group, uint16_t port) {
+        char sourceText[INET_ADDRSTRLEN], groupText[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &source, sourceText, sizeof(sourceText));
+        inet_ntop(AF_INET, &group, groupText, sizeof(groupText));
+        return std::string("(") + sourceText + ", " + groupText + ") port " + std::to_string(port);
+    }
+
+private:
+    std::vector<std::unique_ptr<ReceiveEngine>>& engines;
+    const ClientOptions& options;
+    std::vector<size_t> load;                       // Channels per worker
+    std::map<ChannelKey, size_t> owners;
+    std::map<std::string, std::unique_ptr<Feed>> feeds;
+
+    size_t leastLoaded() const {
+        size_t worker = 0;
+        for (size_t i = 1; i < load.size(); i++) {
+            if (load[i] < load[worker]) {
+                worker = i;
+            }
+        }
+        return worker;
+    }
+};
+
+// Apply one line of commands from standard input: "join S G port [feed]", "leave S G port"
+void runCommand(const std::string& line, Subscriber& subscriber) {
+    std::istringstream words(line);
+    std::string verb;
+    if (!(words >> verb)) {
+        return;
+    }
+    struct in_addr source, group;
+    uint16_t port;
+    if ((verb != "join" && verb != "leave") || !parseChannel(words, source, group, port)) {
+        std::cerr << "Commands: join <source IP> <multicast IP> <port> [feed], leave <source IP> <multicast IP> <port>" << std::endl;
+        return;
     }
+    if (verb == "join") {
+        std::string feedName;
+        words >> feedName;
+        subscriber.join(source, group, port, feedName);
+        std::cout << "Joining " << Subscriber::describe(source, group, port) << std::endl;
+    } else {
+        subscriber.leave(source, group, port);
+        std::cout << "Leaving " << Subscriber::describe(source, group, port) << std::endl;
+    }
+}
 
-    // Join the multicast group using Source-Specific Multicast (SSM)
-    mreq.imr_multiaddr.s_addr = inet_addr(multicast_ip);
-    mreq.imr_sourceaddr.s_addr = inet_addr(source_ip);
-    mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+// Join every channel listed in a file, one "source group port [feed]" per line; # starts a comment
+bool readChannelFile(const char* path, Subscriber& subscriber) {
+    std::ifstream file(path);
+    if (!file) {
+        perror(path);
+        return false;
+    }
+    std::string line;
+    int number = 0;
+    while (std::getline(file, line)) {
+        ++number;
+        line = line.substr(0, line.find('#'));
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+        std::istringstream words(line);
+        struct in_addr source, group;
+        uint16_t port;
+        if (!parseChannel(words, source, group, port)) {
+            std::cerr << path << ":" << number << ": expected <source IP> <multicast IP> <port> [feed]" << std::endl;
+            return false;
+        }
+        std::string feedName;
+        words >> feedName;
+        subscriber.join(source, group, port, feedName);
+    }
+    return true;
+}
 
-    if (setsockopt(sockfd, IPPROTO_IP, IP_ADD_SOURCE_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
-        perror("setsockopt");
-        close(sockfd);
+void report(std::vector<std::unique_ptr<ReceiveEngine>>& engines, const Subscriber& subscriber, std::unordered_map<Channel*, Reported>& reported,
+            double seconds) {
+    uint64_t received = 0, drops = 0, truncated = 0, unmatched = 0, stalls = 0;
+    size_t depth = 0, peak = 0, capacity = 0;
+    for (auto& engine : engines) {
+        engine->forEachChannel([&](Channel& channel) {
+            Reported& last = reported[&channel];
+            uint64_t datagrams = channel.datagrams.load(std::memory_order_relaxed);
+            uint64_t bytes = channel.bytes.load(std::memory_order_relaxed);
+            uint64_t consumed = channel.consumed.load(std::memory_order_relaxed);
+            uint64_t latencySum = channel.latencySum.load(std::memory_order_relaxed);
+            uint64_t latencyMax = channel.latencyMax.exchange(0, std::memory_order_relaxed);
+            // Channels left earlier stay quiet once their last datagrams are reported
+            if (channel.joined.load(std::memory_order_relaxed) || datagrams != last.datagrams) {
+                uint64_t count = consumed - last.consumed;
+                std::cout << "  " << std::left << std::setw(40) << Subscriber::describe(channel.source, channel.group, channel.port) << std::right
+                          << std::fixed << std::setprecision(0) << std::setw(9) << (datagrams - last.datagrams) / seconds << " datagrams/s, "
+                          << std::setprecision(1) << std::setw(8) << (bytes - last.bytes) * 8 / seconds / 1e6 << " Mbit/s, consumed after "
+                          << (count ? (latencySum - last.latencySum) / count / 1e3 : 0) << " us on average, " << latencyMax / 1e3 << " us at most";
+                FeedLine* line = static_cast<FeedLine*>(channel.context.load(std::memory_order_relaxed));
+                if (line != nullptr) {
+                    std::cout << ", feed " << line->feed->name << " line " << (char)('A' + line->line);
+                }
+                std::cout << (channel.joined.load(std::memory_order_relaxed) ? "" : " (left)") << std::endl;
+            }
+            last = {datagrams, bytes, consumed, latencySum};
+        });
+        received += engine->getDatagrams();
+        drops += engine->getDrops();
+        truncated += engine->getTruncated();
+        unmatched += engine->getUnmatched();
+        stalls += engine->getStalls();
+        depth += engine->getQueueDepth();
+        peak = std::max(peak, engine->getPeakDepth());
+        capacity += engine->getBatches();
+    }
+    for (auto& [name, feed] : subscriber.getFeeds()) {
+        const Arbitrator& arbitrator = feed->arbitrator;
+        uint64_t forwarded = arbitrator.getForwarded();
+        uint64_t recovered = arbitrator.getRecovered();
+        std::cout << "  feed " << name << ": " << std::setprecision(0) << (forwarded - feed->reportedForwarded) / seconds << " forwarded/s; "
+                  << arbitrator.getDuplicates() << " duplicates, " << arbitrator.getGaps() << " gaps, " << recovered << " recovered after "
+                  << std::setprecision(1) << (recovered ? arbitrator.getRecoveryNsSum() / recovered / 1e3 : 0) << " us on average, "
+                  << arbitrator.getRecoveryNsMax() / 1e3 << " us at most, " << arbitrator.getLost() << " lost, " << arbitrator.getMissing()
+                  << " missing, " << arbitrator.getStale() << " stale, " << feed->malformed.load(std::memory_order_relaxed) << " malformed; first from";
+        for (size_t i = 0; i < feed->lines.size(); i++) {
+            std::cout << (i ? ", " : " ") << (char)('A' + i) << " " << (forwarded ? 100.0 * feed->firsts[i].load(std::memory_order_relaxed) / forwarded : 0) << "%";
+        }
+        std::cout << std::endl;
+        feed->reportedForwarded = forwarded;
+    }
+    std::cout << "  " << received << " datagrams received in all, " << drops << " dropped, " << truncated << " truncated, "
+              << unmatched << " unmatched; queues " << depth << " of " << capacity << " batches (peak " << peak << " in one worker), "
+              << stalls << " stalls" << std::endl;
+}
+
+// Subscribes to any number of Source-Specific Multicast (SSM) channels, each
+// a source IP address, a multicast group and a port, and receives from them
+// for 100 seconds, or as long as -d says. Channels come from the command line
+// (one, for compatibility), from a file given with -f, and from commands on
+// standard input while running:
+//     join <source IP> <multicast IP> <port>
+//     leave <source IP> <multicast IP> <port>
+// Channels are spread over -w workers, each a ReceiveEngine (see
+// receiveengine.h) with one epoll loop pinned to its own CPU. Datagrams are
+// counted on the engines' consumer threads; -v prints every payload as well.
+// Every -i seconds a report lists each channel's rate and how long its
+// datagrams took from arrival to the consumer, followed by drops and queue
+// depths.
+//
+// With -s, naming where each datagram carries its sequence number, the client
+// is a feed handler: channels given the same feed name, in the file or a join
+// command, are redundant lines of one feed, e.g. its A and B sides. Only the
+// first copy of each sequence number is passed on; an Arbitrator (see
+// arbitrator.h) counts duplicates, gaps, how long gaps took to be filled by
+// another line and what was lost, and the report adds how often each line won.
+//
+// Build: g++ -std=c++20 -O2 -pthread -o multicastclient multicastclient.cpp
+int main(int argc, char* argv[]) {
+    ClientOptions options;
+    int opt;
+    bool valid = true;
+    while ((opt = getopt(argc, argv, "d:i:w:b:f:s:W:v")) != -1) {
+        switch (opt) {
+            case 'd':
+                options.duration = std::atoi(optarg);
+                break;
+            case 'i':
+                options.interval = std::atoi(optarg);
+                break;
+            case 'w':
+                options.workers = std::atoi(optarg);
+                break;
+            case 'b':
+                options.batches = std::atoi(optarg);
+                break;
+            case 'f':
+                options.channelFile = optarg;
+                break;
+            case 's':
+                options.feeds = true;
+                valid = valid && options.sequence.parse(optarg);
+                break;
+            case 'W':
+                options.window = std::atoi(optarg);
+                break;
+            case 'v':
+                options.verbose = true;
+                break;
+            default:
+                valid = false;
+        }
+    }
+    int positional = argc - optind;
+    if (!valid || (positional != 0 && positional != 3) || options.duration < 0 || options.interval <= 0 ||
+        options.workers < 0 || options.batches == 0 || options.window == 0) {
+        // Print usage if the arguments are incorrect
+        std::cerr << "Usage: " << argv[0] << " [-d seconds, 0 until interrupted] [-i report seconds] [-w workers, 0 for one per CPU]"
+                  << " [-b batches of " << BATCH_SIZE << " datagrams] [-f channel file] [-s sequence offset:bytes[:be|le] [-W window]] [-v]"
+                  << " [<source IP> <multicast IP> <port>]" << std::endl
+                  << "A channel file has one \"<source IP> <multicast IP> <port> [feed]\" per line; while running, standard input takes" << std::endl
+                  << "\"join <source IP> <multicast IP> <port> [feed]\" and \"leave <source IP> <multicast IP> <port>\"." << std::endl;
         return EXIT_FAILURE;
     }
 
-    std::cout << "Joined multicast group " << multicast_ip << " from source " << source_ip << " on port " << port << std::endl;
+    // CPUs this process may run on; with -w 0 there is one worker per CPU
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    std::vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed)) {
+            cpus.push_back(cpu);
+        }
+    }
+    if (options.workers == 0) {
+        options.workers = cpus.size();
+    }
 
-    // Receive data from the multicast group for 100 seconds
-    time_t start_time = time(nullptr);
-    while (time(nullptr) - start_time < 100) {
-        ssize_t n = recv(sockfd, buffer, BUFFER_SIZE, 0);
-        if (n < 0) {
-            perror("recv");
-            break;
+    auto consumer = [&options](const Datagram* datagrams, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            const Datagram& datagram = datagrams[i];
+            FeedLine* line = static_cast<FeedLine*>(datagram.channel->context.load(std::memory_order_relaxed));
+            uint64_t sequence = 0;
+            if (line != nullptr) {
+                Feed& feed = *line->feed;
+                if (!options.sequence.extract(datagram.data, datagram.length, sequence)) {
+                    bump(feed.malformed);
+                    continue;
+                }
+                // Arbitrated with the arrival time, so gaps are timed without the queueing delay
+                Arbitrator::Verdict verdict = feed.arbitrator.offer(sequence, datagram.receivedNs);
+                if (verdict != Arbitrator::FORWARD && verdict != Arbitrator::RECOVERED) {
+                    continue;
+                }
+                bump(feed.firsts[line->line]);
+            }
+            // Passed on: every datagram, or with feeds the first copy of each sequence number
+            if (options.verbose) {
+                std::cout << Subscriber::describe(datagram.channel->source, datagram.channel->group, datagram.channel->port);
+                if (line != nullptr) {
+                    std::cout << " feed " << line->feed->name << " sequence " << sequence;
+                }
+                std::cout << ": " << std::string(reinterpret_cast<const char*>(datagram.data), datagram.length) << '\n';
+            }
+        }
+    };
+
+    std::vector<std::unique_ptr<ReceiveEngine>> engines;
+    for (int i = 0; i < options.workers; i++) {
+        engines.push_back(std::make_unique<ReceiveEngine>(options.batches, BATCH_SIZE));
+        // A single worker keeps the original behaviour with no affinity
+        if (!engines.back()->start(consumer, options.workers == 1 ? -1 : cpus[i % cpus.size()])) {
+            return EXIT_FAILURE;
         }
-        std::cout << "Received data: " << std::string(buffer, n) << std::endl;
     }
 
-    // Leave the multicast group
-    if (setsockopt(sockfd, IPPROTO_IP, IP_DROP_SOURCE_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
-        perror("setsockopt");
-        close(sockfd);
+    Subscriber subscriber(engines, options);
+    if (positional == 3) {
+        std::istringstream words(std::string(argv[optind]) + " " + argv[optind + 1] + " " + argv[optind + 2]);
+        struct in_addr source, group;
+        uint16_t port;
+        if (!parseChannel(words, source, group, port)) {
+            std::cerr << "Invalid channel " << argv[optind] << " " << argv[optind + 1] << " " << argv[optind + 2] << std::endl;
+            return EXIT_FAILURE;
+        }
+        subscriber.join(source, group, port, "");
+    }
+    if (options.channelFile != nullptr && !readChannelFile(options.channelFile, subscriber)) {
         return EXIT_FAILURE;
     }
+    std::cout << "Joining " << subscriber.size() << " channels with " << options.workers << " workers" << std::endl;
 
-    std::cout << "Left multicast group " << multicast_ip << std::endl;
+    // An interrupt ends the wait for input or the next report
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    // Receive until the duration is up, taking commands and reporting every interval
+    auto start = std::chrono::steady_clock::now();
+    auto end = start + std::chrono::seconds(options.duration);
+    auto nextReport = start + std::chrono::seconds(options.interval);
+    auto lastReport = start;
+    std::unordered_map<Channel*, Reported> reported;
+    std::string input;
+    bool inputOpen = true;
+    while (!stopped) {
+        auto now = std::chrono::steady_clock::now();
+        if (options.duration > 0 && now >= end) {
+            break;
+        }
+        if (now >= nextReport) {
+            std::cout << "After " << std::chrono::duration_cast<std::chrono::seconds>(now - start).count() << " s:" << std::endl;
+            report(engines, subscriber, reported, std::chrono::duration<double>(now - lastReport).count());
+            lastReport = now;
+            nextReport += std::chrono::seconds(options.interval);
+            continue;
+        }
+        auto wait = nextReport;
+        if (options.duration > 0 && end < wait) {
+            wait = end;
+        }
+        struct pollfd stdinPoll = {STDIN_FILENO, POLLIN, 0};
+        int timeout = std::chrono::duration_cast<std::chrono::milliseconds>(wait - now).count() + 1;
+        if (poll(&stdinPoll, inputOpen ? 1 : 0, timeout) <= 0 || !inputOpen) {
+            continue;
+        }
+        char buffer[4096];
+        ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
+        if (n <= 0) {
+            inputOpen = false;
+            continue;
+        }
+        input.append(buffer, n);
+        size_t newline;
+        while ((newline = input.find('\n')) != std::string::npos) {
+            runCommand(input.substr(0, newline), subscriber);
+            input.erase(0, newline + 1);
+        }
+    }
 
-    close(sockfd);
+    // Stopping closes the workers' sockets, which leaves every group
+    for (auto& engine : engines) {
+        engine->stop();
+    }
+    auto now = std::chrono::steady_clock::now();
+    std::cout << "Last " << std::fixed << std::setprecision(1) << std::chrono::duration<double>(now - lastReport).count() << " s:" << std::endl;
+    report(engines, subscriber, reported, std::chrono::duration<double>(now - lastReport).count());
+    std::cout << "Left " << subscriber.size() << " channels" << std::endl;
     return EXIT_SUCCESS;
 }
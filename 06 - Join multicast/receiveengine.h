@@ -0,0 +1,654 @@
+#ifndef RECEIVEENGINE_H
+#define RECEIVEENGINE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include "spscqueue.h"
+
+#define DATAGRAM_SIZE 9216      // Room for a jumbo frame's payload
+#define RECEIVE_TIMEOUT_MS 100
+#define MAX_EVENTS 64
+#define PORT_RECEIVE_BUFFER (4 << 20)   // Per port socket, capped by net.core.rmem_max
+
+/**
+ * @brief One source-specific multicast channel, (S,G) on a UDP port, and what
+ * was received on it.
+ *
+ * Channels are created by the first ReceiveEngine::join() and live as long as
+ * the engine, so a pointer to one stays valid after leaving it; joining it
+ * again reuses the same object.
+ */
+struct Channel {
+    struct in_addr source;
+    struct in_addr group;
+    uint16_t port;                          // Host byte order
+    std::atomic<void*> context{nullptr};    // From the latest join(), for the consumer
+    std::atomic<bool> joined{false};
+    // Written by the receiving thread
+    std::atomic<uint64_t> datagrams{0};
+    std::atomic<uint64_t> bytes{0};
+    // Written by the consuming thread: delay from the kernel's receive timestamp to the consumer, in ns
+    std::atomic<uint64_t> consumed{0};
+    std::atomic<uint64_t> latencySum{0};
+    std::atomic<uint64_t> latencyMax{0};    // Whoever reports may exchange it for 0
+};
+
+/**
+ * @brief One received datagram, valid until the consumer callback returns.
+ */
+struct Datagram {
+    const uint8_t* data;
+    size_t length;              // Bytes at data
+    bool truncated;             // Longer than DATAGRAM_SIZE; the rest was discarded
+    Channel* channel;
+    uint64_t receivedNs;        // Kernel receive timestamp, CLOCK_REALTIME
+};
+
+/**
+ * @brief Receives datagrams from any number of multicast channels on one
+ * thread and hands them in batches to a callback on another.
+ *
+ * The receiving thread runs a single epoll loop over one socket per UDP port,
+ * shared by every channel on that port: each joins its (S,G) on the port's
+ * socket, and datagrams are told apart by their source address and, through
+ * IP_PKTINFO, the group they were sent to. IP_MULTICAST_ALL is off, so a
+ * socket only gets the groups it joined itself and several engines can serve
+ * different channels on the same port. Joins and leaves are queued from any
+ * thread and carried out by the receiving thread, which owns the sockets;
+ * leaving one channel does not touch the others on its socket.
+ *
+ * Ready sockets are read with recvmmsg() straight into a ring of preallocated
+ * DATAGRAM_SIZE buffers, filling a batch from as many sockets as are ready,
+ * and each batch goes to the consuming thread through a lock-free queue. The
+ * consumer returns the batch once the callback is done with it. If the
+ * consumer falls behind until every batch is queued, the receiver waits for
+ * one to come back and the sockets' receive buffers absorb the backlog; what
+ * overflows those is dropped by the kernel and reported through SO_RXQ_OVFL.
+ */
+class ReceiveEngine {
+public:
+    /**
+     * @brief Callback run on the consuming thread for every batch.
+     */
+    using Consumer = std::function<void(const Datagram* datagrams, size_t count)>;
+
+    /**
+     * @brief Constructor.
+     * @param batches Number of batches in the ring.
+     * @param batchSize Datagrams per batch.
+     */
+    ReceiveEngine(size_t batches, size_t batchSize)
+        : batchSize(batchSize), ring(batches), filled(batches), spare(batches) {
+    }
+
+    ReceiveEngine(const ReceiveEngine&) = delete;
+    ReceiveEngine& operator=(const ReceiveEngine&) = delete;
+
+    ~ReceiveEngine() {
+        stop();
+        if (buffers != nullptr) {
+            munmap(buffers, ring.size() * batchSize * DATAGRAM_SIZE);
+        }
+        if (epollFd >= 0) {
+            close(epollFd);
+        }
+        if (wakeFd >= 0) {
+            close(wakeFd);
+        }
+    }
+
+    /**
+     * @brief Allocate the ring and start both threads.
+     * @param consumer Callback for every batch.
+     * @param cpu CPU to pin the receiving thread to, or -1 to leave it to the scheduler.
+     * @return False, after printing the reason, on failure.
+     */
+    bool start(Consumer consumer, int cpu) {
+        this->consumer = std::move(consumer);
+        if ((epollFd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+            perror("epoll_create1");
+            return false;
+        }
+        if ((wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+            perror("eventfd");
+            return false;
+        }
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = nullptr;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event) < 0) {
+            perror("epoll_ctl");
+            return false;
+        }
+
+        void* memory = mmap(nullptr, ring.size() * batchSize * DATAGRAM_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            perror("mmap receive ring");
+            return false;
+        }
+        buffers = static_cast<uint8_t*>(memory);
+        for (size_t i = 0; i < ring.size(); i++) {
+            Batch& batch = ring[i];
+            batch.messages.resize(batchSize);
+            batch.iovecs.resize(batchSize);
+            batch.sources.resize(batchSize);
+            batch.controls.resize(batchSize * CONTROL_WORDS);
+            batch.datagrams.resize(batchSize);
+            for (size_t j = 0; j < batchSize; j++) {
+                batch.iovecs[j].iov_base = buffers + (i * batchSize + j) * DATAGRAM_SIZE;
+                batch.iovecs[j].iov_len = DATAGRAM_SIZE;
+            }
+            spare.push(i);
+        }
+
+        receiver = std::thread(&ReceiveEngine::receive, this);
+        if (cpu >= 0) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(cpu, &cpus);
+            pthread_setaffinity_np(receiver.native_handle(), sizeof(cpus), &cpus);
+        }
+        dispatcher = std::thread(&ReceiveEngine::dispatch, this);
+        return true;
+    }
+
+    /**
+     * @brief Subscribe to a channel. Carried out asynchronously by the receiving thread, which prints failures.
+     * @param source Source address.
+     * @param group Multicast group address.
+     * @param port UDP port, host byte order.
+     * @param context Stored in Channel::context before the first datagram reaches the consumer.
+     */
+    void join(struct in_addr source, struct in_addr group, uint16_t port, void* context = nullptr) {
+        post({true, source, group, port, context});
+    }
+
+    /**
+     * @brief Unsubscribe from a channel. Carried out asynchronously by the receiving thread.
+     * @param source Source address.
+     * @param group Multicast group address.
+     * @param port UDP port, host byte order.
+     */
+    void leave(struct in_addr source, struct in_addr group, uint16_t port) {
+        post({false, source, group, port, nullptr});
+    }
+
+    /**
+     * @brief Stop receiving, let the consumer finish the batches already received and join both threads.
+     * Closing the sockets leaves every channel.
+     */
+    void stop() {
+        stopping.store(true, std::memory_order_relaxed);
+        if (receiver.joinable()) {
+            receiver.join();
+        }
+        if (dispatcher.joinable()) {
+            dispatcher.join();
+        }
+    }
+
+    /**
+     * @brief Call a function for every channel ever joined, in the order they were first joined.
+     * @param function Called with each channel; must not join or leave.
+     */
+    void forEachChannel(const std::function<void(Channel&)>& function) {
+        std::lock_guard<std::mutex> lock(channelsMutex);
+        for (auto& channel : channels) {
+            function(*channel);
+        }
+    }
+
+    /**
+     * @brief Get the number of datagrams received.
+     * @return Datagrams, including any that matched no joined channel.
+     */
+    uint64_t getDatagrams() const {
+        return datagrams.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the number of payload bytes received.
+     * @return Bytes, not counting what truncation discarded.
+     */
+    uint64_t getBytes() const {
+        return bytes.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the number of datagrams that matched no joined channel, e.g. still queued when it was left.
+     * @return Unmatched datagrams, which are not passed to the consumer.
+     */
+    uint64_t getUnmatched() const {
+        return unmatched.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the number of datagrams the kernel dropped because a socket's receive buffer was full.
+     * @return Drops since start(), as far as the last datagram received on each socket reported them.
+     */
+    uint64_t getDrops() const {
+        return drops.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the number of datagrams longer than DATAGRAM_SIZE.
+     * @return Truncated datagrams.
+     */
+    uint64_t getTruncated() const {
+        return truncated.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the number of times the receiver found every batch queued and had to wait for the consumer.
+     * @return Stalls.
+     */
+    uint64_t getStalls() const {
+        return stalls.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the number of filled batches waiting for the consumer.
+     * @return Queue depth.
+     */
+    size_t getQueueDepth() const {
+        return filled.size();
+    }
+
+    /**
+     * @brief Get the highest queue depth seen.
+     * @return Peak queue depth.
+     */
+    size_t getPeakDepth() const {
+        return peakDepth.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the number of batches in the ring.
+     * @return Batches.
+     */
+    size_t getBatches() const {
+        return ring.size();
+    }
+
+private:
+    // recvmmsg() arguments and results for one batch of buffers
+    struct Batch {
+        std::vector<struct mmsghdr> messages;
+        std::vector<struct iovec> iovecs;
+        std::vector<struct sockaddr_in> sources;
+        std::vector<uint64_t> controls;     // CONTROL_WORDS per message
+        std::vector<Datagram> datagrams;    // The ones that matched a channel, in order
+        size_t count = 0;
+    };
+
+    // The socket every channel on one UDP port shares
+    struct Port {
+        int sockfd;
+        uint16_t port;
+        std::unordered_map<uint64_t, Channel*> channels;    // Joined ones, by source << 32 | group
+        uint32_t lastOverflow = 0;
+    };
+
+    struct Command {
+        bool join;
+        struct in_addr source;
+        struct in_addr group;
+        uint16_t port;
+        void* context;
+    };
+
+    static constexpr size_t END = SIZE_MAX; // Queued after the last batch
+    // Room for SO_RXQ_OVFL, IP_PKTINFO and SO_TIMESTAMPNS
+    static constexpr size_t CONTROL_WORDS = (CMSG_SPACE(sizeof(uint32_t)) + CMSG_SPACE(sizeof(struct in_pktinfo)) +
+                                             CMSG_SPACE(sizeof(struct timespec)) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    size_t batchSize;
+    std::vector<Batch> ring;
+    SpscQueue<size_t> filled;               // Receiver to consumer, filled batches
+    SpscQueue<size_t> spare;                // Consumer to receiver, batches to reuse
+    uint8_t* buffers = nullptr;             // ring.size() * batchSize buffers of DATAGRAM_SIZE bytes
+    int epollFd = -1;
+    int wakeFd = -1;                        // Signalled when commands are queued
+    Consumer consumer;
+    std::thread receiver;
+    std::thread dispatcher;
+    std::mutex commandsMutex;
+    std::vector<Command> commands;
+    std::mutex channelsMutex;               // Guards adding to channels against forEachChannel()
+    std::vector<std::unique_ptr<Channel>> channels;
+    std::unordered_map<uint16_t, std::unique_ptr<Port>> ports;  // Receiving thread only
+    std::atomic<bool> stopping{false};
+    std::atomic<uint64_t> datagrams{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> unmatched{0};
+    std::atomic<uint64_t> drops{0};
+    std::atomic<uint64_t> truncated{0};
+    std::atomic<uint64_t> stalls{0};
+    std::atomic<size_t> peakDepth{0};
+
+    static uint64_t channelKey(struct in_addr source, struct in_addr group) {
+        return (uint64_t)source.s_addr << 32 | group.s_addr;
+    }
+
+    void post(const Command& command) {
+        {
+            std::lock_guard<std::mutex> lock(commandsMutex);
+            commands.push_back(command);
+        }
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) < 0) {
+            perror("write eventfd");
+        }
+    }
+
+    // Socket for a port, opened on the first channel joined on it. Returns nullptr after printing the reason.
+    Port* openPort(uint16_t port) {
+        auto found = ports.find(port);
+        if (found != ports.end()) {
+            return found->second.get();
+        }
+        int sockfd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (sockfd < 0) {
+            perror("socket");
+            return nullptr;
+        }
+        int on = 1;
+        int off = 0;
+        int size = PORT_RECEIVE_BUFFER;
+        // Every engine has its own socket on a port and only receives the channels it joined
+        setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        if (setsockopt(sockfd, IPPROTO_IP, IP_MULTICAST_ALL, &off, sizeof(off)) < 0 ||
+            setsockopt(sockfd, IPPROTO_IP, IP_PKTINFO, &on, sizeof(on)) < 0 ||
+            setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0 ||
+            setsockopt(sockfd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) < 0) {
+            perror("setsockopt");
+            close(sockfd);
+            return nullptr;
+        }
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(port);
+        if (bind(sockfd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+            perror("bind");
+            close(sockfd);
+            return nullptr;
+        }
+        auto entry = std::make_unique<Port>();
+        entry->sockfd = sockfd;
+        entry->port = port;
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = entry.get();
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, sockfd, &event) < 0) {
+            perror("epoll_ctl");
+            close(sockfd);
+            return nullptr;
+        }
+        return (ports[port] = std::move(entry)).get();
+    }
+
+    void closePort(Port* port) {
+        // Closing drops whatever memberships are left
+        close(port->sockfd);
+        ports.erase(port->port);
+    }
+
+    Channel* findChannel(const Command& command, bool create) {
+        std::lock_guard<std::mutex> lock(channelsMutex);
+        for (auto& channel : channels) {
+            if (channel->source.s_addr == command.source.s_addr && channel->group.s_addr == command.group.s_addr && channel->port == command.port) {
+                return channel.get();
+            }
+        }
+        if (!create) {
+            return nullptr;
+        }
+        channels.push_back(std::make_unique<Channel>());
+        Channel* channel = channels.back().get();
+        channel->source = command.source;
+        channel->group = command.group;
+        channel->port = command.port;
+        return channel;
+    }
+
+    void runCommands() {
+        uint64_t value;
+        if (read(wakeFd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+            perror("read eventfd");
+        }
+        std::vector<Command> pending;
+        {
+            std::lock_guard<std::mutex> lock(commandsMutex);
+            pending.swap(commands);
+        }
+        for (const Command& command : pending) {
+            struct ip_mreq_source mreq{};
+            mreq.imr_multiaddr = command.group;
+            mreq.imr_sourceaddr = command.source;
+            mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+            uint64_t key = channelKey(command.source, command.group);
+
+            if (command.join) {
+                Channel* channel = findChannel(command, true);
+                if (channel->joined.load(std::memory_order_relaxed)) {
+                    continue;
+                }
+                Port* port = openPort(command.port);
+                if (port == nullptr) {
+                    continue;
+                }
+                // Reaches the consumer ahead of the channel's datagrams through the queue
+                channel->context.store(command.context, std::memory_order_relaxed);
+                if (setsockopt(port->sockfd, IPPROTO_IP, IP_ADD_SOURCE_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+                    perror("setsockopt IP_ADD_SOURCE_MEMBERSHIP");
+                    if (port->channels.empty()) {
+                        closePort(port);
+                    }
+                    continue;
+                }
+                port->channels[key] = channel;
+                channel->joined.store(true, std::memory_order_relaxed);
+            } else {
+                Channel* channel = findChannel(command, false);
+                auto found = ports.find(command.port);
+                if (channel == nullptr || !channel->joined.load(std::memory_order_relaxed) || found == ports.end()) {
+                    continue;
+                }
+                Port* port = found->second.get();
+                if (setsockopt(port->sockfd, IPPROTO_IP, IP_DROP_SOURCE_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+                    perror("setsockopt IP_DROP_SOURCE_MEMBERSHIP");
+                }
+                port->channels.erase(key);
+                channel->joined.store(false, std::memory_order_relaxed);
+                if (port->channels.empty()) {
+                    closePort(port);
+                }
+            }
+        }
+    }
+
+    // Read what a ready socket has into the rest of the batch. Returns the number of messages read.
+    size_t receiveFrom(Port* port, Batch& batch, size_t first) {
+        for (size_t i = first; i < batchSize; i++) {
+            struct msghdr& msg = batch.messages[i].msg_hdr;
+            msg.msg_name = &batch.sources[i];
+            msg.msg_namelen = sizeof(batch.sources[i]);
+            msg.msg_iov = &batch.iovecs[i];
+            msg.msg_iovlen = 1;
+            msg.msg_control = &batch.controls[i * CONTROL_WORDS];
+            msg.msg_controllen = CONTROL_WORDS * sizeof(uint64_t);
+            msg.msg_flags = 0;
+        }
+        int count = recvmmsg(port->sockfd, &batch.messages[first], batchSize - first, MSG_DONTWAIT, nullptr);
+        if (count < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("recvmmsg");
+            }
+            return 0;
+        }
+
+        uint64_t received = 0;
+        uint64_t cut = 0;
+        uint64_t stray = 0;
+        for (size_t i = first; i < first + count; i++) {
+            const struct msghdr& msg = batch.messages[i].msg_hdr;
+            size_t length = batch.messages[i].msg_len;
+            bool truncated = (msg.msg_flags & MSG_TRUNC) != 0;
+            received += length;
+            cut += truncated;
+
+            struct in_addr group{};
+            uint64_t receivedNs = 0;
+            for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(const_cast<struct msghdr*>(&msg), cmsg)) {
+                if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO) {
+                    struct in_pktinfo info;
+                    memcpy(&info, CMSG_DATA(cmsg), sizeof(info));
+                    group = info.ipi_addr;
+                } else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_TIMESTAMPNS) {
+                    struct timespec ts;
+                    memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+                    receivedNs = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+                } else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+                    // The counter is the socket's running total of drops; only the newest value matters
+                    uint32_t overflow;
+                    memcpy(&overflow, CMSG_DATA(cmsg), sizeof(overflow));
+                    drops.fetch_add(overflow - port->lastOverflow, std::memory_order_relaxed);
+                    port->lastOverflow = overflow;
+                }
+            }
+
+            auto found = port->channels.find(channelKey(batch.sources[i].sin_addr, group));
+            if (found == port->channels.end()) {
+                ++stray;
+                continue;
+            }
+            Channel* channel = found->second;
+            channel->datagrams.store(channel->datagrams.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            channel->bytes.store(channel->bytes.load(std::memory_order_relaxed) + length, std::memory_order_relaxed);
+            batch.datagrams[batch.count++] = {static_cast<const uint8_t*>(batch.iovecs[i].iov_base), length, truncated, channel, receivedNs};
+        }
+        datagrams.fetch_add(count, std::memory_order_relaxed);
+        bytes.fetch_add(received, std::memory_order_relaxed);
+        truncated.fetch_add(cut, std::memory_order_relaxed);
+        unmatched.fetch_add(stray, std::memory_order_relaxed);
+        return count;
+    }
+
+    void publish(size_t index) {
+        // Cannot fail, the queue holds every batch
+        filled.push(index);
+        size_t depth = filled.size();
+        if (depth > peakDepth.load(std::memory_order_relaxed)) {
+            peakDepth.store(depth, std::memory_order_relaxed);
+        }
+    }
+
+    void receive() {
+        struct epoll_event events[MAX_EVENTS];
+        size_t index = END;     // Batch being filled
+        size_t used = 0;        // Its messages read so far
+        while (!stopping.load(std::memory_order_relaxed)) {
+            int count = epoll_wait(epollFd, events, MAX_EVENTS, RECEIVE_TIMEOUT_MS);
+            if (count < 0) {
+                if (errno != EINTR) {
+                    perror("epoll_wait");
+                }
+                continue;
+            }
+
+            // Commands wait until the events are handled, since a leave may close a socket among them
+            bool wake = false;
+            for (int i = 0; i < count; i++) {
+                Port* port = static_cast<Port*>(events[i].data.ptr);
+                if (port == nullptr) {
+                    wake = true;
+                    continue;
+                }
+                // Level-triggered: one read per socket and round, so a busy channel cannot starve the others
+                if (index == END) {
+                    while (!spare.pop(index)) {
+                        stalls.fetch_add(1, std::memory_order_relaxed);
+                        spare.waitNotEmpty();
+                    }
+                    ring[index].count = 0;
+                    used = 0;
+                }
+                used += receiveFrom(port, ring[index], used);
+                if (used == batchSize) {
+                    publish(index);
+                    index = END;
+                }
+            }
+            // Whatever arrived this round goes to the consumer now rather than waiting for a full batch
+            if (index != END && used > 0) {
+                publish(index);
+                index = END;
+            }
+            if (wake) {
+                runCommands();
+            }
+        }
+        if (index != END) {
+            spare.push(index);
+        }
+        while (!ports.empty()) {
+            closePort(ports.begin()->second.get());
+        }
+        for (auto& channel : channels) {
+            channel->joined.store(false, std::memory_order_relaxed);
+        }
+        filled.push(END);
+    }
+
+    void dispatch() {
+        for (;;) {
+            size_t index;
+            if (!filled.pop(index)) {
+                filled.waitNotEmpty();
+                continue;
+            }
+            if (index == END) {
+                break;
+            }
+            Batch& batch = ring[index];
+            // Latency to consume: how long each datagram waited in the kernel and the queue
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            uint64_t now = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+            for (size_t i = 0; i < batch.count; i++) {
+                Channel* channel = batch.datagrams[i].channel;
+                uint64_t latency = now > batch.datagrams[i].receivedNs ? now - batch.datagrams[i].receivedNs : 0;
+                channel->consumed.store(channel->consumed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                channel->latencySum.store(channel->latencySum.load(std::memory_order_relaxed) + latency, std::memory_order_relaxed);
+                uint64_t max = channel->latencyMax.load(std::memory_order_relaxed);
+                while (latency > max && !channel->latencyMax.compare_exchange_weak(max, latency, std::memory_order_relaxed)) {
+                }
+            }
+            consumer(batch.datagrams.data(), batch.count);
+            spare.push(index);
+        }
+    }
+};
+
+#endif // RECEIVEENGINE_H
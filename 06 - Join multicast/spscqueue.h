@@ -0,0 +1,123 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <cstddef>
+#include <atomic>
+#include <vector>
+
+/**
+ * @brief Bounded lock-free queue between exactly one producer thread and one
+ * consumer thread.
+ *
+ * Items live in a ring whose size is a power of two; the producer only ever
+ * writes the tail index and the consumer the head index, each on its own
+ * cache line, and each side keeps a private copy of the other's index so it
+ * only reads the shared one when the ring looks full or empty. Either side
+ * can block in a wait until the other makes progress, which costs a futex
+ * call only when someone is actually waiting. A wait only returns once the
+ * other side has pushed or popped, so to shut a consumer down, push an item
+ * it recognizes as the end.
+ */
+template <typename T>
+class SpscQueue {
+public:
+    /**
+     * @brief Constructor.
+     * @param capacity Most items held at once, rounded up to a power of two.
+     */
+    explicit SpscQueue(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        items.resize(size);
+        mask = size - 1;
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    /**
+     * @brief Append an item. Producer only.
+     * @param item Item to copy in.
+     * @return False if the queue is full.
+     */
+    bool push(const T& item) {
+        size_t position = tail.load(std::memory_order_relaxed);
+        if (position - headCache == items.size()) {
+            headCache = head.load(std::memory_order_acquire);
+            if (position - headCache == items.size()) {
+                return false;
+            }
+        }
+        items[position & mask] = item;
+        tail.store(position + 1, std::memory_order_release);
+        tail.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Take the oldest item. Consumer only.
+     * @param item Set to the item.
+     * @return False if the queue is empty.
+     */
+    bool pop(T& item) {
+        size_t position = head.load(std::memory_order_relaxed);
+        if (position == tailCache) {
+            tailCache = tail.load(std::memory_order_acquire);
+            if (position == tailCache) {
+                return false;
+            }
+        }
+        item = items[position & mask];
+        head.store(position + 1, std::memory_order_release);
+        head.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Block until an item may be available. Consumer only; spurious returns are possible.
+     */
+    void waitNotEmpty() const {
+        size_t position = head.load(std::memory_order_relaxed);
+        tail.wait(position, std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Block until there may be room for an item. Producer only; spurious returns are possible.
+     */
+    void waitNotFull() const {
+        size_t position = tail.load(std::memory_order_relaxed);
+        head.wait(position - items.size(), std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Get the number of items queued. Exact only from the producer or consumer thread.
+     * @return Items queued.
+     */
+    size_t size() const {
+        // Head first: tail only grows, so it cannot be read behind it
+        size_t position = head.load(std::memory_order_acquire);
+        return tail.load(std::memory_order_acquire) - position;
+    }
+
+    /**
+     * @brief Get the most items held at once.
+     * @return Capacity.
+     */
+    size_t capacity() const {
+        return items.size();
+    }
+
+private:
+    static constexpr size_t CACHE_LINE = 64;
+
+    std::vector<T> items;
+    size_t mask;
+    alignas(CACHE_LINE) std::atomic<size_t> head{0};    // Next item to pop, written by the consumer
+    size_t tailCache = 0;                               // Consumer's last view of tail
+    alignas(CACHE_LINE) std::atomic<size_t> tail{0};    // Next slot to push, written by the producer
+    size_t headCache = 0;                               // Producer's last view of head
+};
+
+#endif // SPSCQUEUE_H